@@ -12,4 +12,13 @@ std::string lowerString(std::string s) {
     }
 
     return s;
-}
\ No newline at end of file
+}
+
+std::uint64_t fnv1aHash(const char *data, std::size_t length, std::uint64_t hash) {
+    for(std::size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
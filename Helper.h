@@ -4,6 +4,7 @@
 // Created by radu_ on 3/14/2021.
 //
 
+#include<cstdint>
 #include<string>
 #include<iostream>
 
@@ -12,5 +13,10 @@
 
 std::string lowerString(std::string s);
 
+//FNV-1a 64-bit hash, used for checksums and content hashes
+constexpr std::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+std::uint64_t fnv1aHash(const char *data, std::size_t length,
+                        std::uint64_t hash = FNV_OFFSET_BASIS);
+
 
 #endif //PROJECT_CLEAN_HELPER_H
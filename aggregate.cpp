@@ -0,0 +1,469 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the Aggregation class.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include "aggregate.h"
+#include "areas.h"
+#include "jsonwriter.h"
+#include "predicate.h"
+#include "snapshot.h"
+
+/*
+  Aggregation::Aggregation(groupBy, statistics)
+
+  @param groupBy
+    What to group the values by (none of area, measure and year more than
+    once), or nothing to aggregate all the values together
+
+  @param statistics
+    The statistics to calculate for each group, in the order to output them
+
+  @throws
+    std::invalid_argument if a key is given more than once, or there are no
+    statistics
+*/
+Aggregation::Aggregation(std::vector<Key> groupBy, std::vector<Statistic> statistics)
+    : groupBy(std::move(groupBy)), statistics(std::move(statistics)) {
+    for(Key key : this->groupBy) {
+        bool &grouped = key == AREA ? byArea : key == MEASURE ? byMeasure : byYear;
+        if(grouped) {
+            throw std::invalid_argument(std::string("Aggregation::Aggregation: Grouped by ")
+                                        + name(key) + " more than once");
+        }
+        grouped = true;
+    }
+
+    if(this->statistics.empty()) {
+        throw std::invalid_argument("Aggregation::Aggregation: No statistics to calculate");
+    }
+}
+
+std::vector<Aggregation::Key> const &Aggregation::getGroupBy() const {
+    return groupBy;
+}
+
+std::vector<Aggregation::Statistic> const &Aggregation::getStatistics() const {
+    return statistics;
+}
+
+const char *Aggregation::name(Key key) {
+    switch(key) {
+        case AREA:
+            return "area";
+        case MEASURE:
+            return "measure";
+        default:
+            return "year";
+    }
+}
+
+const char *Aggregation::name(Statistic statistic) {
+    switch(statistic) {
+        case SUM:
+            return "sum";
+        case MEAN:
+            return "mean";
+        case MIN:
+            return "min";
+        case MAX:
+            return "max";
+        default:
+            return "count";
+    }
+}
+
+/*
+  The position of the group of a value among all the possible groups: by
+  area number, then measure number, then year, for whichever are grouped by.
+*/
+std::size_t Aggregation::groupIndex(std::size_t area, std::size_t measure, int year) const {
+    std::size_t measures = byMeasure ? measureCodes.size() : 1;
+    std::size_t years = byYear ? static_cast<std::size_t>(lastYear - firstYear + 1) : 1;
+
+    std::size_t index = byArea ? area : 0;
+    index = index * measures + (byMeasure ? measure : 0);
+    index = index * years + (byYear ? static_cast<std::size_t>(year - firstYear) : 0);
+    return index;
+}
+
+/*
+  Aggregation::aggregate(areas)
+
+  Aggregate the values of every Measure of every Area, replacing anything
+  aggregated before.
+
+  @param areas
+    The Areas to aggregate the values of
+*/
+void Aggregation::aggregate(Areas const &areas) {
+    aggregateAll([&areas](auto &&visit) {
+        for(auto const &area : areas.getAreas()) {
+            visit(area);
+        }
+    });
+}
+
+/*
+  Aggregation::aggregate(snapshot, datasets, query)
+
+  Aggregate the values that loading datasets from a snapshot would give,
+  straight from the snapshot (see Snapshot::forEachArea()), replacing
+  anything aggregated before. Unless grouped by year, only the statistics
+  of each Measure are needed, which the snapshot's indexes give for any
+  window of years.
+
+  @param snapshot
+    The snapshot to aggregate the values of
+
+  @param datasets
+    The datasets to aggregate, in the order they are merged
+
+  @param query
+    The filters of the query, prepared for `snapshot`
+
+  @throws
+    std::runtime_error if a dataset is not in the snapshot
+*/
+void Aggregation::aggregate(Snapshot const &snapshot,
+                            std::vector<BethYw::InputFileSource> const &datasets,
+                            SnapshotQuery const &query) {
+    aggregateAll([&](auto &&visit) {
+        snapshot.forEachArea(datasets, query, byYear, visit);
+    });
+}
+
+/*
+  Aggregation::aggregate(snapshot, datasets, query, where, measuresFilter)
+
+  As above, for only the years that pass a condition, which is evaluated on
+  each area as it is merged from the snapshot (see Predicate::filter()).
+
+  @param where
+    The condition the years must pass
+
+  @param measuresFilter
+    The measure filter of the query; `query` must be prepared with
+    where.importFilter(measuresFilter)
+
+  @throws
+    std::runtime_error if a dataset is not in the snapshot
+*/
+void Aggregation::aggregate(Snapshot const &snapshot,
+                            std::vector<BethYw::InputFileSource> const &datasets,
+                            SnapshotQuery const &query,
+                            Predicate const &where,
+                            StringFilterSet const &measuresFilter) {
+    SnapshotAreaView passed;
+    aggregateAll([&](auto &&visit) {
+        snapshot.forEachArea(datasets, query, true, [&](SnapshotAreaView const &area) {
+            if(where.filter(area, measuresFilter, passed)) {
+                visit(static_cast<const SnapshotAreaView &>(passed));
+            }
+        });
+    });
+}
+
+/*
+  Aggregate the areas that `forEachArea(visit)` visits, in order of code,
+  in two passes: one to number the areas and measures and find the span of
+  years, and one to add up the values.
+*/
+template <typename ForEachArea>
+void Aggregation::aggregateAll(ForEachArea const &forEachArea) {
+    areaCodes.clear();
+    measureCodes.clear();
+    measureLabels.clear();
+    dense.clear();
+    sparse.clear();
+    firstYear = 0;
+    lastYear = -1;
+
+    //number the areas in order of code, and the measures (which may be in
+    //any of the areas) in order of code too, and find the span of years
+    std::map<std::string, std::string> labels;
+    bool anyValues = false;
+    forEachArea([&](auto const &area) {
+        areaCodes.push_back(codeOf(area));
+
+        for(auto const &measure : measuresOf(area)) {
+            labels.emplace(codeOf(measure), labelOf(measure));
+
+            int first, last;
+            if(spanOf(measure, first, last)) {
+                firstYear = anyValues ? std::min(firstYear, first) : first;
+                lastYear = anyValues ? std::max(lastYear, last) : last;
+                anyValues = true;
+            }
+        }
+    });
+
+    if(!anyValues) {
+        return;
+    }
+
+    std::unordered_map<std::string, std::size_t> measureNumbers;
+    for(auto const &label : labels) {
+        measureNumbers.emplace(label.first, measureCodes.size());
+        measureCodes.push_back(label.first);
+        measureLabels.push_back(label.second);
+    }
+
+    //the number of possible groups, stopping at the limit of a dense array
+    std::size_t possible = 1;
+    for(std::size_t size : {byArea ? areaCodes.size() : 1,
+                            byMeasure ? measureCodes.size() : 1,
+                            byYear ? static_cast<std::size_t>(lastYear - firstYear + 1) : 1}) {
+        possible = possible > MAX_DENSE_GROUPS / size ? MAX_DENSE_GROUPS + 1 : possible * size;
+    }
+    if(possible <= MAX_DENSE_GROUPS) {
+        dense.resize(possible);
+    }
+
+    auto groupAt = [this](std::size_t index) -> Group & {
+        return dense.empty() ? sparse[index] : dense[index];
+    };
+
+    std::size_t areaNumber = 0;
+    forEachArea([&](auto const &area) {
+        for(auto const &measure : measuresOf(area)) {
+            RangeStats stats;
+            if(!statsOf(measure, stats)) {
+                continue;
+            }
+
+            std::size_t measureNumber = measureNumbers.at(codeOf(measure));
+            auto const &data = dataOf(measure);
+
+            if(byYear && !dense.empty()) {
+                //the groups of the Measure's years are consecutive
+                Group *groups = &dense[groupIndex(areaNumber, measureNumber, firstYear)];
+                for(auto const &element : data) {
+                    Group &group = groups[element.first - firstYear];
+                    group.sum += element.second;
+                    group.min = std::min(group.min, element.second);
+                    group.max = std::max(group.max, element.second);
+                    group.count++;
+                }
+            } else if(byYear) {
+                for(auto const &element : data) {
+                    Group &group = groupAt(groupIndex(areaNumber, measureNumber, element.first));
+                    group.sum += element.second;
+                    group.min = std::min(group.min, element.second);
+                    group.max = std::max(group.max, element.second);
+                    group.count++;
+                }
+            } else {
+                //every value of the Measure is in the same group
+                Group &group = groupAt(groupIndex(areaNumber, measureNumber, firstYear));
+                group.sum += stats.sum;
+                group.min = std::min(group.min, stats.min);
+                group.max = std::max(group.max, stats.max);
+                group.count += static_cast<std::uint64_t>(stats.count);
+            }
+        }
+
+        areaNumber++;
+    });
+}
+
+/*
+  The groups that have any values, in order of area, measure and year.
+*/
+std::vector<Aggregation::Row> Aggregation::rows() const {
+    std::vector<std::pair<std::size_t, Group const *>> groups;
+    if(!dense.empty()) {
+        for(std::size_t i = 0; i < dense.size(); i++) {
+            if(dense[i].count > 0) {
+                groups.emplace_back(i, &dense[i]);
+            }
+        }
+    } else {
+        for(auto const &group : sparse) {
+            groups.emplace_back(group.first, &group.second);
+        }
+        std::sort(groups.begin(), groups.end(),
+                  [](std::pair<std::size_t, Group const *> const &a,
+                     std::pair<std::size_t, Group const *> const &b) {
+                      return a.first < b.first;
+                  });
+    }
+
+    //undo groupIndex()
+    std::size_t measures = byMeasure ? measureCodes.size() : 1;
+    std::size_t years = byYear ? static_cast<std::size_t>(lastYear - firstYear + 1) : 1;
+
+    std::vector<Row> rows;
+    rows.reserve(groups.size());
+    for(auto const &group : groups) {
+        std::size_t index = group.first;
+        int year = firstYear + static_cast<int>(index % years);
+        index /= years;
+        std::size_t measure = index % measures;
+        std::size_t area = index / measures;
+        rows.push_back(Row{area, measure, year, group.second});
+    }
+
+    return rows;
+}
+
+double Aggregation::value(Group const &group, Statistic statistic) const {
+    switch(statistic) {
+        case SUM:
+            return group.sum;
+        case MEAN:
+            return group.sum / static_cast<double>(group.count);
+        case MIN:
+            return group.min;
+        case MAX:
+            return group.max;
+        default:
+            return static_cast<double>(group.count);
+    }
+}
+
+/*
+  Aggregation::writeTable(os)
+
+  Write the aggregates as a table: a column for each key grouped by, then
+  one for each statistic, and a row for each group with any values.
+
+  @param os
+    The stream to write to
+*/
+void Aggregation::writeTable(std::ostream &os) const {
+    std::vector<Row> groups = rows();
+    if(groups.empty()) {
+        os << "<No values>" << std::endl;
+        return;
+    }
+
+    std::size_t measureWidth = 7;
+    for(auto const &code : measureCodes) {
+        measureWidth = std::max(measureWidth, code.size());
+    }
+
+    char cell[64];
+    std::string line;
+    for(Key key : groupBy) {
+        int width = key == AREA ? 9 : key == MEASURE ? static_cast<int>(measureWidth) : 4;
+        std::snprintf(cell, sizeof(cell), "%-*s  ", width, key == AREA ? "Area" : key == MEASURE ? "Measure" : "Year");
+        line += cell;
+    }
+    for(Statistic statistic : statistics) {
+        std::string heading = name(statistic);
+        heading[0] = static_cast<char>(heading[0] - 'a' + 'A');
+        std::snprintf(cell, sizeof(cell), "%15s ", heading.c_str());
+        line += cell;
+    }
+    line.back() = '\n';
+    os << line;
+
+    for(auto const &row : groups) {
+        line.clear();
+        for(Key key : groupBy) {
+            if(key == AREA) {
+                std::snprintf(cell, sizeof(cell), "%-9s  ", areaCodes[row.area].c_str());
+            } else if(key == MEASURE) {
+                std::snprintf(cell, sizeof(cell), "%-*s  ", static_cast<int>(measureWidth),
+                              measureCodes[row.measure].c_str());
+            } else {
+                std::snprintf(cell, sizeof(cell), "%-4d  ", row.year);
+            }
+            line += cell;
+        }
+
+        for(Statistic statistic : statistics) {
+            if(statistic == COUNT) {
+                std::snprintf(cell, sizeof(cell), "%15llu ",
+                              static_cast<unsigned long long>(row.group->count));
+            } else {
+                std::snprintf(cell, sizeof(cell), "%15.6f ", value(*row.group, statistic));
+            }
+            line += cell;
+        }
+        line.back() = '\n';
+        os << line;
+    }
+}
+
+/*
+  Aggregation::writeJSON(os)
+
+  Write the aggregates as a JSON array with an object for each group with
+  any values, e.g. [{"label":"Population","measure":"pop","sum":3063456.0,
+  "year":2010},...], streamed as it is produced.
+
+  @param os
+    The stream to write to
+*/
+void Aggregation::writeJSON(std::ostream &os) const {
+    //the fields of a group, in order of name as in all JSON output: a key
+    //(the measure has its label too) or a statistic
+    struct Field {
+        std::string name;
+        bool isKey;
+        Key key;
+        Statistic statistic;
+    };
+
+    std::vector<Field> fields;
+    for(Key key : groupBy) {
+        fields.push_back({name(key), true, key, SUM});
+        if(key == MEASURE) {
+            fields.push_back({"label", true, key, SUM});
+        }
+    }
+    for(Statistic statistic : statistics) {
+        fields.push_back({name(statistic), false, AREA, statistic});
+    }
+
+    auto byName = [](Field const &a, Field const &b) { return a.name < b.name; };
+    auto sameName = [](Field const &a, Field const &b) { return a.name == b.name; };
+    std::stable_sort(fields.begin(), fields.end(), byName);
+    fields.erase(std::unique(fields.begin(), fields.end(), sameName), fields.end());
+
+    JsonWriter writer(os);
+    writer.beginArray();
+    for(auto const &row : rows()) {
+        writer.beginObject();
+        for(Field const &field : fields) {
+            writer.key(field.name);
+            if(!field.isKey) {
+                if(field.statistic == COUNT) {
+                    writer.value(row.group->count);
+                } else {
+                    writer.value(value(*row.group, field.statistic));
+                }
+            } else if(field.key == AREA) {
+                writer.value(areaCodes[row.area]);
+            } else if(field.key == YEAR) {
+                writer.value(static_cast<std::int64_t>(row.year));
+            } else if(field.name == "label") {
+                writer.value(measureLabels[row.measure]);
+            } else {
+                writer.value(measureCodes[row.measure]);
+            }
+        }
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.flush();
+
+    os << std::endl;
+}
@@ -0,0 +1,112 @@
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the Aggregation class, which aggregates the values of
+  Areas across areas, measures and years (--group-by and --agg): e.g. the
+  total population of all the areas in each year, with --group-by
+  measure,year --agg sum, or the mean of every value of each measure, with
+  --group-by measure --agg mean.
+
+  Each value goes to the group of its area, measure and/or year (whichever
+  are grouped by), or to a single group if nothing is. The groups are kept
+  in a dense array, indexed by area, measure and year number, when there are
+  few enough possible groups, and in a hash table otherwise. The values of a
+  Measure are added to their groups in one pass over the Measure.
+
+  In server and batch mode the values are aggregated straight from the
+  snapshot the data is kept in (see Snapshot::forEachArea()), rather than
+  from an Areas object loaded from it for each query.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "areas.h"
+#include "datasets.h"
+
+class Predicate;
+class Snapshot;
+struct SnapshotQuery;
+
+class Aggregation {
+public:
+    enum Key { AREA, MEASURE, YEAR };
+    enum Statistic { SUM, MEAN, MIN, MAX, COUNT };
+
+    // the most groups kept in a dense array
+    static constexpr std::size_t MAX_DENSE_GROUPS = 1 << 20;
+
+    Aggregation(std::vector<Key> groupBy, std::vector<Statistic> statistics);
+
+    std::vector<Key> const &getGroupBy() const;
+    std::vector<Statistic> const &getStatistics() const;
+
+    void aggregate(Areas const &areas);
+    void aggregate(Snapshot const &snapshot,
+                   std::vector<BethYw::InputFileSource> const &datasets,
+                   SnapshotQuery const &query);
+    void aggregate(Snapshot const &snapshot,
+                   std::vector<BethYw::InputFileSource> const &datasets,
+                   SnapshotQuery const &query,
+                   Predicate const &where,
+                   StringFilterSet const &measuresFilter);
+
+    void writeTable(std::ostream &os) const;
+    void writeJSON(std::ostream &os) const;
+
+    static const char *name(Key key);
+    static const char *name(Statistic statistic);
+
+private:
+    struct Group {
+        double sum = 0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        std::uint64_t count = 0;
+    };
+
+    // a group that has values, in output order
+    struct Row {
+        std::size_t area;
+        std::size_t measure;
+        int year;
+        Group const *group;
+    };
+
+    std::vector<Key> groupBy;
+    std::vector<Statistic> statistics;
+
+    bool byArea = false;
+    bool byMeasure = false;
+    bool byYear = false;
+
+    std::vector<std::string> areaCodes;
+    std::vector<std::string> measureCodes;
+    std::vector<std::string> measureLabels;
+    int firstYear = 0;
+    int lastYear = -1;
+
+    std::vector<Group> dense;
+    std::unordered_map<std::uint64_t, Group> sparse;
+
+    template <typename ForEachArea>
+    void aggregateAll(ForEachArea const &forEachArea);
+
+    std::size_t groupIndex(std::size_t area, std::size_t measure, int year) const;
+    std::vector<Row> rows() const;
+    double value(Group const &group, Statistic statistic) const;
+};
+
+#endif // AGGREGATE_H_
@@ -20,6 +20,7 @@
 #include <stdexcept>
 
 #include "area.h"
+#include "tablewriter.h"
 
 /*
   TODO: Area::Area(localAuthorityCode)
@@ -51,7 +52,7 @@ Area::Area(const std::string& localAuthorityCode) {
     auto authCode = area.getLocalAuthorityCode();
 */
 
-std::string Area::getLocalAuthorityCode() const {
+std::string const &Area::getLocalAuthorityCode() const {
     return authorityCode;
 }
 
@@ -90,7 +91,7 @@ std::string Area::getName(std::string const &lang) const {
     return names.at(lang);
 }
 
-std::unordered_map<std::string, std::string> Area::getNamesList() const{
+std::unordered_map<std::string, std::string> const &Area::getNamesList() const{
     return names;
 }
 
@@ -264,10 +265,21 @@ int Area::size() const {
     return measures.size();
 }
 
-std::map<std::string, Measure> Area::getMeasuresList() const {
+std::map<std::string, Measure> const &Area::getMeasuresList() const {
     return measures;
 }
 
+/*
+  Area::buildIndexes()
+
+  Build the index of every Measure of the Area (see Measure::buildIndex()).
+*/
+void Area::buildIndexes() {
+    for(auto &measure : measures) {
+        measure.second.buildIndex();
+    }
+}
+
 /*
   TODO: operator<<(os, area)
 
@@ -301,37 +313,7 @@ std::map<std::string, Measure> Area::getMeasuresList() const {
 */
 
 std::ostream& operator<<(std::ostream& os, Area const &area) {
-
-    int i = 0;
-
-    if(area.getNamesList().empty()) {
-        os << "Unnamed\n";
-    } else {
-        for(std::pair<std::string, std::string> element : area.getNamesList()) {
-
-            os << element.second;
-
-
-            //check if there are more names to write after the current one
-            //if so, write " / ", otherwise write the local authority code
-            if(i < (area.getNamesList().size() - 1)) {
-                os << " / ";
-            } else {
-                os << " (" + area.getLocalAuthorityCode() + ")";
-            }
-
-            i++;
-        }
-    }
-
-    if(area.size() == 0) {
-        os << "\n<no measures>\n";
-    } else {
-        for(std::pair<std::string, Measure> element : area.getMeasuresList()) {
-            os << element.second << '\n';
-        }
-    }
-
+    TableWriter(os).write(area);
     return os;
 }
 
@@ -372,7 +354,7 @@ bool operator==(Area const &lhs, Area const &rhs) {
         //is thrown, then the values are not equal and the key does not
         //exist in both, meaning they are not equal
         try{
-            if(lhs.getNamesList()[element.first] != element.second)
+            if(lhs.getNamesList().at(element.first) != element.second)
                 return false;
 
         } catch(std::out_of_range &e) {
@@ -389,7 +371,7 @@ bool operator==(Area const &lhs, Area const &rhs) {
         //is thrown, then the values are not equal and the key does not
         //exist in both, meaning they are not equal
         try{
-            if(!(lhs.getMeasuresList()[element.first] == element.second))
+            if(!(lhs.getMeasuresList().at(element.first) == element.second))
                 return false;
 
         } catch(std::out_of_range &e) {
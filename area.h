@@ -36,11 +36,11 @@ public:
 
     Area() = default;
     Area(const std::string& localAuthorityCode);
-    std::string getLocalAuthorityCode() const;
+    std::string const &getLocalAuthorityCode() const;
     std::string getName(std::string const &lang) const;
     void setName(std::string lang, std::string const &name);
-    std::unordered_map<std::string, std::string> getNamesList() const;
-    std::map<std::string, Measure> getMeasuresList() const;
+    std::unordered_map<std::string, std::string> const &getNamesList() const;
+    std::map<std::string, Measure> const &getMeasuresList() const;
     Measure getMeasure(std::string key) const;
     void setMeasure(std::string key, Measure const &measure);
 
@@ -49,6 +49,8 @@ public:
 
     int size() const;
 
+    void buildIndexes();
+
 private:
     std::unordered_map<std::string, std::string> names;
     std::string authorityCode;
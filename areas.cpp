@@ -18,8 +18,10 @@
   must implement has a TODO block comment. 
 */
 
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <tuple>
 #include <unordered_set>
@@ -28,6 +30,11 @@
 
 #include "datasets.h"
 #include "areas.h"
+#include "input.h"
+#include "jsonwriter.h"
+#include "memstats.h"
+#include "profile.h"
+#include "tablewriter.h"
 
 /*
   An alias for the imported JSON parsing library.
@@ -90,6 +97,50 @@ void Areas::setArea(std::string const &localAuthorityCode, Area const &area) {
    // std::cout<<"\n\n-----------set area END --------------\n\n";
 }
 
+/*
+  Areas::merge(other)
+
+  Add every Area of another Areas object to this one, following the same
+  rules as setArea() (i.e. the Areas in `other` take precedence). This is how
+  the dataset loading pipeline combines the datasets it parsed separately.
+
+  @param other
+    The Areas object to merge into this one
+
+  @return
+    void
+
+  @example
+    Areas data = Areas();
+    Areas dataset = Areas();
+    ...
+    data.merge(dataset);
+*/
+void Areas::merge(Areas const &other) {
+    for(auto const &element : other.areas) {
+        setArea(element.first, element.second);
+    }
+}
+
+/*
+  Areas::buildIndexes()
+
+  Build the index of every Measure of every Area, so that the statistics of
+  any range of years can be found without scanning the values again (see
+  Measure::getRangeStats()). Merging or setting values afterwards discards
+  the indexes of the Measures changed.
+
+  @example
+    Areas data = Areas();
+    ...
+    data.buildIndexes();
+*/
+void Areas::buildIndexes() {
+    for(auto &area : areas) {
+        area.second.buildIndexes();
+    }
+}
+
 /*
   TODO: Areas::getArea(localAuthorityCode)
 
@@ -236,7 +287,10 @@ void Areas::populateFromAuthorityCodeCSV(
         area.setName("cym", cymName);
 
         //check if it is found in filter and if a filter exists
-        if(filterCheck(areasFilter, authorityCode, area.getNamesList())) {
+        bool accepted = filterCheck(areasFilter, authorityCode, area.getNamesList());
+        Profiler::countRows(accepted);
+
+        if(accepted) {
             setArea(authorityCode, area);
            // std::cout<< authorityCode + ", " + area.getName("eng") + ", " + area.getName("cym") << std::endl;
         }
@@ -277,7 +331,7 @@ bool yearFilterCheck(const YearFilterTuple * const yearsFilter, const int &year)
 bool filterCheck(const StringFilterSet * const filterSet,
                  std::string const &code,
                  std::unordered_map<std::string, std::string> const &names) {
-
+    MemStats::Scope filtering(MemStats::FILTERING);
 
     //we lower the letters in order to make the
     //filter case insensitive (e.g. swan = SWAN)
@@ -330,6 +384,7 @@ bool filterCheck(const StringFilterSet * const filterSet,
 bool filterCheck(const StringFilterSet * const filterSet,
                  std::string const &code,
                  std::string const &name){
+    MemStats::Scope filtering(MemStats::FILTERING);
 
     //we lower the letters in order to make the
     //filter case insensitive (e.g. swan = SWAN)
@@ -565,17 +620,15 @@ void Areas::populateFromWelshStatsJSON(
             area.setName("cym", cymName);
         }
 
-        if(filterCheck(areasFilter, area.getLocalAuthorityCode(), area.getNamesList())) {
-            if(filterCheck(measuresFilter, measureCode, measureName)) {
-                if(yearFilterCheck(yearsFilter, year)) {
-                    // std::cout<< authCode << " " << engName << " " << cymName << " " <<
-                    //measureName << " ("<< measureCode  << ") "<< measureValue  << " "<< year << "\n\n";
-
-                    area.setMeasure(measure.getCodename(), measure);
-                    setArea(authCode, area);
-                } // if(yearFilterCheck(yearsFilter, year))
-            } //end if measureFilter
-        } //end if areasFilter
+        bool accepted = filterCheck(areasFilter, area.getLocalAuthorityCode(), area.getNamesList())
+                        && filterCheck(measuresFilter, measureCode, measureName)
+                        && yearFilterCheck(yearsFilter, year);
+        Profiler::countRows(accepted);
+
+        if(accepted) {
+            area.setMeasure(measure.getCodename(), measure);
+            setArea(authCode, area);
+        }
     } //end  for (auto& el : j["value"].items())
 
     //std::cout<<"\n\n*************FINISHED READING FILE***************\n\n";
@@ -683,6 +736,9 @@ void Areas::populateFromAuthorityByYearCSV(
         std::string authorityCode = line.substr(0, split);
         line = line.erase(0, split + 1);
 
+        //every value of a row the area or measure filter rejects is rejected
+        bool rowAccepted = false;
+
         //if area is in filter
         //because there is no name for these values, we will only add the empty string
         if(filterCheck(areasFilter, authorityCode, "")) {
@@ -691,6 +747,7 @@ void Areas::populateFromAuthorityByYearCSV(
             std::string measureName = cols.at(BethYw::SINGLE_MEASURE_NAME);
 
             if(filterCheck(measuresFilter, measureCode, measureName)) {
+                rowAccepted = true;
                 split = line.find(',');
 
                 //throw exception if there are no commas
@@ -742,8 +799,16 @@ void Areas::populateFromAuthorityByYearCSV(
 
                 area.setMeasure(measure.getCodename(), measure);
                 setArea(authorityCode, area);
+
+                std::size_t kept = static_cast<std::size_t>(measure.size());
+                Profiler::countRows(true, kept);
+                Profiler::countRows(false, years.size() - kept);
             } // end if(filterCheck(measuresFilter, measureCode))
         } // end if(filterCheck(areasFilter, authorityCode))
+
+        if(!rowAccepted) {
+            Profiler::countRows(false, years.size());
+        }
     }//end while(!is.eof())
 }
 
@@ -818,6 +883,9 @@ void Areas::populate(std::istream &is,
     } else {
         throw std::runtime_error("Areas::populate: Unexpected data type");
     }
+
+    //the parsers may stop before the end of a compressed file
+    finishInput(is);
 }
 
 /*
@@ -932,6 +1000,9 @@ void Areas::populate(
   } else {
       throw std::runtime_error("Areas::populate: Unexpected data type");
   }
+
+  //the parsers may stop before the end of a compressed file
+  finishInput(is);
 }
 
 /*
@@ -1008,16 +1079,83 @@ void Areas::populate(
     std::cout << data.toJSON();
 */
 std::string Areas::toJSON() const {
-  json j;
-  
-  return j.dump();
+  std::ostringstream os;
+  writeJSON(os);
+  return os.str();
+}
+
+/*
+  Areas::writeJSON(os)
+
+  Write the JSON described for toJSON() straight to a stream, without
+  building a JSON document in memory first. Keys appear in the same (sorted)
+  order as nlohmann::json would put them in: each area has a "measures"
+  object, mapping each measure code to its values by year, if it has any
+  measures, and a "names" object mapping language codes to names.
+
+  @param os
+    The stream to write the JSON to
+
+  @example
+    Areas data = Areas();
+    data.writeJSON(std::cout);
+*/
+void Areas::writeJSON(std::ostream &os) const {
+  JsonWriter writer(os);
+
+  //names are kept unordered, so they are sorted into here for each area
+  std::vector<const std::pair<const std::string, std::string> *> sortedNames;
+
+  writer.beginObject();
+  for (auto const &areaEntry : areas) {
+    Area const &area = areaEntry.second;
+
+    writer.key(areaEntry.first);
+    writer.beginObject();
+
+    if (!area.getMeasuresList().empty()) {
+      writer.key("measures");
+      writer.beginObject();
+      for (auto const &measureEntry : area.getMeasuresList()) {
+        writer.key(measureEntry.first);
+        writer.beginObject();
+        for (auto const &value : measureEntry.second.getData()) {
+          writer.key(value.first);
+          writer.value(value.second);
+        }
+        writer.endObject();
+      }
+      writer.endObject();
+    }
+
+    sortedNames.clear();
+    for (auto const &name : area.getNamesList()) {
+      sortedNames.push_back(&name);
+    }
+    std::sort(sortedNames.begin(), sortedNames.end(),
+              [](const std::pair<const std::string, std::string> *lhs,
+                 const std::pair<const std::string, std::string> *rhs) {
+                return lhs->first < rhs->first;
+              });
+
+    writer.key("names");
+    writer.beginObject();
+    for (auto name : sortedNames) {
+      writer.key(name->first);
+      writer.value(name->second);
+    }
+    writer.endObject();
+
+    writer.endObject();
+  }
+  writer.endObject();
 }
 
 /**
  * Get the areas container.
  * @return The areas container
  */
-AreasContainer Areas::getAreas() const {
+AreasContainer const &Areas::getAreas() const {
     return areas;
 }
 
@@ -1129,14 +1267,7 @@ AreasContainer Areas::getAreas() const {
 */
 
 std::ostream& operator<<(std::ostream& os, Areas const &areas) {
-
-    if(areas.size() == 0) {
-        os << "<No areas>\n";
-    } else {
-        for(std::pair<std::string, Area> element : areas.getAreas()) {
-            os << element.second;
-        }
-    }
+    TableWriter(os).write(areas);
     return os;
 }
 
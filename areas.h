@@ -93,9 +93,11 @@ public:
   int size() const;
 
   void setArea(std::string const &localAuthorityCode, Area const &area);
+  void merge(Areas const &other);
+  void buildIndexes();
   Area getArea(std::string const &localAuthorityCode) const;
 
-  AreasContainer getAreas() const;
+  AreasContainer const &getAreas() const;
 
   void populateFromAuthorityCodeCSV(
       std::istream& is,
@@ -142,6 +144,7 @@ public:
   friend std::ostream& operator<<(std::ostream& os, const Areas &areas);
 
   std::string toJSON() const;
+  void writeJSON(std::ostream &os) const;
 };
 
 #endif // AREAS_H
\ No newline at end of file
@@ -0,0 +1,440 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the ArrowWriter class.
+
+  Each message of an Arrow IPC stream is a continuation marker (0xFFFFFFFF),
+  the length of its metadata, the metadata (a flatbuffer holding an
+  org.apache.arrow.flatbuf.Message, padded to 8 bytes), and a body holding
+  the buffers of the columns. The stream is a Schema message, a RecordBatch
+  message for each batch of rows, and an end-of-stream marker.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+#include "areas.h"
+#include "arrowwriter.h"
+#include "trace.h"
+
+namespace {
+
+// values from the Arrow flatbuffers schema (Schema.fbs, Message.fbs)
+const std::int16_t METADATA_V5 = 4;
+const std::uint8_t HEADER_SCHEMA = 1;
+const std::uint8_t HEADER_RECORD_BATCH = 3;
+const std::uint8_t TYPE_INT = 2;
+const std::uint8_t TYPE_FLOATING_POINT = 3;
+const std::uint8_t TYPE_UTF8 = 5;
+const std::int16_t PRECISION_DOUBLE = 2;
+
+/*
+  Lays out a flatbuffer front to back. Unlike the flatbuffers library, which
+  builds a buffer from the end, a table is written before the tables,
+  vectors and strings it refers to, as offsets in a flatbuffer must point
+  forwards; offset fields are written as placeholders and set with link()
+  once the object they refer to has been written.
+*/
+class FlatBuilder {
+public:
+    // a scalar or offset field of a table
+    struct Field {
+        std::uint16_t id;
+        std::size_t size;
+        std::uint64_t value;
+    };
+
+    static Field scalar(std::uint16_t id, std::size_t size, std::uint64_t value) {
+        return Field{id, size, value};
+    }
+
+    static Field offset(std::uint16_t id) {
+        return Field{id, 4, 0};
+    }
+
+    FlatBuilder() : buffer(4, 0) {}
+
+    /*
+      Write a table, preceded by its vtable.
+
+      @return
+        The position of each field by id, for link(), and of the table
+        itself as the last element
+    */
+    std::vector<std::size_t> table(std::vector<Field> const &fields) {
+        std::uint16_t slots = 0;
+        for(auto const &field : fields) {
+            slots = std::max<std::uint16_t>(slots, field.id + 1);
+        }
+
+        align(2, 0);
+        std::size_t vtable = grow(4 + 2 * slots);
+
+        align(4, 0);
+        std::size_t start = grow(4);
+
+        std::vector<std::size_t> positions(slots + 1, 0);
+        for(auto const &field : fields) {
+            align(field.size, 0);
+            std::size_t position = grow(field.size);
+            std::memcpy(&buffer[position], &field.value, field.size);
+
+            positions[field.id] = position;
+            put<std::uint16_t>(vtable + 4 + 2 * field.id,
+                               static_cast<std::uint16_t>(position - start));
+        }
+
+        put<std::uint16_t>(vtable, static_cast<std::uint16_t>(4 + 2 * slots));
+        put<std::uint16_t>(vtable + 2, static_cast<std::uint16_t>(buffer.size() - start));
+        put<std::int32_t>(start, static_cast<std::int32_t>(start - vtable));
+
+        positions[slots] = start;
+        return positions;
+    }
+
+    std::size_t string(std::string const &value) {
+        align(4, 0);
+        std::size_t start = grow(4 + value.size() + 1);
+        put<std::uint32_t>(start, static_cast<std::uint32_t>(value.size()));
+        std::memcpy(&buffer[start + 4], value.data(), value.size());
+        return start;
+    }
+
+    /*
+      Write a vector of `count` offsets, the i-th of which is at position
+      `start + 4 + 4 * i` for link().
+    */
+    std::size_t offsetVector(std::size_t count) {
+        align(4, 0);
+        std::size_t start = grow(4 + 4 * count);
+        put<std::uint32_t>(start, static_cast<std::uint32_t>(count));
+        return start;
+    }
+
+    /*
+      Write a vector of structs of two longs (a FieldNode or a Buffer).
+    */
+    std::size_t pairVector(std::vector<std::pair<std::int64_t, std::int64_t>> const &pairs) {
+        align(8, 4);
+        std::size_t start = grow(4 + 16 * pairs.size());
+        put<std::uint32_t>(start, static_cast<std::uint32_t>(pairs.size()));
+        for(std::size_t i = 0; i < pairs.size(); i++) {
+            put<std::int64_t>(start + 4 + 16 * i, pairs[i].first);
+            put<std::int64_t>(start + 12 + 16 * i, pairs[i].second);
+        }
+        return start;
+    }
+
+    // point the offset field at `from` to the object at `to`
+    void link(std::size_t from, std::size_t to) {
+        put<std::uint32_t>(from, static_cast<std::uint32_t>(to - from));
+    }
+
+    std::vector<std::uint8_t> finish(std::size_t root) {
+        link(0, root);
+        return std::move(buffer);
+    }
+
+private:
+    std::vector<std::uint8_t> buffer;
+
+    std::size_t grow(std::size_t length) {
+        std::size_t start = buffer.size();
+        buffer.resize(start + length, 0);
+        return start;
+    }
+
+    // pad the buffer until its size is `remainder` more than a multiple of `alignment`
+    void align(std::size_t alignment, std::size_t remainder) {
+        while(buffer.size() % alignment != remainder) {
+            buffer.push_back(0);
+        }
+    }
+
+    template <typename T>
+    void put(std::size_t position, T value) {
+        std::memcpy(&buffer[position], &value, sizeof(T));
+    }
+};
+
+/*
+  Append a buffer to the body of a record batch, padded to 8 bytes, and
+  note where it is.
+*/
+void addBuffer(std::vector<std::uint8_t> &body,
+               std::vector<std::pair<std::int64_t, std::int64_t>> &buffers,
+               const void *data,
+               std::size_t length) {
+    buffers.emplace_back(static_cast<std::int64_t>(body.size()),
+                         static_cast<std::int64_t>(length));
+
+    const std::uint8_t *bytes = static_cast<const std::uint8_t *>(data);
+    body.insert(body.end(), bytes, bytes + length);
+    body.resize((body.size() + 7) / 8 * 8, 0);
+}
+
+} // namespace
+
+void ArrowWriter::StringColumn::clear() {
+    offsets.assign(1, 0);
+    data.clear();
+    validity.clear();
+    nulls = 0;
+}
+
+void ArrowWriter::StringColumn::push(std::string const &value) {
+    std::size_t row = offsets.size() - 1;
+    if(row % 8 == 0) {
+        validity.push_back(0);
+    }
+    validity.back() |= static_cast<std::uint8_t>(1 << (row % 8));
+
+    data += value;
+    if(data.size() > static_cast<std::size_t>(INT32_MAX)) {
+        throw std::runtime_error("ArrowWriter::write: Too much text in one record batch");
+    }
+    offsets.push_back(static_cast<std::int32_t>(data.size()));
+}
+
+void ArrowWriter::StringColumn::pushNull() {
+    std::size_t row = offsets.size() - 1;
+    if(row % 8 == 0) {
+        validity.push_back(0);
+    }
+
+    nulls++;
+    offsets.push_back(static_cast<std::int32_t>(data.size()));
+}
+
+/*
+  ArrowWriter::ArrowWriter(os)
+
+  Create a writer.
+
+  @param os
+    The stream to write the Arrow IPC stream to, which should be opened in
+    binary mode
+*/
+ArrowWriter::ArrowWriter(std::ostream &os) : os(os) {}
+
+/*
+  ArrowWriter::write(areas)
+
+  Write `areas` as a complete Arrow IPC stream: the schema, the rows in
+  record batches, and the end-of-stream marker. Areas without Measures
+  have no rows, but their names still decide the name columns.
+
+  @param areas
+    The Areas to write
+
+  @throws
+    std::runtime_error if a record batch would hold more text in a column
+    than Arrow's 32-bit offsets can address
+*/
+void ArrowWriter::write(Areas const &areas) {
+    std::set<std::string> found;
+    for(auto const &area : areas.getAreas()) {
+        for(auto const &name : area.second.getNamesList()) {
+            found.insert(name.first);
+        }
+    }
+    languages.assign(found.begin(), found.end());
+    names.assign(languages.size(), StringColumn());
+
+    writeSchema();
+    startBatch();
+
+    for(auto const &areaElement : areas.getAreas()) {
+        Area const &area = areaElement.second;
+        auto const &areaNames = area.getNamesList();
+
+        for(auto const &measureElement : area.getMeasuresList()) {
+            Measure const &measure = measureElement.second;
+
+            for(auto const &value : measure.getData()) {
+                authorityCodes.push(area.getLocalAuthorityCode());
+                for(std::size_t i = 0; i < languages.size(); i++) {
+                    auto name = areaNames.find(languages[i]);
+                    if(name == areaNames.end()) {
+                        names[i].pushNull();
+                    } else {
+                        names[i].push(name->second);
+                    }
+                }
+                measureCodes.push(measure.getCodename());
+                measureLabels.push(measure.getLabel());
+                years.push_back(value.first);
+                values.push_back(value.second);
+
+                if(++rows == BATCH_ROWS) {
+                    writeBatch();
+                }
+            }
+        }
+    }
+
+    if(rows > 0) {
+        writeBatch();
+    }
+
+    // end-of-stream marker
+    const std::uint32_t end[2] = {0xFFFFFFFFu, 0};
+    os.write(reinterpret_cast<const char *>(end), sizeof(end));
+}
+
+/*
+  Write the Schema message describing the columns.
+*/
+void ArrowWriter::writeSchema() {
+    struct Column {
+        std::string name;
+        bool nullable;
+        std::uint8_t type;
+    };
+
+    std::vector<Column> columns;
+    columns.push_back({"authority_code", false, TYPE_UTF8});
+    for(auto const &language : languages) {
+        columns.push_back({"name_" + language, true, TYPE_UTF8});
+    }
+    columns.push_back({"measure_code", false, TYPE_UTF8});
+    columns.push_back({"measure_label", false, TYPE_UTF8});
+    columns.push_back({"year", false, TYPE_INT});
+    columns.push_back({"value", false, TYPE_FLOATING_POINT});
+
+    FlatBuilder fb;
+    auto message = fb.table({FlatBuilder::scalar(0, 2, METADATA_V5),
+                             FlatBuilder::scalar(1, 1, HEADER_SCHEMA),
+                             FlatBuilder::offset(2),
+                             FlatBuilder::scalar(3, 8, 0)});
+
+    auto schema = fb.table({FlatBuilder::scalar(0, 2, 0), FlatBuilder::offset(1)});
+    fb.link(message[2], schema.back());
+
+    std::size_t fields = fb.offsetVector(columns.size());
+    fb.link(schema[1], fields);
+
+    for(std::size_t i = 0; i < columns.size(); i++) {
+        auto field = fb.table({FlatBuilder::offset(0),
+                               FlatBuilder::scalar(1, 1, columns[i].nullable),
+                               FlatBuilder::scalar(2, 1, columns[i].type),
+                               FlatBuilder::offset(3),
+                               FlatBuilder::offset(5)});
+        fb.link(fields + 4 + 4 * i, field.back());
+
+        fb.link(field[0], fb.string(columns[i].name));
+
+        std::vector<std::size_t> type;
+        if(columns[i].type == TYPE_INT) {
+            type = fb.table({FlatBuilder::scalar(0, 4, 32), FlatBuilder::scalar(1, 1, 1)});
+        } else if(columns[i].type == TYPE_FLOATING_POINT) {
+            type = fb.table({FlatBuilder::scalar(0, 2, PRECISION_DOUBLE)});
+        } else {
+            type = fb.table({});
+        }
+        fb.link(field[3], type.back());
+
+        fb.link(field[5], fb.offsetVector(0));
+    }
+
+    writeMessage(fb.finish(message.back()), std::vector<std::uint8_t>());
+}
+
+/*
+  Write the rows gathered so far as a RecordBatch message, and start the
+  next batch.
+*/
+void ArrowWriter::writeBatch() {
+    Tracer::Span span("output", "write batch");
+    std::vector<std::uint8_t> body;
+    std::vector<std::pair<std::int64_t, std::int64_t>> nodes;
+    std::vector<std::pair<std::int64_t, std::int64_t>> buffers;
+
+    auto addStrings = [&](StringColumn const &column) {
+        nodes.emplace_back(static_cast<std::int64_t>(rows),
+                           static_cast<std::int64_t>(column.nulls));
+
+        //a column without nulls needs no validity bitmap
+        addBuffer(body, buffers, column.validity.data(),
+                  column.nulls > 0 ? column.validity.size() : 0);
+        addBuffer(body, buffers, column.offsets.data(),
+                  column.offsets.size() * sizeof(std::int32_t));
+        addBuffer(body, buffers, column.data.data(), column.data.size());
+    };
+
+    addStrings(authorityCodes);
+    for(auto const &column : names) {
+        addStrings(column);
+    }
+    addStrings(measureCodes);
+    addStrings(measureLabels);
+
+    nodes.emplace_back(static_cast<std::int64_t>(rows), 0);
+    addBuffer(body, buffers, nullptr, 0);
+    addBuffer(body, buffers, years.data(), years.size() * sizeof(std::int32_t));
+
+    nodes.emplace_back(static_cast<std::int64_t>(rows), 0);
+    addBuffer(body, buffers, nullptr, 0);
+    addBuffer(body, buffers, values.data(), values.size() * sizeof(double));
+
+    FlatBuilder fb;
+    auto message = fb.table({FlatBuilder::scalar(0, 2, METADATA_V5),
+                             FlatBuilder::scalar(1, 1, HEADER_RECORD_BATCH),
+                             FlatBuilder::offset(2),
+                             FlatBuilder::scalar(3, 8, body.size())});
+
+    auto batch = fb.table({FlatBuilder::scalar(0, 8, rows),
+                           FlatBuilder::offset(1),
+                           FlatBuilder::offset(2)});
+    fb.link(message[2], batch.back());
+    fb.link(batch[1], fb.pairVector(nodes));
+    fb.link(batch[2], fb.pairVector(buffers));
+
+    writeMessage(fb.finish(message.back()), body);
+    startBatch();
+}
+
+/*
+  Empty the columns, ready for the rows of the next record batch.
+*/
+void ArrowWriter::startBatch() {
+    authorityCodes.clear();
+    for(auto &column : names) {
+        column.clear();
+    }
+    measureCodes.clear();
+    measureLabels.clear();
+    years.clear();
+    values.clear();
+    rows = 0;
+}
+
+/*
+  Write an encapsulated message: the continuation marker, the length of the
+  metadata padded to 8 bytes, the metadata and the body.
+*/
+void ArrowWriter::writeMessage(std::vector<std::uint8_t> const &metadata,
+                               std::vector<std::uint8_t> const &body) {
+    static const char padding[8] = {};
+
+    std::size_t padded = (metadata.size() + 7) / 8 * 8;
+    const std::uint32_t prefix[2] = {0xFFFFFFFFu, static_cast<std::uint32_t>(padded)};
+
+    os.write(reinterpret_cast<const char *>(prefix), sizeof(prefix));
+    os.write(reinterpret_cast<const char *>(metadata.data()),
+             static_cast<std::streamsize>(metadata.size()));
+    os.write(padding, static_cast<std::streamsize>(padded - metadata.size()));
+    os.write(reinterpret_cast<const char *>(body.data()),
+             static_cast<std::streamsize>(body.size()));
+}
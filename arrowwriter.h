@@ -0,0 +1,85 @@
+#ifndef ARROWWRITER_H_
+#define ARROWWRITER_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the ArrowWriter class, which writes Areas as an Apache
+  Arrow IPC stream (--format arrow), so that analytics tools can read the
+  output as columns without parsing text, or map a file of it into memory.
+
+  The stream has one row for each value of each Measure of each Area, with
+  the columns:
+
+    authority_code  utf8
+    name_<lang>     utf8, null if the Area has no name in <lang> (one column
+                    for each language any of the Areas has a name in)
+    measure_code    utf8
+    measure_label   utf8
+    year            int32
+    value           float64
+
+  in order of authority code, then measure code, then year. The rows are
+  written in record batches of at most BATCH_ROWS rows.
+
+  The writer is self-contained: the flatbuffers holding the schema and the
+  record batch metadata are laid out by hand. Arrow and flatbuffers data is
+  little-endian, as are the platforms Beth Yw? is built for.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Areas;
+
+class ArrowWriter {
+public:
+    static constexpr std::size_t BATCH_ROWS = 1 << 16;
+
+    explicit ArrowWriter(std::ostream &os);
+
+    ArrowWriter(ArrowWriter const &) = delete;
+    ArrowWriter &operator=(ArrowWriter const &) = delete;
+
+    void write(Areas const &areas);
+
+private:
+    // the values of a utf8 column in the record batch being built
+    struct StringColumn {
+        std::vector<std::int32_t> offsets;
+        std::string data;
+        std::vector<std::uint8_t> validity;
+        std::size_t nulls = 0;
+
+        void clear();
+        void push(std::string const &value);
+        void pushNull();
+    };
+
+    std::ostream &os;
+
+    std::vector<std::string> languages;
+
+    StringColumn authorityCodes;
+    std::vector<StringColumn> names;
+    StringColumn measureCodes;
+    StringColumn measureLabels;
+    std::vector<std::int32_t> years;
+    std::vector<double> values;
+    std::size_t rows = 0;
+
+    void writeSchema();
+    void startBatch();
+    void writeBatch();
+    void writeMessage(std::vector<std::uint8_t> const &metadata,
+                      std::vector<std::uint8_t> const &body);
+};
+
+#endif // ARROWWRITER_H_
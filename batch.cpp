@@ -0,0 +1,353 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the batch mode of Beth Yw? (--batch FILE). Every line of
+  FILE is a JSON object describing one query, e.g.
+
+    {"id": "swansea-pop", "datasets": ["popden"], "areas": "W06000011",
+     "measures": ["pop", "dens"], "years": "2010-2015", "format": "json",
+     "output": "reports/swansea.json"}
+
+  All the fields are optional, and have the same meaning as the matching
+  program arguments (datasets, areas and measures can be a list or a
+  comma-separated string; format is "table", the default, "json", or
+  "arrow", which needs an "output" file as it is binary). A query with
+  "group-by" and/or "agg" fields (each a list or a comma-separated string)
+  outputs aggregates instead of values, and one with a "top" field (a
+  number) and optionally "by" outputs only the top areas. A "where" field
+  is a condition that the values of each year must meet to be output. The
+  union of the datasets of all the queries is imported once, and each query
+  is then answered from it.
+
+  For each query a JSON line is printed on the standard output, tagged with
+  the query's id (or its line number if it has none), holding either the
+  output, the file it was written to if the query has an "output" field, or
+  the error that stopped the query. A dataset that cannot be imported only
+  stops the queries that need it. The queries are answered in parallel on
+  a ThreadPool, but their results are printed in the order of the file.
+  Outputs are kept in a ResultCache, so a query repeated in the file is only
+  answered once.
+*/
+
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lib_cxxopts.hpp"
+#include "lib_json.hpp"
+
+#include "bethyw.h"
+#include "threadpool.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+/*
+  A query read from the batch file, as the program arguments it stands for.
+*/
+struct BatchQuery {
+    json id;
+    std::vector<std::string> arguments;
+    std::vector<std::string> datasets;
+    std::string output;
+    std::string error;
+};
+
+/*
+  Turn a list, or a comma-separated string, of values into one argument.
+*/
+std::string joinValues(json const &value, std::string const &field) {
+    if(value.is_string()) {
+        return value.get<std::string>();
+    }
+
+    if(value.is_array()) {
+        std::string joined;
+        for(auto const &item : value) {
+            if(!item.is_string()) {
+                throw std::invalid_argument("Expected strings in field: " + field);
+            }
+            if(!joined.empty()) {
+                joined += ',';
+            }
+            joined += item.get<std::string>();
+        }
+        return joined;
+    }
+
+    throw std::invalid_argument("Expected a string or a list of strings in field: " + field);
+}
+
+/*
+  Read one line of the batch file into a query. The id is read before any
+  other field, so that an error in another field is still tagged with it.
+*/
+void parseQuery(std::string const &line, BatchQuery &query) {
+    json object = json::parse(line);
+    if(!object.is_object()) {
+        throw std::invalid_argument("Expected a JSON object");
+    }
+
+    auto id = object.find("id");
+    if(id != object.end()) {
+        query.id = *id;
+    }
+
+    std::string datasets = "all";
+    bool binary = false;
+
+    for(auto it = object.begin(); it != object.end(); it++) {
+        std::string const &field = it.key();
+        json const &value = it.value();
+
+        if(field == "id") {
+            continue;
+        } else if(field == "datasets") {
+            datasets = joinValues(value, field);
+        } else if(field == "areas") {
+            query.arguments.push_back("-a");
+            query.arguments.push_back(joinValues(value, field));
+        } else if(field == "measures") {
+            query.arguments.push_back("-m");
+            query.arguments.push_back(joinValues(value, field));
+        } else if(field == "years") {
+            query.arguments.push_back("-y");
+            query.arguments.push_back(value.is_number_integer()
+                                      ? std::to_string(value.get<long long>())
+                                      : joinValues(value, field));
+        } else if(field == "format") {
+            std::string format = joinValues(value, field);
+            if(format != "table" && format != "json" && format != "arrow") {
+                throw std::invalid_argument("Unknown format: " + format);
+            }
+            query.arguments.push_back("--format");
+            query.arguments.push_back(format);
+            binary = format == "arrow";
+        } else if(field == "group-by" || field == "agg") {
+            query.arguments.push_back("--" + field);
+            query.arguments.push_back(joinValues(value, field));
+        } else if(field == "top") {
+            query.arguments.push_back("--top");
+            query.arguments.push_back(value.is_number_unsigned()
+                                      ? std::to_string(value.get<unsigned long long>())
+                                      : joinValues(value, field));
+        } else if(field == "by") {
+            query.arguments.push_back("--by");
+            query.arguments.push_back(joinValues(value, field));
+        } else if(field == "where") {
+            if(!value.is_string()) {
+                throw std::invalid_argument("Expected a string in field: " + field);
+            }
+            query.arguments.push_back("--where");
+            query.arguments.push_back(value.get<std::string>());
+        } else if(field == "output") {
+            query.output = joinValues(value, field);
+        } else {
+            throw std::invalid_argument("Unknown field: " + field);
+        }
+    }
+
+    if(binary && query.output.empty()) {
+        throw std::invalid_argument("The arrow format needs an output file");
+    }
+
+    //the datasets are always given explicitly, so the query does not
+    //depend on which other datasets the batch happens to load
+    query.arguments.push_back("-d");
+    query.arguments.push_back(datasets);
+}
+
+/*
+  The datasets a query needs, checking its arguments on the way.
+*/
+std::vector<BethYw::InputFileSource> queryDatasets(BatchQuery const &query) {
+    std::vector<std::string> arguments = query.arguments;
+    arguments.insert(arguments.begin(), "bethyw");
+
+    std::vector<char *> argv;
+    for(std::string &argument : arguments) {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    int argc = static_cast<int>(arguments.size());
+    char **argvp = argv.data();
+
+    auto cxxopts = BethYw::cxxoptsSetup();
+    auto args = cxxopts.parse(argc, argvp);
+
+    BethYw::parseAreasArg(args);
+    BethYw::parseMeasuresArg(args);
+    BethYw::parseYearsArg(args);
+    return BethYw::parseDatasetsArg(args);
+}
+
+} // namespace
+
+/*
+  BethYw::runBatch(batchPath, dir, cacheDir, resultCacheBytes)
+
+  Answer every query in a JSON Lines file (see the top of this file). Blank
+  lines are skipped. A query that fails does not stop the others.
+
+  @param batchPath
+    The path of the JSON Lines file
+
+  @param dir
+    The directory where the datasets are
+
+  @param cacheDir
+    The parse cache directory (see importDatasets()), or empty
+
+  @param resultCacheBytes
+    The size of the cache of query outputs (see resultcache.h), or 0 for
+    no cache
+
+  @return
+    Exit code: 0 if every query was answered, 1 otherwise
+
+  @throws
+    std::runtime_error if the file or areas.csv cannot be read
+*/
+int BethYw::runBatch(std::string const &batchPath,
+                     std::string const &dir,
+                     std::string const &cacheDir,
+                     std::size_t resultCacheBytes) {
+    std::ifstream file(batchPath);
+    if(!file.is_open()) {
+        throw std::runtime_error("BethYw::runBatch: Failed to open file " + batchPath);
+    }
+
+    std::vector<BatchQuery> queries;
+    std::vector<BethYw::InputFileSource> datasets;
+
+    std::string line;
+    for(unsigned int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        if(line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        BatchQuery query;
+        query.id = lineNumber;
+
+        try {
+            parseQuery(line, query);
+
+            for(auto const &src : queryDatasets(query)) {
+                query.datasets.push_back(src.CODE);
+
+                bool seen = false;
+                for(auto const &loaded : datasets) {
+                    seen = seen || loaded.CODE == src.CODE;
+                }
+                if(!seen) {
+                    datasets.push_back(src);
+                }
+            }
+        } catch(std::exception &e) {
+            query.error = e.what();
+        }
+
+        queries.push_back(std::move(query));
+    }
+
+    //a dataset that fails to import is left out, and fails only the
+    //queries that need it
+    std::shared_ptr<const Snapshot> store;
+    std::map<std::string, std::string> failures;
+    if(!datasets.empty()) {
+        store = loadStore(dir, datasets, cacheDir, &failures);
+    }
+
+    std::vector<BethYw::InputFileSource> loaded;
+    for(auto const &src : datasets) {
+        if(!failures.count(src.CODE)) {
+            loaded.push_back(src);
+        }
+    }
+
+    //a batch is answered from one load, so all of it is the same version
+    std::unique_ptr<ResultCache> cache;
+    if(resultCacheBytes > 0) {
+        cache.reset(new ResultCache(resultCacheBytes));
+    }
+
+    auto answer = [&store, &loaded, &failures, &cache](BatchQuery const &query) {
+        json result;
+        result["id"] = query.id;
+
+        try {
+            if(!query.error.empty()) {
+                throw std::invalid_argument(query.error);
+            }
+
+            for(auto const &code : query.datasets) {
+                auto failure = failures.find(code);
+                if(failure != failures.end()) {
+                    throw std::runtime_error("Failed to import dataset " + code + ": "
+                                             + failure->second);
+                }
+            }
+
+            std::ostringstream out;
+            answerQuery(*store, loaded, query.arguments, out, cache.get(), 1);
+
+            if(query.output.empty()) {
+                result["output"] = out.str();
+            } else {
+                std::ofstream outputFile(query.output, std::ios_base::out | std::ios_base::binary);
+                outputFile << out.str();
+                if(!outputFile) {
+                    throw std::runtime_error("Failed to write file " + query.output);
+                }
+                result["file"] = query.output;
+            }
+        } catch(std::exception &e) {
+            result.erase("output");
+            result["error"] = e.what();
+        }
+
+        return result;
+    };
+
+    //only a few results per worker are held at once, so the memory used
+    //does not grow with the size of the batch
+    ThreadPool pool;
+    std::size_t window = pool.size() * 4;
+    std::deque<std::future<json>> pendingResults;
+
+    int exitCode = 0;
+    std::size_t next = 0;
+    while(next < queries.size() || !pendingResults.empty()) {
+        while(next < queries.size() && pendingResults.size() < window) {
+            BatchQuery const *query = &queries[next++];
+            pendingResults.push_back(pool.submit([&answer, query]() { return answer(*query); }));
+        }
+
+        json result = pendingResults.front().get();
+        pendingResults.pop_front();
+
+        if(result.count("error")) {
+            exitCode = 1;
+        }
+        std::cout << result.dump() << '\n';
+    }
+    std::cout.flush();
+
+    return exitCode;
+}
@@ -0,0 +1,513 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains bethyw-benchmark, which runs a fixed suite of
+  representative Beth Yw? workloads a number of times each, and records the
+  median and 95th percentile of their wall time, peak resident set size and
+  rows (values output) per second. Given a baseline of an earlier run, it
+  also fails if any of them has regressed by more than a threshold, so that
+  it can gate changes. Build it, Beth Yw? and bethyw-generate with:
+
+    ./build.sh benchmark
+    ./build.sh generate
+    ./build.sh
+
+  and run it from bin/ (as Beth Yw? reads its data directories from ../):
+
+    ./bethyw-benchmark --runs 10 --output results.json
+    ./bethyw-benchmark --runs 10 --baseline ../tests/benchmark_baseline.json
+
+  The workloads run on a synthetic data directory (../benchmark-data by
+  default), which is written with bethyw-generate on the first run and kept
+  for the next: 100 areas with 10 measures each over 1971-2020, seed 7, so
+  that each run takes seconds rather than being dominated by starting the
+  process, as the ~25 ms runs on the bundled datasets are. The generator
+  writes the same files on every platform. The workloads import every
+  dataset but AQI (which cannot be parsed yet):
+
+    all datasets   every value, as tables
+    single area    the values of one area, as tables
+    year range     the values of six years, as tables
+    json output    every value, as JSON
+
+  Their output is discarded. The rows of each run are read from the "output"
+  phase of its --profile=json report. For the rows per second, the 95th
+  percentile is the rate 95% of the runs reached, i.e. the slow end as for
+  the other metrics.
+
+  A metric has regressed if it is worse than its baseline by more than the
+  threshold plus the noise of the runs: the spread between the median and
+  95th percentile (as a fraction of the median), of the baseline or of the
+  results, whichever is larger. Timings on a shared machine spread by 10-30%
+  even over seconds, while the resident set size barely does, so this allows
+  for the noise of each metric without raising the threshold for all.
+
+  The baseline in tests/ was recorded in a shared single-core Linux (x86-64)
+  container, not on dedicated hardware, with Beth Yw? built by build.sh
+  (unoptimised, so each run took 2.5-7.5 s) and
+
+    ./bethyw-benchmark --runs 20 --output ../tests/benchmark_baseline.json
+
+  It is only comparable with runs on similar hardware: record a new one on
+  the machine that runs the gate. Peak resident set sizes are only measured
+  on POSIX systems.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lib_cxxopts.hpp"
+#include "lib_json.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+namespace {
+
+const char *DATASETS = "popden,biz,trains,complete-popden,complete-pop,complete-area";
+
+// the arguments of bethyw-generate for the data directory of the workloads
+const std::vector<std::string> GENERATE = {
+    "--areas", "100", "--measures", "10", "--years", "1971-2020", "--seed", "7"};
+
+struct Workload {
+    std::string name;
+    std::vector<std::string> args;
+};
+
+/*
+  The workloads, on the data directory `data` (relative to the parent of the
+  working directory, as Beth Yw?'s --dir is).
+*/
+std::vector<Workload> workloads(std::string const &data) {
+    return {
+        {"all datasets", {"--dir", data, "-d", DATASETS}},
+        {"single area", {"--dir", data, "-d", DATASETS, "-a", "W00000001"}},
+        {"year range", {"--dir", data, "-d", DATASETS, "-y", "2010-2015"}},
+        {"json output", {"--dir", data, "-d", DATASETS, "--format", "json"}}
+    };
+}
+
+// the measurements of one run of a workload
+struct Run {
+    double seconds;
+    double peakResident;
+    double rowsPerSecond;
+};
+
+struct Summary {
+    double median;
+    double p95;
+};
+
+// a metric of the workloads, and whether more of it is better
+struct Metric {
+    const char *key;
+    bool higherIsBetter;
+};
+
+const Metric METRICS[] = {
+    {"wall_seconds", false},
+    {"peak_rss_bytes", false},
+    {"rows_per_second", true}
+};
+
+/*
+  Summarise the values of a metric over the runs: their median, and the
+  value 95% of the runs were at least as good as.
+*/
+Summary summarise(std::vector<double> values, bool higherIsBetter) {
+    std::sort(values.begin(), values.end());
+    if(higherIsBetter) {
+        std::reverse(values.begin(), values.end());
+    }
+
+    std::size_t n = values.size();
+    double median = n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+
+    //nearest rank
+    std::size_t rank = static_cast<std::size_t>(std::ceil(0.95 * n));
+    double p95 = values[std::max<std::size_t>(rank, 1) - 1];
+
+    return Summary{median, p95};
+}
+
+std::string readFile(std::string const &path) {
+    std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+    if(!file) {
+        throw std::runtime_error("Failed to open file " + path);
+    }
+
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+/*
+  The values output by a run, from its --profile=json report.
+*/
+double outputRows(std::string const &report) {
+    //the report is the last line of the standard error
+    std::size_t start = report.rfind("{\"phases\"");
+    if(start == std::string::npos) {
+        throw std::runtime_error("No profile in the output of Beth Yw?: " + report);
+    }
+
+    nlohmann::json profile = nlohmann::json::parse(report.substr(start));
+    for(auto const &phase : profile["phases"]) {
+        if(phase["phase"] == "output") {
+            return phase["accepted"].get<double>();
+        }
+    }
+
+    throw std::runtime_error("No output phase in the profile of Beth Yw?");
+}
+
+/*
+  Write the data directory of the workloads with bethyw-generate, unless an
+  earlier run has (generating it takes longer than a few runs).
+*/
+void generateData(std::string const &generate, std::string const &data) {
+    std::string directory = "../" + data;
+    if(std::ifstream(directory + "/areas.csv")) {
+        return;
+    }
+
+    std::string command = "\"" + generate + "\" --out \"" + directory + "\"";
+    for(auto const &arg : GENERATE) {
+        command += " " + arg;
+    }
+#ifdef _WIN32
+    command += " > NUL";
+#else
+    command += " > /dev/null";
+#endif
+
+    std::fprintf(stderr, "Generating %s with %s\n", directory.c_str(), generate.c_str());
+    if(std::system(command.c_str()) != 0) {
+        throw std::runtime_error("Failed to generate the data directory " + directory
+                                 + " with " + generate);
+    }
+}
+
+/*
+  Removes a temporary file when it goes out of scope.
+*/
+struct TemporaryFile {
+    std::string path;
+    ~TemporaryFile() { std::remove(path.c_str()); }
+};
+
+/*
+  Run Beth Yw? once with the arguments of a workload, discarding its output.
+*/
+Run runOnce(std::string const &bethyw, Workload const &workload) {
+    std::vector<std::string> args = {bethyw};
+    args.insert(args.end(), workload.args.begin(), workload.args.end());
+    args.push_back("--profile=json");
+
+    TemporaryFile errorsFile{"bethyw-benchmark.stderr"};
+    std::string const &errors = errorsFile.path;
+    Run run{0, 0, 0};
+
+#ifdef _WIN32
+    std::string command;
+    for(auto const &arg : args) {
+        command += "\"" + arg + "\" ";
+    }
+    command += "> NUL 2> " + errors;
+
+    auto started = std::chrono::steady_clock::now();
+    int status = std::system(command.c_str());
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    if(status != 0) {
+        throw std::runtime_error("Beth Yw? failed on workload " + workload.name);
+    }
+#else
+    std::vector<char *> argv;
+    for(auto &arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, errors.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    auto started = std::chrono::steady_clock::now();
+    pid_t pid;
+    int spawned = posix_spawn(&pid, bethyw.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if(spawned != 0) {
+        throw std::runtime_error("Failed to run " + bethyw);
+    }
+
+    int status;
+    struct rusage usage;
+    if(wait4(pid, &status, 0, &usage) != pid) {
+        throw std::runtime_error("Failed to wait for " + bethyw);
+    }
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error("Beth Yw? failed on workload " + workload.name + ": "
+                                 + readFile(errors));
+    }
+
+#ifdef __APPLE__
+    run.peakResident = static_cast<double>(usage.ru_maxrss);
+#else
+    run.peakResident = static_cast<double>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+
+    double rows = outputRows(readFile(errors));
+
+    run.rowsPerSecond = run.seconds > 0 ? rows / run.seconds : 0;
+    return run;
+}
+
+/*
+  Run every workload `runs` times on the data directory `data`, after one
+  untimed run of each to warm the file cache.
+*/
+nlohmann::json runWorkloads(std::string const &bethyw, std::string const &data, int runs) {
+    nlohmann::json results;
+    results["runs"] = runs;
+    results["generate"] = GENERATE;
+    results["workloads"] = nlohmann::json::array();
+
+    for(auto const &workload : workloads(data)) {
+        runOnce(bethyw, workload);
+
+        std::vector<double> metrics[3];
+        for(int i = 0; i < runs; i++) {
+            Run run = runOnce(bethyw, workload);
+            metrics[0].push_back(run.seconds);
+            metrics[1].push_back(run.peakResident);
+            metrics[2].push_back(run.rowsPerSecond);
+        }
+
+        nlohmann::json result;
+        result["name"] = workload.name;
+        result["args"] = workload.args;
+        for(int m = 0; m < 3; m++) {
+            Summary summary = summarise(metrics[m], METRICS[m].higherIsBetter);
+            result[METRICS[m].key] = {{"median", summary.median}, {"p95", summary.p95}};
+        }
+
+        std::fprintf(stderr, "%-14s %10.6f s %12.0f bytes %12.0f rows/s (medians)\n",
+                     workload.name.c_str(),
+                     result["wall_seconds"]["median"].get<double>(),
+                     result["peak_rss_bytes"]["median"].get<double>(),
+                     result["rows_per_second"]["median"].get<double>());
+
+        results["workloads"].push_back(result);
+    }
+
+    return results;
+}
+
+/*
+  The noise of a metric in a summary: the spread between its median and
+  95th percentile, as a fraction of the median.
+*/
+double noise(nlohmann::json const &summary) {
+    double median = summary["median"].get<double>();
+    double p95 = summary["p95"].get<double>();
+    return median > 0 ? std::fabs(p95 - median) / median : 0;
+}
+
+/*
+  Compare the results with a baseline, printing every metric of every
+  workload the baseline has.
+
+  @return
+    The number of metrics that regressed by more than `threshold` (a
+    fraction of the baseline) plus the noise of the baseline or results
+
+  @throws
+    std::runtime_error if the baseline was recorded on other data, or has a
+    workload that was not run
+*/
+int compare(nlohmann::json const &results, nlohmann::json const &baseline, double threshold) {
+    if(baseline["generate"] != results["generate"]) {
+        throw std::runtime_error("The baseline was recorded on other data: record a new one");
+    }
+
+    int regressions = 0;
+
+    std::printf("%-14s %-16s %-6s %14s %14s %9s %9s\n",
+                "Workload", "Metric", "", "Baseline", "Now", "Change", "Allowed");
+
+    for(auto const &expected : baseline["workloads"]) {
+        auto const &name = expected["name"];
+        auto measured = std::find_if(results["workloads"].begin(), results["workloads"].end(),
+                                     [&name](nlohmann::json const &w) { return w["name"] == name; });
+        if(measured == results["workloads"].end()) {
+            throw std::runtime_error("Workload of the baseline not run: " + name.get<std::string>());
+        }
+
+        for(auto const &metric : METRICS) {
+            for(const char *statistic : {"median", "p95"}) {
+                double before = expected[metric.key][statistic].get<double>();
+                double now = (*measured)[metric.key][statistic].get<double>();
+
+                //unmeasured (e.g. the resident set size on Windows)
+                if(before <= 0 || now <= 0) {
+                    continue;
+                }
+
+                double allowed = threshold + std::max(noise(expected[metric.key]),
+                                                      noise((*measured)[metric.key]));
+                double change = (now - before) / before;
+                bool regressed = metric.higherIsBetter ? change < -allowed : change > allowed;
+                if(regressed) {
+                    regressions++;
+                }
+
+                std::printf("%-14s %-16s %-6s %14.6g %14.6g %+8.1f%% %8.1f%%%s\n",
+                            name.get<std::string>().c_str(), metric.key, statistic,
+                            before, now, change * 100, allowed * 100,
+                            regressed ? "  REGRESSED" : "");
+            }
+        }
+    }
+
+    return regressions;
+}
+
+cxxopts::Options cxxoptsSetup() {
+    cxxopts::Options cxxopts(
+            "bethyw-benchmark",
+            "Runs a suite of Beth Yw? workloads and records, or checks against "
+            "a baseline, their wall time, peak resident set size and rows per "
+            "second.\n");
+
+    cxxopts.add_options()(
+        "bethyw",
+        "The Beth Yw? executable to run",
+        cxxopts::value<std::string>()->default_value("./bethyw"))(
+
+        "generate",
+        "The bethyw-generate executable to write the data directory with",
+        cxxopts::value<std::string>()->default_value("./bethyw-generate"))(
+
+        "data",
+        "The data directory to run the workloads on (written if it does not "
+        "exist), relative to the parent of the working directory as for "
+        "Beth Yw?'s --dir",
+        cxxopts::value<std::string>()->default_value("benchmark-data"))(
+
+        "runs",
+        "The number of timed runs of each workload",
+        cxxopts::value<int>()->default_value("10"))(
+
+        "output",
+        "Write the results to this JSON file (e.g. to record a baseline)",
+        cxxopts::value<std::string>())(
+
+        "baseline",
+        "Compare the results with this JSON file of earlier results, and fail "
+        "if any metric has regressed",
+        cxxopts::value<std::string>())(
+
+        "threshold",
+        "The fraction of its baseline by which a metric may regress, beyond "
+        "the noise of the runs",
+        cxxopts::value<double>()->default_value("0.2"))(
+
+        "h,help",
+        "Print usage.");
+
+    return cxxopts;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    auto cxxopts = cxxoptsSetup();
+
+    try {
+        auto args = cxxopts.parse(argc, argv);
+        if(args.count("help")) {
+            std::cerr << cxxopts.help() << std::endl;
+            return 0;
+        }
+
+        int runs = args["runs"].as<int>();
+        double threshold = args["threshold"].as<double>();
+        if(runs < 1) {
+            throw std::invalid_argument("Invalid input for runs argument");
+        }
+        if(!(threshold >= 0)) {
+            throw std::invalid_argument("Invalid input for threshold argument");
+        }
+
+        //read the baseline first, so that a bad path fails before the runs
+        nlohmann::json baseline;
+        if(args.count("baseline")) {
+            baseline = nlohmann::json::parse(readFile(args["baseline"].as<std::string>()));
+        }
+
+        std::string data = args["data"].as<std::string>();
+        generateData(args["generate"].as<std::string>(), data);
+
+        nlohmann::json results = runWorkloads(args["bethyw"].as<std::string>(), data, runs);
+
+        if(args.count("output")) {
+            std::ofstream output(args["output"].as<std::string>(),
+                                 std::ios_base::out | std::ios_base::binary);
+            output << results.dump(2) << '\n';
+            if(!output) {
+                throw std::runtime_error("Failed to write file " + args["output"].as<std::string>());
+            }
+        }
+
+        if(args.count("baseline")) {
+            int regressions = compare(results, baseline, threshold);
+            if(regressions > 0) {
+                std::printf("%d metric(s) regressed by more than %.0f%% and their noise\n",
+                            regressions, threshold * 100);
+                return 1;
+            }
+            std::printf("No metric regressed by more than %.0f%% and its noise\n",
+                        threshold * 100);
+        } else if(!args.count("output")) {
+            std::cout << results.dump(2) << std::endl;
+        }
+    } catch(std::exception &e) {
+        std::cerr << "bethyw-benchmark: " << e.what() << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
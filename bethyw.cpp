@@ -22,17 +22,135 @@
   additional functions not specified.
 */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <streambuf>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 #include "lib_cxxopts.hpp"
 
 #include "areas.h"
+#include "arrowwriter.h"
 #include "bethyw.h"
 #include "input.h"
+#include "memstats.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "tablewriter.h"
+#include "trace.h"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+/*
+  A stream buffer that passes everything written to it on to another, and
+  counts the bytes, so that --profile can report the size of the output.
+*/
+class CountingBuffer : public std::streambuf {
+public:
+    explicit CountingBuffer(std::streambuf *target) : target(target) {}
+
+    std::uint64_t written() const { return count; }
+
+protected:
+    int_type overflow(int_type c) override {
+        if(traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        count++;
+        return target->sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        std::streamsize put = target->sputn(s, n);
+        count += static_cast<std::uint64_t>(put);
+        return put;
+    }
+
+    int sync() override {
+        return target->pubsync();
+    }
+
+private:
+    std::streambuf *target;
+    std::uint64_t count = 0;
+};
+
+/*
+  The number of values held by all the Measures of all the Areas.
+*/
+static std::uint64_t countValues(Areas const &data) {
+    std::uint64_t values = 0;
+    for(auto const &area : data.getAreas()) {
+        for(auto const &measure : area.second.getMeasuresList()) {
+            values += static_cast<std::uint64_t>(measure.second.size());
+        }
+    }
+    return values;
+}
+
+/*
+  Finish profiling the run, if it is being profiled: record its total time
+  and report every phase on the standard error.
+*/
+static void reportProfile(std::unique_ptr<Profiler> &profiler,
+                          bool json,
+                          Profiler::Clock::time_point started) {
+    if(!profiler) {
+        return;
+    }
+
+    profiler->record({"total", "", Profiler::since(started), 0, 0, 0});
+    profiler->report(std::cerr, json);
+
+    Profiler::setActive(nullptr);
+    profiler.reset();
+}
+
+/*
+  Report the allocations of the run and the footprint of `data` (or leave
+  it out, if nullptr), if MemStats is enabled, on the standard error.
+*/
+static void reportMemStats(bool json, Areas const *data) {
+    if(!MemStats::enabled()) {
+        return;
+    }
+
+    MemStats::report(std::cerr, json, data);
+    MemStats::setEnabled(false);
+}
+
+/*
+  Write the timeline of the run to `path`, if it is being traced, and stop
+  tracing.
+*/
+static void writeTrace(std::unique_ptr<Tracer> &tracer, std::string const &path) {
+    if(!tracer) {
+        return;
+    }
+
+    Tracer::setActive(nullptr);
+    tracer->write(path);
+    tracer.reset();
+}
 
 /*
   Run Beth Yw?, parsing the command line arguments, importing the data,
@@ -51,6 +169,8 @@
     Exit code
 */
 int BethYw::run(int argc, char *argv[]) {
+  auto started = Profiler::Clock::now();
+  Tracer::nameThread("main");
   auto cxxopts = BethYw::cxxoptsSetup();
   auto args = cxxopts.parse(argc, argv);
   // Print the help usage if requested
@@ -59,35 +179,309 @@ int BethYw::run(int argc, char *argv[]) {
     return 0;
   }
 
+  // Count the allocations of the run if asked to (a server runs until it is
+  // stopped, so is never counted)
+  bool memStats = args.count("mem-stats") && !args.count("serve");
+  bool memStatsJSON = memStats && BethYw::parseMemStatsArg(args);
+  MemStats::setEnabled(memStats);
+
   // Parse data directory argument
   std::string dir = args["dir"].as<std::string>() + DIR_SEP;
+  std::string cacheDir = args.count("cache") ? args["cache"].as<std::string>() + DIR_SEP : "";
+  std::size_t resultCacheBytes = args["result-cache"].as<std::size_t>() << 20;
 
   // Parse other arguments and import data
+   MemStats::Scope filtering(MemStats::FILTERING);
    auto datasetsToImport = BethYw::parseDatasetsArg(args);
    auto areasFilter      = BethYw::parseAreasArg(args);
    auto measuresFilter   = BethYw::parseMeasuresArg(args);
    auto yearsFilter      = BethYw::parseYearsArg(args);
+   auto format           = BethYw::parseFormatArg(args);
+   auto aggregation      = BethYw::parseAggregationArgs(args);
+   auto ranking          = BethYw::parseRankingArgs(args);
+   auto predicate        = BethYw::parseWhereArg(args);
+   auto importFilter     = predicate ? predicate->importFilter(measuresFilter) : measuresFilter;
+   MemStats::Scope other(MemStats::OTHER);
+
+   // Profile the run if asked to (a server runs until it is stopped, so
+   // is never profiled); counting the hardware events implies profiling
+   std::unique_ptr<Profiler> profiler;
+   bool profileJSON = false;
+   if ((args.count("profile") || args.count("counters")) && !args.count("serve")) {
+       profileJSON = args.count("profile") && BethYw::parseProfileArg(args);
+       profiler.reset(new Profiler());
+       if (args.count("counters")) {
+           profiler->countHardware();
+       }
+       Profiler::setActive(profiler.get());
+       profiler->record({"arguments", "", Profiler::since(started), 0, 0, 0});
+   }
+
+   // Record a timeline of the run if asked to (again, not of a server)
+   std::unique_ptr<Tracer> tracer;
+   std::string tracePath = args.count("trace") ? args["trace"].as<std::string>() : "";
+   if (!tracePath.empty() && !args.count("serve")) {
+       tracer.reset(new Tracer());
+       Tracer::setActive(tracer.get());
+   }
+
+   if (args.count("snapshot")) {
+       BethYw::buildSnapshot(dir, datasetsToImport, cacheDir);
+   }
+
+   if (args.count("batch")) {
+       int code = BethYw::runBatch(args["batch"].as<std::string>(), dir, cacheDir, resultCacheBytes);
+       reportProfile(profiler, profileJSON, started);
+       reportMemStats(memStatsJSON, nullptr);
+       writeTrace(tracer, tracePath);
+       return code;
+   }
+
+   if (args.count("serve")) {
+       return BethYw::serve(args["serve"].as<std::string>(),
+                            dir,
+                            datasetsToImport,
+                            cacheDir,
+                            resultCacheBytes);
+   }
 
    Areas data = Areas();
 
-   BethYw::loadAreas(data, dir, areasFilter);
+   auto loadStarted = Profiler::start();
+   Profiler::RowCounts snapshotRows;
+   bool fromSnapshot;
+   {
+       Profiler::CountRows counting(profiler ? &snapshotRows : nullptr);
+       MemStats::Scope parsing(MemStats::PARSING);
+       Tracer::Span span("import", "snapshot");
+       fromSnapshot = BethYw::loadSnapshot(data,
+                                           dir,
+                                           datasetsToImport,
+                                           areasFilter,
+                                           importFilter,
+                                           yearsFilter);
+   }
+
+   if (fromSnapshot && profiler) {
+       profiler->record({"snapshot", "", 0, 0, snapshotRows.accepted, snapshotRows.rejected},
+                        loadStarted);
+   }
 
-   BethYw::loadDatasets(data,
-                        dir,
-                        datasetsToImport,
-                        areasFilter,
-                        measuresFilter,
-                        yearsFilter);
+   if (!fromSnapshot) {
+       BethYw::loadAreas(data, dir, areasFilter);
 
-  if (args.count("json")) {
+       BethYw::loadDatasets(data,
+                            dir,
+                            datasetsToImport,
+                            areasFilter,
+                            importFilter,
+                            yearsFilter,
+                            cacheDir);
+   }
+
+  // Keep only the years of each area that pass the --where condition
+  if (predicate) {
+    auto whereStarted = Profiler::start();
+    std::uint64_t values = profiler ? countValues(data) : 0;
+    {
+      MemStats::Scope condition(MemStats::FILTERING);
+      Tracer::Span span("filter", "where");
+      data = predicate->filter(data, measuresFilter);
+    }
+
+    if (profiler) {
+      std::uint64_t passed = countValues(data);
+      profiler->record({"where", "", 0, 0, passed, values - passed}, whereStarted);
+    }
+  }
+
+  // When profiling, the output goes through a buffer that counts its bytes
+  auto outputStarted = Profiler::start();
+  CountingBuffer counter(std::cout.rdbuf());
+  std::ostream counted(&counter);
+  std::ostream &out = profiler ? counted : std::cout;
+  MemStats::Scope output(MemStats::OUTPUT);
+  {
+    Tracer::Span span("output", "output");
+
+    // (the hardware counters only count this thread, so if they are being
+    // counted the tables are rendered on it)
+    if (aggregation) {
+      BethYw::writeAggregation(out, data, *aggregation, format);
+    } else if (ranking) {
+      BethYw::writeRanking(out, data, *ranking, format);
+    } else if (format == BethYw::OutputFormat::TABLE && !(profiler && profiler->countsHardware())) {
+      ThreadPool pool;
+      BethYw::writeOutput(out, data, format, &pool);
+    } else {
+#ifdef _WIN32
+      // Arrow output is binary, so must not have its new lines translated
+      _setmode(_fileno(stdout), _O_BINARY);
+#endif
+      BethYw::writeOutput(out, data, format);
+    }
+    out.flush();
+  }
+
+  if (profiler) {
+    profiler->record({"output", "", 0, counter.written(), countValues(data), 0},
+                     outputStarted);
+  }
+  reportProfile(profiler, profileJSON, started);
+  reportMemStats(memStatsJSON, &data);
+  writeTrace(tracer, tracePath);
+
+  return 0;
+}
+
+/*
+  Aggregates and top areas are only output as tables or JSON; the arrow
+  format only holds values.
+*/
+static void checkSummaryFormat(BethYw::OutputFormat format, const char *what) {
+  if (format == BethYw::OutputFormat::ARROW) {
+    throw std::invalid_argument(std::string(what) + " cannot be output in the arrow format");
+  }
+}
+
+/*
+  BethYw::writeOutput(os, data, format, pool)
+
+  Output the imported data as tables or as JSON, followed by a new line, or
+  as an Arrow IPC stream (see arrowwriter.h).
+
+  @param os
+    The stream to write to
+
+  @param data
+    The imported data
+
+  @param format
+    The format to output the data in
+
+  @param pool
+    Workers to render the tables on (see TableWriter::write(areas, pool)),
+    or nullptr to render them on this thread. This must not be one of the
+    workers of `pool`.
+*/
+void BethYw::writeOutput(std::ostream &os,
+                         Areas const &data,
+                         OutputFormat format,
+                         ThreadPool *pool) {
+  if (format == OutputFormat::ARROW) {
+    ArrowWriter(os).write(data);
+  } else if (format == OutputFormat::JSON) {
     // The output as JSON
-    std::cout << data.toJSON() << std::endl;
+    data.writeJSON(os);
+    os << std::endl;
+  } else if (pool != nullptr) {
+    //  The output as tables, rendered in parallel
+    TableWriter(os).write(data, *pool);
+    os << std::endl;
   } else {
    //  The output as tables
-    std::cout << data << std::endl;
+    os << data << std::endl;
   }
+}
 
-  return 0;
+/*
+  BethYw::writeAggregation(os, data, aggregation, format)
+
+  Aggregate the imported data and output the aggregates as a table or as
+  JSON.
+
+  @param os
+    The stream to write to
+
+  @param data
+    The imported data
+
+  @param aggregation
+    The groups and statistics to aggregate the data into
+
+  @param format
+    The format to output the aggregates in
+
+  @throws
+    std::invalid_argument if the format is arrow, which only holds values
+*/
+void BethYw::writeAggregation(std::ostream &os,
+                              Areas const &data,
+                              Aggregation &aggregation,
+                              OutputFormat format) {
+  checkSummaryFormat(format, "Aggregates");
+  aggregation.aggregate(data);
+  writeAggregation(os, aggregation, format);
+}
+
+/*
+  BethYw::writeAggregation(os, aggregation, format)
+
+  Output aggregates that have already been aggregated (e.g. straight from a
+  snapshot) as a table or as JSON.
+
+  @throws
+    std::invalid_argument if the format is arrow, which only holds values
+*/
+void BethYw::writeAggregation(std::ostream &os,
+                              Aggregation const &aggregation,
+                              OutputFormat format) {
+  checkSummaryFormat(format, "Aggregates");
+  if (format == OutputFormat::JSON) {
+    aggregation.writeJSON(os);
+  } else {
+    aggregation.writeTable(os);
+  }
+}
+
+/*
+  BethYw::writeRanking(os, data, ranking, format)
+
+  Rank the areas of the imported data and output the top ones of each
+  measure as a table or as JSON.
+
+  @param os
+    The stream to write to
+
+  @param data
+    The imported data
+
+  @param ranking
+    The number of areas and the statistic to rank them by
+
+  @param format
+    The format to output the top areas in
+
+  @throws
+    std::invalid_argument if the format is arrow, which only holds values
+*/
+void BethYw::writeRanking(std::ostream &os,
+                          Areas const &data,
+                          Ranking &ranking,
+                          OutputFormat format) {
+  checkSummaryFormat(format, "Top areas");
+  ranking.rank(data);
+  writeRanking(os, ranking, format);
+}
+
+/*
+  BethYw::writeRanking(os, ranking, format)
+
+  Output top areas that have already been ranked (e.g. straight from a
+  snapshot) as a table or as JSON.
+
+  @throws
+    std::invalid_argument if the format is arrow, which only holds values
+*/
+void BethYw::writeRanking(std::ostream &os,
+                          Ranking const &ranking,
+                          OutputFormat format) {
+  checkSummaryFormat(format, "Top areas");
+  if (format == OutputFormat::JSON) {
+    ranking.writeJSON(os);
+  } else {
+    ranking.writeTable(os);
+  }
 }
 
 /*
@@ -134,7 +528,90 @@ cxxopts::Options BethYw::cxxoptsSetup() {
       cxxopts::value<std::string>()->default_value("0"))(
 
       "j,json",
-      "Print the output as JSON instead of tables.")(
+      "Print the output as JSON instead of tables (the same as --format json).")(
+
+      "format",
+      "The format of the output: table, json, or arrow (an Apache Arrow IPC "
+      "stream of the values, for analytics tools)",
+      cxxopts::value<std::string>()->default_value("table"))(
+
+      "group-by",
+      "Aggregate the values across areas instead of printing them, grouped "
+      "by a comma-separated list of area, measure and/or year (or 'none' to "
+      "aggregate all the values together)",
+      cxxopts::value<std::vector<std::string>>())(
+
+      "agg",
+      "The statistics of each group to output when aggregating, as a "
+      "comma-separated list of sum, mean, min, max and count (omit or set to "
+      "'all' for all of them); implies --group-by none if that is not given",
+      cxxopts::value<std::vector<std::string>>())(
+
+      "top",
+      "Print only the areas with the highest value of a statistic (--by) "
+      "of each measure, this many for each measure",
+      cxxopts::value<std::size_t>())(
+
+      "by",
+      "The statistic of each measure to find the top areas by: average, "
+      "diff, pct-diff, or value:YYYY for the value in year YYYY",
+      cxxopts::value<std::string>()->default_value("average"))(
+
+      "where",
+      "Keep only the years of each area whose values meet a condition, "
+      "e.g. \"pop>100000 and dens<50\": comparisons (<, <=, >, >=, =, !=) "
+      "of measure codes with numbers or each other, combined with and, or, "
+      "not and parentheses (the measures compared are imported, and only "
+      "output if --measures selects them)",
+      cxxopts::value<std::string>())(
+
+      "snapshot",
+      "Save the imported datasets as a snapshot in the data directory, which "
+      "later runs load instead of the files for as long as it is up to date")(
+
+      "cache",
+      "Directory in which to keep the parsed contents of each dataset file, "
+      "so that only the files that have changed since are parsed again",
+      cxxopts::value<std::string>())(
+
+      "serve",
+      "Load the datasets once and answer queries, given as the arguments "
+      "of this program one query per line, on this Unix domain socket",
+      cxxopts::value<std::string>())(
+
+      "batch",
+      "Answer every query in this JSON Lines file, loading the datasets "
+      "they need only once",
+      cxxopts::value<std::string>())(
+
+      "result-cache",
+      "The size in MiB of the cache of query outputs in --serve and --batch "
+      "mode (0 for no cache)",
+      cxxopts::value<std::size_t>()->default_value(DEFAULT_RESULT_CACHE_MB))(
+
+      "profile",
+      "Time each phase of the run and report it, with the bytes and rows "
+      "each phase handled, on the standard error as a table (or as JSON, "
+      "with --profile=json)",
+      cxxopts::value<std::string>()->implicit_value("table"))(
+
+      "counters",
+      "Also count the CPU cycles, instructions, cache misses and branch "
+      "misses of each phase with the hardware performance counters (Linux "
+      "only), implying --profile")(
+
+      "trace",
+      "Record when each dataset is opened, parsed, filtered and merged and "
+      "the output rendered, on which thread, and write it to this file in "
+      "the Chrome Trace Event format (for chrome://tracing or Perfetto)",
+      cxxopts::value<std::string>())(
+
+      "mem-stats",
+      "Count the allocations and bytes allocated by parsing, building the "
+      "store, filtering and output, estimate the memory the loaded data "
+      "takes up, and report them on the standard error as tables (or as "
+      "JSON, with --mem-stats=json)",
+      cxxopts::value<std::string>()->implicit_value("table"))(
 
       "h,help",
       "Print usage.");
@@ -391,6 +868,296 @@ YearFilterTuple BethYw::parseYearsArg(cxxopts::ParseResult& args) {
     return (YearFilterTuple(x, y));
 }
 
+/*
+  BethYw::parseFormatArg(args)
+
+  Parse the format argument, and the json argument which is a shorthand for
+  --format json.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The format to output the data in
+
+  @throws
+    std::invalid_argument if the format is not table, json or arrow, or if
+    the json argument is given with another format
+*/
+BethYw::OutputFormat BethYw::parseFormatArg(cxxopts::ParseResult& args) {
+    std::string format = lowerString(args["format"].as<std::string>());
+    bool json = args.count("json") > 0;
+
+    if(format == "json" || (json && format == "table")) {
+        return OutputFormat::JSON;
+    }
+
+    if(json) {
+        throw std::invalid_argument("Conflicting output formats: json and " + format);
+    }
+
+    if(format == "table") {
+        return OutputFormat::TABLE;
+    } else if(format == "arrow") {
+        return OutputFormat::ARROW;
+    }
+
+    throw std::invalid_argument("Invalid input for format argument: " + format);
+}
+
+/*
+  BethYw::parseProfileArg(args)
+
+  Parse the profile argument, which is "table" if it is given without a
+  value.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    true if the profile should be reported as JSON, false for a table
+
+  @throws
+    std::invalid_argument if the argument is not table or json
+*/
+bool BethYw::parseProfileArg(cxxopts::ParseResult& args) {
+    std::string profile = lowerString(args["profile"].as<std::string>());
+
+    if(profile != "table" && profile != "json") {
+        throw std::invalid_argument("Invalid input for profile argument: " + profile);
+    }
+
+    return profile == "json";
+}
+
+/*
+  BethYw::parseMemStatsArg(args)
+
+  Parse the mem-stats argument, which is "table" if it is given without a
+  value.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    true if the memory statistics should be reported as JSON, false for
+    tables
+
+  @throws
+    std::invalid_argument if the argument is not table or json
+*/
+bool BethYw::parseMemStatsArg(cxxopts::ParseResult& args) {
+    std::string memStats = lowerString(args["mem-stats"].as<std::string>());
+
+    if(memStats != "table" && memStats != "json") {
+        throw std::invalid_argument("Invalid input for mem-stats argument: " + memStats);
+    }
+
+    return memStats == "json";
+}
+
+/*
+  BethYw::parseGroupByArg(args)
+
+  Parse the group-by argument, a comma-separated list of what to group the
+  values by when aggregating them.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The keys to group by, in the order given, or none if the values should
+    all be aggregated together (the argument is omitted or "none")
+
+  @throws
+    std::invalid_argument if the argument contains anything other than
+    area, measure, year or none, or one of them more than once
+*/
+std::vector<Aggregation::Key> BethYw::parseGroupByArg(cxxopts::ParseResult& args) {
+    std::vector<Aggregation::Key> groupBy;
+    if(!args.count("group-by")) {
+        return groupBy;
+    }
+
+    auto values = args["group-by"].as<std::vector<std::string>>();
+    if(values.size() == 1 && lowerString(values[0]) == "none") {
+        return groupBy;
+    }
+
+    for(std::string const &value : values) {
+        std::string key = lowerString(value);
+        Aggregation::Key parsed;
+        if(key == "area") {
+            parsed = Aggregation::AREA;
+        } else if(key == "measure") {
+            parsed = Aggregation::MEASURE;
+        } else if(key == "year") {
+            parsed = Aggregation::YEAR;
+        } else {
+            throw std::invalid_argument("Invalid input for group-by argument: " + value);
+        }
+
+        if(std::find(groupBy.begin(), groupBy.end(), parsed) != groupBy.end()) {
+            throw std::invalid_argument("Invalid input for group-by argument: " + value
+                                        + " given more than once");
+        }
+        groupBy.push_back(parsed);
+    }
+
+    return groupBy;
+}
+
+/*
+  BethYw::parseAggArg(args)
+
+  Parse the agg argument, a comma-separated list of the statistics to
+  output for each group when aggregating.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The statistics to output, in the order given, or all of them if the
+    argument is omitted or "all"
+
+  @throws
+    std::invalid_argument if the argument contains anything other than
+    sum, mean, min, max, count or all
+*/
+std::vector<Aggregation::Statistic> BethYw::parseAggArg(cxxopts::ParseResult& args) {
+    std::vector<Aggregation::Statistic> all = {Aggregation::SUM,
+                                               Aggregation::MEAN,
+                                               Aggregation::MIN,
+                                               Aggregation::MAX,
+                                               Aggregation::COUNT};
+    if(!args.count("agg")) {
+        return all;
+    }
+
+    auto values = args["agg"].as<std::vector<std::string>>();
+    if(values.size() == 1 && lowerString(values[0]) == "all") {
+        return all;
+    }
+
+    std::vector<Aggregation::Statistic> statistics;
+    for(std::string const &value : values) {
+        std::string statistic = lowerString(value);
+        auto found = std::find_if(all.begin(), all.end(), [&statistic](Aggregation::Statistic s) {
+            return statistic == Aggregation::name(s);
+        });
+        if(found == all.end()) {
+            throw std::invalid_argument("Invalid input for agg argument: " + value);
+        }
+        statistics.push_back(*found);
+    }
+
+    return statistics;
+}
+
+/*
+  BethYw::parseAggregationArgs(args)
+
+  Parse the group-by and agg arguments into an Aggregation, if either is
+  given.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The aggregation to output instead of the values, or nullptr if the
+    values should be output
+
+  @throws
+    std::invalid_argument if either argument is invalid
+*/
+std::unique_ptr<Aggregation> BethYw::parseAggregationArgs(cxxopts::ParseResult& args) {
+    if(!args.count("group-by") && !args.count("agg")) {
+        return nullptr;
+    }
+
+    return std::unique_ptr<Aggregation>(new Aggregation(parseGroupByArg(args), parseAggArg(args)));
+}
+
+/*
+  BethYw::parseRankingArgs(args)
+
+  Parse the top and by arguments into a Ranking, if top is given.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The ranking to output instead of the values, or nullptr if the values
+    should be output
+
+  @throws
+    std::invalid_argument if top is 0, by is not average, diff, pct-diff or
+    value:YYYY, by is given without top, or top is given with group-by or
+    agg
+*/
+std::unique_ptr<Ranking> BethYw::parseRankingArgs(cxxopts::ParseResult& args) {
+    if(!args.count("top")) {
+        if(args.count("by")) {
+            throw std::invalid_argument("Invalid input for by argument: "
+                                        + args["by"].as<std::string>() + " (without top)");
+        }
+        return nullptr;
+    }
+
+    if(args.count("group-by") || args.count("agg")) {
+        throw std::invalid_argument("Conflicting outputs: top and group-by/agg");
+    }
+
+    std::size_t count = args["top"].as<std::size_t>();
+    if(count == 0) {
+        throw std::invalid_argument("Invalid input for top argument: 0");
+    }
+
+    std::string by = lowerString(args["by"].as<std::string>());
+    if(by == "average") {
+        return std::unique_ptr<Ranking>(new Ranking(count, Ranking::AVERAGE));
+    } else if(by == "diff") {
+        return std::unique_ptr<Ranking>(new Ranking(count, Ranking::DIFFERENCE));
+    } else if(by == "pct-diff") {
+        return std::unique_ptr<Ranking>(new Ranking(count, Ranking::PERCENTAGE_DIFFERENCE));
+    }
+
+    //value:YYYY
+    char *end = nullptr;
+    long year = 0;
+    if(by.compare(0, 6, "value:") == 0) {
+        year = std::strtol(by.c_str() + 6, &end, 10);
+    }
+    if(end == nullptr || *end != '\0' || year <= 999 || year >= 9999) {
+        throw std::invalid_argument("Invalid input for by argument: " + by);
+    }
+
+    return std::unique_ptr<Ranking>(new Ranking(count, Ranking::VALUE, static_cast<int>(year)));
+}
+
+/*
+  BethYw::parseWhereArg(args)
+
+  Parse the where argument into a Predicate, if it is given.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The condition the values of each year of an area must meet to be
+    output, or nullptr if all the values should be output
+
+  @throws
+    std::invalid_argument if the condition is not valid
+*/
+std::unique_ptr<Predicate> BethYw::parseWhereArg(cxxopts::ParseResult& args) {
+    if(!args.count("where")) {
+        return nullptr;
+    }
+
+    return std::unique_ptr<Predicate>(new Predicate(args["where"].as<std::string>()));
+}
+
 /*
   TODO: BethYw::loadAreas(areas, dir, areasFilter)
 
@@ -430,16 +1197,41 @@ YearFilterTuple BethYw::parseYearsArg(cxxopts::ParseResult& args) {
 void BethYw::loadAreas(Areas &areas, std::string const &dir, std::unordered_set<std::string> const &areasFilter) {
 
     std::string inputString = "../" + dir + InputFiles::AREAS.FILE;
-    InputFile file(inputString);
-    //we use a pointer because
-    //istream cannot be instantiated without a value
-    std::istream *stream = file.open().release();
+    MemStats::Scope parsing(MemStats::PARSING);
+    Profiler *profiler = Profiler::active();
+    auto started = Profiler::start();
+
+    std::string contents;
+    {
+        Tracer::Span span("import", "open", InputFiles::AREAS.CODE);
+        contents = InputFile(inputString).read();
+    }
+    std::uint64_t bytes = contents.size();
+
+    if(profiler != nullptr) {
+        profiler->record({"open", InputFiles::AREAS.CODE, 0, bytes, 0, 0}, started);
+        started = Profiler::start();
+    }
+
+    InputBuffer buffer(inputString, std::move(contents));
+    auto stream = buffer.open();
+
+    Profiler::RowCounts rows;
+    {
+        Profiler::CountRows counting(profiler != nullptr ? &rows : nullptr);
+        Tracer::Span span("import", "parse", InputFiles::AREAS.CODE);
+
+        areas.populate(
+                *stream,
+                InputFiles::AREAS.PARSER,
+                InputFiles::AREAS.COLS,
+                &areasFilter);
+    }
 
-    areas.populate(
-            *stream,
-            InputFiles::AREAS.PARSER,
-            InputFiles::AREAS.COLS,
-            &areasFilter);
+    if(profiler != nullptr) {
+        profiler->record({"parse", InputFiles::AREAS.CODE, 0, bytes, rows.accepted, rows.rejected},
+                         started);
+    }
 }
 
 /*
@@ -482,6 +1274,10 @@ void BethYw::loadAreas(Areas &areas, std::string const &dir, std::unordered_set<
     An two-pair tuple of unsigned ints corresponding to the range of years 
     to import, which should both be 0 to import all years.
 
+  @param cacheDir
+    The parse cache directory (see importDatasets()), or empty to always
+    parse the dataset files
+
   @return
     void
 
@@ -501,21 +1297,641 @@ void BethYw::loadDatasets(Areas& areas, std::string const &dir,
             std::vector<BethYw::InputFileSource> const &datasetsToImport,
             StringFilterSet const &areasFilter,
             StringFilterSet const &measuresFilter,
-            YearFilterTuple const &yearsFilter) {
+            YearFilterTuple const &yearsFilter,
+            std::string const &cacheDir) {
+
+    importDatasets(dir,
+                   datasetsToImport,
+                   areasFilter,
+                   measuresFilter,
+                   yearsFilter,
+                   [&areas](InputFileSource const &, Areas &parsed) {
+                       areas.merge(parsed);
+                   },
+                   cacheDir);
+}
+
+/*
+  Create a directory, if it does not exist yet.
+*/
+static void makeDirectory(std::string const &path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0777);
+#endif
+}
 
+/*
+  The key of a dataset file in the parse cache. The parsed result of a file
+  depends on its contents, on the parser used and on the columns it reads,
+  so all of them (and the snapshot format version) go into the key.
+
+  @return
+    The key as 16 hexadecimal digits
+*/
+static std::string parseCacheKey(BethYw::InputFileSource const &src,
+                                 std::string const &contents) {
+    std::uint64_t hash = fnv1aHash(contents.data(), contents.size());
+
+    //each string is hashed with its terminating null, so that the
+    //boundaries between them are part of the key too
+    auto mix = [&hash](std::string const &s) {
+        hash = fnv1aHash(s.c_str(), s.size() + 1, hash);
+    };
+
+    mix(std::to_string(SNAPSHOT_VERSION));
+    mix(src.CODE);
+    mix(std::to_string(src.PARSER));
+    for(int col = BethYw::AUTH_CODE; col <= BethYw::VALUE; col++) {
+        auto it = src.COLS.find(static_cast<BethYw::SourceColumn>(col));
+        if(it != src.COLS.end()) {
+            mix(std::to_string(col));
+            mix(it->second);
+        }
+    }
+
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+    return key;
+}
+
+/*
+  Get the size of a file in bytes, or 0 if it cannot be found (reading it
+  then reports the error).
+*/
+static std::uint64_t fileSize(std::string const &path) {
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0) {
+        return 0;
+    }
+    return static_cast<std::uint64_t>(info.st_size);
+}
+
+/*
+  BethYw::importDatasets(dir,
+                         datasetsToImport,
+                         areasFilter,
+                         measuresFilter,
+                         yearsFilter,
+                         merge,
+                         cacheDir)
+
+  Import each dataset from `datasetsToImport` into its own Areas object and
+  hand it to `merge`, one dataset at a time and in order. This is the
+  pipeline behind loadDatasets(), which merges every dataset into one Areas
+  object; building a snapshot instead keeps the datasets apart.
+
+  If `cacheDir` is given, the unfiltered result of parsing each file is kept
+  there as a one-dataset snapshot (see snapshot.h), named after a hash of the
+  file's contents, its parser and its columns. A file whose contents have not
+  changed since is then loaded from the cache instead of being parsed again.
+  Cache entries are never removed, so the directory can be emptied at any
+  time.
+
+  @param dir
+    The directory where the datasets are
+
+  @param datasetsToImport
+    A vector of InputFileSource objects
+
+  @param areasFilter
+    An unordered set of areas to filter, or empty to import all areas
+
+  @param measuresFilter
+    An unordered set of measures to filter, or empty to import all measures
+
+  @param yearsFilter
+    A tuple of the range of years to import, or <0,0> for all years
+
+  @param merge
+    Called on this thread with each dataset and the Areas parsed from it
+
+  @param cacheDir
+    The parse cache directory, or empty to always parse the files
+
+  @param failed
+    If given, called on this thread instead of throwing with each dataset
+    that cannot be read or parsed, and the exception raised, after which
+    the import carries on with the next dataset
+
+  @throws
+    The first exception raised while reading, parsing (unless `failed` is
+    given) or merging a dataset, after every dataset before it has been
+    merged
+*/
+void BethYw::importDatasets(std::string const &dir,
+            std::vector<BethYw::InputFileSource> const &datasetsToImport,
+            StringFilterSet const &areasFilter,
+            StringFilterSet const &measuresFilter,
+            YearFilterTuple const &yearsFilter,
+            std::function<void(InputFileSource const &, Areas &)> const &merge,
+            std::string const &cacheDir,
+            std::function<void(InputFileSource const &, std::exception_ptr)> const &failed) {
+
+    /*
+     * The import is split into three stages so that reading one file from
+     * disk overlaps with parsing the previous one:
+     *   I/O   — reads the dataset files into buffers (own thread)
+     *   parse — parses each buffer into its own Areas object (own thread)
+     *   merge — passes the parsed Areas to `merge` (this thread)
+     * The queues between the stages are bounded, so at most PIPELINE_DEPTH
+     * buffers are waiting in each queue at any time, and the I/O stage
+     * reads at most READ_BATCH_BYTES (or one larger file) ahead of them.
+     * Datasets move through the stages in order, so they are merged in the
+     * order they were given.
+     */
+    struct ReadDataset {
+        InputFileSource const *src;
+        std::string contents;
+        std::exception_ptr error;
+    };
+
+    struct ParsedDataset {
+        InputFileSource const *src;
+        Areas areas;
+        std::exception_ptr error;
+        Profiler::RowCounts rows;
+    };
+
+    Profiler *profiler = Profiler::active();
+
+    //look the file up in the parse cache, parsing it (unfiltered, as the
+    //cache entry has to serve any filters) and adding it on a miss
+    auto cachedDataset = [&](InputFileSource const &src, std::string &contents) {
+        std::string path = "../" + cacheDir + parseCacheKey(src, contents) + ".snapshot";
+
+        try {
+            return Snapshot::open(path);
+        } catch(std::runtime_error &) {
+            //not cached yet (or unreadable), so fall through and parse it
+        }
+
+        StringFilterSet noFilter;
+        YearFilterTuple allYears(0, 0);
+        Areas areas = Areas();
+
+        InputBuffer buffer("../" + dir + src.FILE, std::move(contents));
+        auto stream = buffer.open();
+        {
+            //the rows are counted when the filters are applied, on loading
+            Profiler::CountRows notCounting(nullptr);
+            areas.populate(*stream, src.PARSER, src.COLS, &noFilter, &noFilter, &allYears);
+        }
+
+        SnapshotWriter writer;
+        writer.addDataset(src, areas);
+        std::string bytes = writer.finish();
+
+        try {
+            SnapshotWriter::save(path, bytes);
+        } catch(std::runtime_error &e) {
+            std::cerr << "Could not update parse cache: " << e.what() << std::endl;
+        }
+
+        return Snapshot::fromBytes(std::move(bytes));
+    };
+
+    if(!cacheDir.empty()) {
+        makeDirectory("../" + cacheDir);
+    }
+
+    BoundedQueue<ReadDataset> readQueue(PIPELINE_DEPTH);
+    BoundedQueue<ParsedDataset> parsedQueue(PIPELINE_DEPTH);
+
+    std::thread reader([&]() {
+        MemStats::Scope parsing(MemStats::PARSING);
+        Tracer::nameThread("reader");
+        //the files are read in batches of up to READ_BATCH_SIZE files and
+        //READ_BATCH_BYTES, all reads of a batch being submitted together
+        //(see InputFileBatch in input.h)
+        size_t last;
+        for(size_t first = 0; first < datasetsToImport.size(); first = last) {
+            std::uint64_t batchBytes = fileSize("../" + dir + datasetsToImport[first].FILE);
+            last = first + 1;
+            while(last < datasetsToImport.size() && last - first < READ_BATCH_SIZE) {
+                std::uint64_t bytes = fileSize("../" + dir + datasetsToImport[last].FILE);
+                if(bytes > READ_BATCH_BYTES - std::min(batchBytes, READ_BATCH_BYTES)) {
+                    break;
+                }
+                batchBytes += bytes;
+                last++;
+            }
+
+            std::vector<std::string> paths;
+            std::string codes;
+            for(size_t i = first; i < last; i++) {
+                paths.push_back("../" + dir + datasetsToImport[i].FILE);
+                codes += (i > first ? "," : "") + datasetsToImport[i].CODE;
+            }
+
+            //the files of a batch are read together, so are timed together
+            auto started = Profiler::start();
+            std::vector<InputFileBatch::Result> results;
+            {
+                Tracer::Span span("import", "open", codes);
+                results = InputFileBatch(paths).read();
+            }
+
+            if(profiler != nullptr) {
+                std::uint64_t bytes = 0;
+                for(size_t i = first; i < last; i++) {
+                    bytes += results[i - first].contents.size();
+                }
+                profiler->record({"open", codes, 0, bytes, 0, 0}, started);
+            }
+
+            for(size_t i = first; i < last; i++) {
+                ReadDataset dataset{&datasetsToImport[i],
+                                    std::move(results[i - first].contents),
+                                    results[i - first].error};
+
+                if(!readQueue.push(std::move(dataset))) {
+                    readQueue.close();
+                    return;
+                }
+            }
+        }
+        readQueue.close();
+    });
+
+    std::thread parser([&]() {
+        MemStats::Scope parsing(MemStats::PARSING);
+        Tracer::nameThread("parser");
+        ReadDataset dataset;
+        while(readQueue.pop(dataset)) {
+            ParsedDataset parsed{dataset.src, Areas(), dataset.error, Profiler::RowCounts()};
+            auto started = Profiler::start();
+            std::uint64_t bytes = dataset.contents.size();
+
+            if(!parsed.error) {
+                Profiler::CountRows counting(profiler != nullptr ? &parsed.rows : nullptr);
+                Tracer::Span span("import", cacheDir.empty() ? "parse" : "parse (cache)",
+                                  dataset.src->CODE);
+
+                try {
+                    if(cacheDir.empty()) {
+                        InputBuffer buffer("../" + dir + dataset.src->FILE,
+                                           std::move(dataset.contents));
+                        auto stream = buffer.open();
+
+                        parsed.areas.populate(
+                                *stream,
+                                dataset.src->PARSER,
+                                dataset.src->COLS,
+                                &areasFilter,
+                                &measuresFilter,
+                                &yearsFilter);
+                    } else {
+                        cachedDataset(*dataset.src, dataset.contents)->loadDataset(
+                                parsed.areas,
+                                dataset.src->CODE,
+                                areasFilter,
+                                measuresFilter,
+                                yearsFilter);
+                    }
+                } catch(...) {
+                    parsed.error = std::current_exception();
+                }
+            }
+
+            if(profiler != nullptr && !parsed.error) {
+                profiler->record({cacheDir.empty() ? "parse" : "parse (cache)",
+                                  parsed.src->CODE,
+                                  0,
+                                  bytes,
+                                  parsed.rows.accepted,
+                                  parsed.rows.rejected},
+                                 started);
+            }
+
+            if(!parsedQueue.push(std::move(parsed))) {
+                break;
+            }
+        }
+        //stop the reader too in case we finished early
+        readQueue.close();
+        parsedQueue.close();
+    });
+
+    std::exception_ptr error;
+    ParsedDataset parsed;
+    MemStats::Scope store(MemStats::STORE);
+    while(parsedQueue.pop(parsed)) {
+        if(parsed.error && !failed) {
+            error = parsed.error;
+            break;
+        }
+
+        auto started = Profiler::start();
+
+        try {
+            if(parsed.error) {
+                failed(*parsed.src, parsed.error);
+                continue;
+            }
+
+            Tracer::Span span("import", "merge", parsed.src->CODE);
+            merge(*parsed.src, parsed.areas);
+        } catch(...) {
+            error = std::current_exception();
+            break;
+        }
+
+        if(profiler != nullptr) {
+            profiler->record({"merge", parsed.src->CODE, 0, 0, parsed.rows.accepted, 0},
+                             started);
+        }
+    }
+
+    //wake up and finish the other stages before leaving, whatever happened
+    parsedQueue.close();
+    readQueue.close();
+    parser.join();
+    reader.join();
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/*
+  Get the time a file was last modified, in nanoseconds.
+
+  @return
+    false if the file does not exist
+*/
+static bool modifiedTime(std::string const &path, long long &time) {
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+
+#ifdef __linux__
+    time = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#else
+    time = static_cast<long long>(info.st_mtime) * 1000000000LL;
+#endif
+    return true;
+}
+
+/*
+  Import areas.csv and every dataset in `datasetsToImport` without any
+  filters into a snapshot. If `failures` is given, a dataset that cannot be
+  imported is left out and its error recorded there, by code, instead of
+  stopping the import.
+*/
+static SnapshotWriter importSnapshot(std::string const &dir,
+                                     std::vector<BethYw::InputFileSource> const &datasetsToImport,
+                                     std::string const &cacheDir,
+                                     std::map<std::string, std::string> *failures = nullptr) {
+    StringFilterSet noFilter;
+    YearFilterTuple allYears(0, 0);
+    SnapshotWriter writer;
+
+    std::function<void(BethYw::InputFileSource const &, std::exception_ptr)> failed;
+    if(failures != nullptr) {
+        failed = [failures](BethYw::InputFileSource const &src, std::exception_ptr error) {
+            try {
+                std::rethrow_exception(error);
+            } catch(std::exception &e) {
+                (*failures)[src.CODE] = e.what();
+            }
+        };
+    }
+
+    Areas areas = Areas();
+    BethYw::loadAreas(areas, dir, noFilter);
+    writer.addDataset(BethYw::InputFiles::AREAS, areas);
+
+    BethYw::importDatasets(dir,
+                           datasetsToImport,
+                           noFilter,
+                           noFilter,
+                           allYears,
+                           [&writer](BethYw::InputFileSource const &src, Areas &parsed) {
+                               writer.addDataset(src, parsed);
+                           },
+                           cacheDir,
+                           failed);
+
+    return writer;
+}
+
+/*
+  BethYw::buildSnapshot(dir, datasetsToImport, cacheDir)
+
+  Import areas.csv and every dataset in `datasetsToImport` without any
+  filters, and save the result as a snapshot (see snapshot.h) in `dir`, so
+  that later runs can load it instead of parsing the files again.
+
+  @param dir
+    The directory where the datasets are, and where the snapshot is written
+
+  @param datasetsToImport
+    A vector of InputFileSource objects to include in the snapshot
+
+  @param cacheDir
+    The parse cache directory (see importDatasets()), or empty
+
+  @throws
+    std::runtime_error if a dataset cannot be imported or the snapshot cannot
+    be written
+
+  @example
+    BethYw::buildSnapshot("datasets/", BethYw::parseDatasetsArg(args));
+*/
+void BethYw::buildSnapshot(std::string const &dir,
+                           std::vector<BethYw::InputFileSource> const &datasetsToImport,
+                           std::string const &cacheDir) {
+    importSnapshot(dir, datasetsToImport, cacheDir).write("../" + dir + SNAPSHOT_FILE);
+}
+
+/*
+  Open the snapshot in `dir` if it contains areas.csv and all of
+  `datasetsToImport` and is newer than all of their files.
+
+  @return
+    The snapshot, or nullptr if the files have to be imported instead
+*/
+static std::shared_ptr<Snapshot> openSnapshot(
+        std::string const &dir,
+        std::vector<BethYw::InputFileSource> const &datasetsToImport) {
+    std::string path = "../" + dir + BethYw::SNAPSHOT_FILE;
+
+    long long snapshotTime;
+    if(!modifiedTime(path, snapshotTime)) {
+        return nullptr;
+    }
+
+    std::vector<std::string> sources = {BethYw::InputFiles::AREAS.FILE};
+    for(BethYw::InputFileSource const &src : datasetsToImport) {
+        sources.push_back(src.FILE);
+    }
+
+    for(std::string const &file : sources) {
+        long long sourceTime;
+        if(modifiedTime("../" + dir + file, sourceTime) && sourceTime > snapshotTime) {
+            return nullptr;
+        }
+    }
+
+    std::shared_ptr<Snapshot> snapshot;
+    try {
+        snapshot = Snapshot::open(path);
+    } catch(std::runtime_error &e) {
+        std::cerr << "Ignoring snapshot: " << e.what() << std::endl;
+        return nullptr;
+    }
+
+    for(BethYw::InputFileSource const &src : datasetsToImport) {
+        if(!snapshot->hasDataset(src.CODE)) {
+            return nullptr;
+        }
+    }
+
+    return snapshot;
+}
+
+/*
+  BethYw::sourceTimes(dir, datasetsToImport)
+
+  Get the times that areas.csv and each dataset file were last modified, so
+  that a caller can tell when any of them has changed.
+
+  @param dir
+    The directory where the datasets are
+
+  @param datasetsToImport
+    A vector of InputFileSource objects
+
+  @return
+    The modification time of each file in nanoseconds (areas.csv first), or
+    -1 for a file that does not exist
+*/
+std::vector<long long> BethYw::sourceTimes(
+        std::string const &dir,
+        std::vector<BethYw::InputFileSource> const &datasetsToImport) {
+    std::vector<long long> times;
+
+    long long time;
+    times.push_back(modifiedTime("../" + dir + InputFiles::AREAS.FILE, time) ? time : -1);
     for(InputFileSource const &src : datasetsToImport) {
+        times.push_back(modifiedTime("../" + dir + src.FILE, time) ? time : -1);
+    }
 
-        std::string inputString = "../" + dir + src.FILE;
-        InputFile file(inputString);
-        std::istream *stream = file.open().release();
+    return times;
+}
 
-        areas.populate(
-                *stream,
-                src.PARSER,
-                src.COLS,
-                &areasFilter,
-                &measuresFilter,
-                &yearsFilter);
+/*
+  BethYw::loadStore(dir, datasetsToImport, cacheDir, failures)
+
+  Get areas.csv and every dataset in `datasetsToImport`, unfiltered, as a
+  read-only snapshot that queries can then be answered from. This is the
+  snapshot file in `dir` if it is up to date, or otherwise a snapshot built
+  in memory from the files. The snapshot's indexes are built (see
+  Snapshot::buildIndexes()), so that queries over any window of years are
+  answered from them.
+
+  @param dir
+    The directory where the datasets are
+
+  @param datasetsToImport
+    A vector of InputFileSource objects
+
+  @param cacheDir
+    The parse cache directory (see importDatasets()), or empty
+
+  @param failures
+    If given, a dataset that cannot be imported is left out of the snapshot
+    and its error recorded here, by code, rather than thrown
+
+  @return
+    The snapshot
+
+  @throws
+    std::runtime_error if areas.csv, or a dataset when `failures` is not
+    given, cannot be imported
+*/
+std::shared_ptr<const Snapshot> BethYw::loadStore(
+        std::string const &dir,
+        std::vector<BethYw::InputFileSource> const &datasetsToImport,
+        std::string const &cacheDir,
+        std::map<std::string, std::string> *failures) {
+    //the values are all checked now rather than by the first queries, so a
+    //snapshot with corrupt values is rebuilt instead of failing them
+    auto snapshot = openSnapshot(dir, datasetsToImport);
+    if(snapshot) {
+        try {
+            snapshot->verifyDataset(InputFiles::AREAS.CODE);
+            for(InputFileSource const &src : datasetsToImport) {
+                snapshot->verifyDataset(src.CODE);
+            }
+        } catch(std::runtime_error &e) {
+            std::cerr << "Ignoring snapshot: " << e.what() << std::endl;
+            snapshot = nullptr;
+        }
     }
+
+    if(!snapshot) {
+        snapshot = Snapshot::fromBytes(importSnapshot(dir, datasetsToImport, cacheDir, failures).finish());
+    }
+
+    snapshot->buildIndexes();
+    return snapshot;
 }
 
+/*
+  BethYw::loadSnapshot(areas,
+                       dir,
+                       datasetsToImport,
+                       areasFilter,
+                       measuresFilter,
+                       yearsFilter)
+
+  Load areas.csv and the datasets from the snapshot in `dir` instead of from
+  the source files, if there is a snapshot that contains all of them and it
+  is newer than all of their files.
+
+  @param areas
+    An Areas instance that should be modified
+
+  @param dir
+    The directory where the datasets and the snapshot are
+
+  @param datasetsToImport
+    A vector of InputFileSource objects
+
+  @param areasFilter
+    An unordered set of areas to filter, or empty to import all areas
+
+  @param measuresFilter
+    An unordered set of measures to filter, or empty to import all measures
+
+  @param yearsFilter
+    A tuple of the range of years to import, or <0,0> for all years
+
+  @return
+    true if the data was loaded from the snapshot, false if it should be
+    loaded from the source files with loadAreas() and loadDatasets()
+*/
+bool BethYw::loadSnapshot(Areas &areas, std::string const &dir,
+                          std::vector<BethYw::InputFileSource> const &datasetsToImport,
+                          StringFilterSet const &areasFilter,
+                          StringFilterSet const &measuresFilter,
+                          YearFilterTuple const &yearsFilter) {
+    auto snapshot = openSnapshot(dir, datasetsToImport);
+    if(!snapshot) {
+        return false;
+    }
+
+    try {
+        snapshot->load(areas, datasetsToImport, areasFilter, measuresFilter, yearsFilter);
+    } catch(std::runtime_error &e) {
+        //values that do not match their checksum, so parse the files instead
+        std::cerr << "Ignoring snapshot: " << e.what() << std::endl;
+        areas = Areas();
+        return false;
+    }
+    return true;
+}
@@ -16,6 +16,11 @@
   functions you need to declare in this file.
  */
 
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -24,8 +29,14 @@
 
 #include "lib_cxxopts.hpp"
 
+#include "aggregate.h"
 #include "datasets.h"
 #include "Helper.h"
+#include "predicate.h"
+#include "ranking.h"
+#include "resultcache.h"
+#include "snapshot.h"
+#include "threadpool.h"
 
 const char DIR_SEP =
 #ifdef _WIN32
@@ -41,6 +52,45 @@ namespace BethYw {
 */
 const std::string STUDENT_NUMBER = "979961";
 
+/*
+  The number of dataset files that each stage of the loading pipeline may
+  hold ready for the next stage (see loadDatasets() in bethyw.cpp).
+*/
+constexpr size_t PIPELINE_DEPTH = 2;
+
+/*
+  The maximum number of dataset files, and of bytes, whose reads are
+  submitted together by the I/O stage of the loading pipeline. A batch
+  always has at least one file, however large it is. The files read but not
+  yet parsed are therefore at most one batch held by the I/O stage (up to
+  READ_BATCH_BYTES, or a single larger file), plus PIPELINE_DEPTH waiting
+  for the parse stage, plus the one it is parsing.
+*/
+constexpr size_t READ_BATCH_SIZE = 16;
+constexpr std::uint64_t READ_BATCH_BYTES = 64 * 1024 * 1024;
+
+/*
+  The name of the snapshot file kept in the data directory (see snapshot.h).
+*/
+const std::string SNAPSHOT_FILE = "bethyw.snapshot";
+
+/*
+  How often, in seconds, server mode checks whether the dataset files have
+  changed and need to be imported again.
+*/
+constexpr unsigned int RELOAD_POLL_SECONDS = 2;
+
+/*
+  The default size, in MiB, of the cache of query outputs in server and
+  batch mode (see resultcache.h).
+*/
+const std::string DEFAULT_RESULT_CACHE_MB = "64";
+
+/*
+  The formats the output can be written in (--format, or -j for JSON).
+*/
+enum class OutputFormat { TABLE, JSON, ARROW };
+
 /*
   Run Beth Yw?, parsing the command line arguments and acting upon them.
 */
@@ -62,12 +112,117 @@ StringFilterSet parseMeasuresArg(
             cxxopts::ParseResult& args);
 
 YearFilterTuple parseYearsArg(cxxopts::ParseResult& args);
+
+OutputFormat parseFormatArg(cxxopts::ParseResult& args);
+
+bool parseProfileArg(cxxopts::ParseResult& args);
+
+bool parseMemStatsArg(cxxopts::ParseResult& args);
+
+std::vector<Aggregation::Key> parseGroupByArg(cxxopts::ParseResult& args);
+
+std::vector<Aggregation::Statistic> parseAggArg(cxxopts::ParseResult& args);
+
+std::unique_ptr<Aggregation> parseAggregationArgs(cxxopts::ParseResult& args);
+
+std::unique_ptr<Ranking> parseRankingArgs(cxxopts::ParseResult& args);
+
+std::unique_ptr<Predicate> parseWhereArg(cxxopts::ParseResult& args);
 void loadAreas(Areas &areas, std::string const &dir, std::unordered_set<std::string> const &areasFilter);
 void loadDatasets(Areas& areas, std::string const &dir,
                   std::vector<BethYw::InputFileSource> const &datasetsToImport,
                   StringFilterSet const &areasFilter,
                   StringFilterSet const &measuresFilter,
-                  YearFilterTuple const &yearsFilter) ;
+                  YearFilterTuple const &yearsFilter,
+                  std::string const &cacheDir = "");
+void importDatasets(std::string const &dir,
+                    std::vector<BethYw::InputFileSource> const &datasetsToImport,
+                    StringFilterSet const &areasFilter,
+                    StringFilterSet const &measuresFilter,
+                    YearFilterTuple const &yearsFilter,
+                    std::function<void(InputFileSource const &, Areas &)> const &merge,
+                    std::string const &cacheDir = "",
+                    std::function<void(InputFileSource const &, std::exception_ptr)> const &failed = nullptr);
+
+void buildSnapshot(std::string const &dir,
+                   std::vector<BethYw::InputFileSource> const &datasetsToImport,
+                   std::string const &cacheDir = "");
+bool loadSnapshot(Areas &areas, std::string const &dir,
+                  std::vector<BethYw::InputFileSource> const &datasetsToImport,
+                  StringFilterSet const &areasFilter,
+                  StringFilterSet const &measuresFilter,
+                  YearFilterTuple const &yearsFilter);
+std::vector<long long> sourceTimes(std::string const &dir,
+                                   std::vector<BethYw::InputFileSource> const &datasetsToImport);
+std::shared_ptr<const Snapshot> loadStore(std::string const &dir,
+                                          std::vector<BethYw::InputFileSource> const &datasetsToImport,
+                                          std::string const &cacheDir = "",
+                                          std::map<std::string, std::string> *failures = nullptr);
+
+/*
+  Output the imported data in the given format, rendering tables on `pool`
+  if one is given.
+*/
+void writeOutput(std::ostream &os,
+                 Areas const &data,
+                 OutputFormat format,
+                 ThreadPool *pool = nullptr);
+
+/*
+  Output the aggregates of the imported data (--group-by and --agg) in the
+  given format, or aggregates already worked out (e.g. from a snapshot).
+*/
+void writeAggregation(std::ostream &os,
+                      Areas const &data,
+                      Aggregation &aggregation,
+                      OutputFormat format);
+void writeAggregation(std::ostream &os,
+                      Aggregation const &aggregation,
+                      OutputFormat format);
+
+/*
+  Output the top areas of each measure of the imported data (--top and
+  --by) in the given format, or top areas already ranked (e.g. from a
+  snapshot).
+*/
+void writeRanking(std::ostream &os,
+                  Areas const &data,
+                  Ranking &ranking,
+                  OutputFormat format);
+void writeRanking(std::ostream &os,
+                  Ranking const &ranking,
+                  OutputFormat format);
+
+/*
+  Answer queries from clients of a Unix domain socket, from data loaded once
+  (see server.cpp).
+*/
+int serve(std::string const &socketPath,
+          std::string const &dir,
+          std::vector<BethYw::InputFileSource> const &loadedDatasets,
+          std::string const &cacheDir,
+          std::size_t resultCacheBytes);
+void answerQuery(Snapshot const &store,
+                 std::vector<BethYw::InputFileSource> const &loadedDatasets,
+                 std::string const &query,
+                 std::ostream &out,
+                 ResultCache *cache = nullptr,
+                 std::uint64_t version = 0);
+void answerQuery(Snapshot const &store,
+                 std::vector<BethYw::InputFileSource> const &loadedDatasets,
+                 std::vector<std::string> arguments,
+                 std::ostream &out,
+                 ResultCache *cache = nullptr,
+                 std::uint64_t version = 0);
+
+/*
+  Answer every query in a JSON Lines file from data loaded once (see
+  batch.cpp).
+*/
+int runBatch(std::string const &batchPath,
+             std::string const &dir,
+             std::string const &cacheDir,
+             std::size_t resultCacheBytes);
 
 /*
   Parse the areas argument and return a std::unordered_set of all the
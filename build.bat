@@ -2,7 +2,7 @@
 
 SET bin_dir=bin
 SET tests_dir=tests
-SET source_files=bethyw.cpp input.cpp areas.cpp area.cpp measure.cpp
+SET source_files=bethyw.cpp input.cpp inflate.cpp snapshot.cpp server.cpp batch.cpp threadpool.cpp resultcache.cpp jsonwriter.cpp tablewriter.cpp arrowwriter.cpp profile.cpp perfcounters.cpp memstats.cpp trace.cpp areas.cpp area.cpp measure.cpp measureindex.cpp aggregate.cpp ranking.cpp predicate.cpp Helper.cpp
 SET main_file=main.cpp
 SET executable=%bin_dir%\bethyw.exe
 
@@ -22,9 +22,21 @@ IF %testStr%==test (
   )
 )
 
+IF "%1"=="generate" (
+  SET source_files=Helper.cpp
+  SET main_file=generate.cpp
+  SET executable=%bin_dir%\bethyw-generate.exe
+)
+
+IF "%1"=="benchmark" (
+  SET source_files=
+  SET main_file=benchmark.cpp
+  SET executable=%bin_dir%\bethyw-benchmark.exe
+)
+
 :compile
 IF NOT EXIST %bin_dir% MKDIR %bin_dir%
 IF EXIST %executable% DEL %executable%
-g++ --std=c++14 -Wall %source_files% %main_file% -o %executable%
+g++ --std=c++14 -Wall -pthread %source_files% %main_file% -o %executable%
 
 :end
@@ -2,7 +2,7 @@
 
 BIN_DIR="bin"
 TESTS_DIR="tests"
-SOURCE_FILES="bethyw.cpp input.cpp areas.cpp area.cpp measure.cpp"
+SOURCE_FILES="bethyw.cpp input.cpp inflate.cpp snapshot.cpp server.cpp batch.cpp threadpool.cpp resultcache.cpp jsonwriter.cpp tablewriter.cpp arrowwriter.cpp profile.cpp perfcounters.cpp memstats.cpp trace.cpp areas.cpp area.cpp measure.cpp measureindex.cpp aggregate.cpp ranking.cpp predicate.cpp Helper.cpp"
 MAIN_FILE="main.cpp"
 EXECUTABLE="./${BIN_DIR}/bethyw"
 
@@ -10,7 +10,7 @@ set -x
 cd "${0%/*}"
 
 if [ $# -gt 1 ]; then
-  echo "Unknown arguments!" "Only one argument accepted, and must begin with test"
+  echo "Unknown arguments!" "Only one argument accepted, and must be generate, benchmark or begin with test"
   exit
 elif [ $# -eq 1 ]; then
   if [[ $1 == test* ]]; then
@@ -18,13 +18,21 @@ elif [ $# -eq 1 ]; then
     MAIN_FILE="./${BIN_DIR}/catch.o"
     EXECUTABLE="./${BIN_DIR}/bethyw-test"
 
-    # Do we need to compile Catch2?
-    if [ ! -f ./${BIN_DIR}/catch.o ]; then
+    # Do we need to compile Catch2 (again, if its main has changed)?
+    if [ ! -f ./${BIN_DIR}/catch.o ] || [ ./lib_catch_main.cpp -nt ./${BIN_DIR}/catch.o ]; then
       g++ --std=c++11 -c ./lib_catch_main.cpp -o ./${BIN_DIR}/catch.o
     fi
+  elif [[ $1 == generate ]]; then
+    SOURCE_FILES="Helper.cpp"
+    MAIN_FILE="generate.cpp"
+    EXECUTABLE="./${BIN_DIR}/bethyw-generate"
+  elif [[ $1 == benchmark ]]; then
+    SOURCE_FILES=""
+    MAIN_FILE="benchmark.cpp"
+    EXECUTABLE="./${BIN_DIR}/bethyw-benchmark"
   fi
 fi
 
 mkdir -p ${BIN_DIR}
 rm ${EXECUTABLE} 2> /dev/null
-g++ --std=c++14 -pedantic -Wall ${SOURCE_FILES} ${MAIN_FILE} -o ${EXECUTABLE}
\ No newline at end of file
+g++ --std=c++14 -pedantic -Wall -pthread ${SOURCE_FILES} ${MAIN_FILE} -o ${EXECUTABLE}
\ No newline at end of file
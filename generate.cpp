@@ -0,0 +1,498 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains bethyw-generate, a tool that writes a synthetic data
+  directory for scale testing Beth Yw? with far more areas, measures, years
+  and rows than the bundled datasets have. Build it with:
+
+    ./build.sh generate
+
+  and run e.g.
+
+    ./bin/bethyw-generate --out synthetic --areas 1909 --measures 40 \
+                          --years 1971-2020 --seed 7
+    ./bin/bethyw --dir synthetic -d popden
+
+  It writes areas.csv and a file for every dataset in datasets.h, with the
+  file name, parser and column names given there, so that Beth Yw? reads
+  them as it reads the bundled files:
+
+    - AuthorityCodeCSV:   a code, English name and Welsh name for each area
+    - WelshStatsJSON:     an OData-style document with a row for each value,
+                          each measure of a multi-measure dataset having its
+                          own series (single-measure datasets have none of
+                          the measure columns, as the bundled files do)
+    - AuthorityByYearCSV: a row for each area, with a value for each year
+
+  The values of each series are a random walk. The same arguments and seed
+  always give the same files, on any platform: each file has its own random
+  generator (std::mt19937_64, whose output the standard defines), seeded
+  from the seed and the dataset's code.
+
+  --sparsity leaves that fraction of the values out of the JSON files, and
+  that fraction of the areas out of the by-year CSV files (whose rows must
+  be complete). --size fills each dataset file with areas until it is about
+  that many megabytes, instead of writing a fixed number of areas; areas.csv
+  then lists as many areas as the largest file has.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lib_cxxopts.hpp"
+
+#include "datasets.h"
+#include "Helper.h"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace {
+
+const char DIR_SEP =
+#ifdef _WIN32
+    '\\';
+#else
+    '/';
+#endif
+
+// how much output is gathered before it is written to a file
+const std::size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+struct Settings {
+    std::string out;
+    std::uint64_t areas;
+    std::uint64_t measures;
+    int firstYear;
+    int lastYear;
+    double sparsity;
+    std::uint64_t sizeBytes;    // 0 to write `areas` areas instead
+    std::uint64_t seed;
+};
+
+/*
+  A file written through a large buffer, counting its bytes.
+*/
+class OutputFile {
+public:
+    explicit OutputFile(std::string const &path)
+        : path(path), file(path, std::ios_base::out | std::ios_base::binary) {
+        if(!file) {
+            throw std::runtime_error("Failed to open file " + path);
+        }
+        buffer.reserve(WRITE_BUFFER_SIZE + 4096);
+    }
+
+    void write(std::string const &text) {
+        buffer += text;
+        if(buffer.size() >= WRITE_BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    void write(const char *text) {
+        buffer += text;
+        if(buffer.size() >= WRITE_BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    std::uint64_t size() const {
+        return written + buffer.size();
+    }
+
+    void close() {
+        flush();
+        file.close();
+        if(!file) {
+            throw std::runtime_error("Failed to write file " + path);
+        }
+    }
+
+private:
+    std::string path;
+    std::ofstream file;
+    std::string buffer;
+    std::uint64_t written = 0;
+
+    void flush() {
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written += buffer.size();
+        buffer.clear();
+    }
+};
+
+/*
+  A deterministic source of random numbers for one file.
+*/
+class Random {
+public:
+    Random(std::uint64_t seed, std::string const &code)
+        : engine(seed ^ fnv1aHash(code.data(), code.size())) {}
+
+    // a number in [0, 1), built from the top 53 bits of the engine's output
+    // rather than with std::uniform_real_distribution, whose results differ
+    // between standard libraries
+    double uniform() {
+        return static_cast<double>(engine() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    bool chance(double probability) {
+        return uniform() < probability;
+    }
+
+    /*
+      Start a random walk: a first value between 1 and 100,000, spread
+      evenly over the orders of magnitude.
+    */
+    double start() {
+        return std::pow(10.0, 5.0 * uniform());
+    }
+
+    /*
+      The next value of a random walk, within 5% of the last.
+    */
+    double step(double value) {
+        return value * (1.0 + (uniform() - 0.5) * 0.1);
+    }
+
+private:
+    std::mt19937_64 engine;
+};
+
+std::string areaCode(std::uint64_t area) {
+    char code[32];
+    std::snprintf(code, sizeof(code), "W%08llu", static_cast<unsigned long long>(area + 1));
+    return code;
+}
+
+std::string englishName(std::uint64_t area) {
+    return "Synthetic Area " + std::to_string(area + 1);
+}
+
+std::string welshName(std::uint64_t area) {
+    return "Ardal Synthetig " + std::to_string(area + 1);
+}
+
+std::string number(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.6f", value);
+    return text;
+}
+
+std::string jsonString(std::string const &text) {
+    return "\"" + text + "\"";
+}
+
+/*
+  Whether another area should be written to a file: until `settings.areas`
+  areas have been written, or with --size until the file is big enough.
+*/
+bool wantsArea(Settings const &settings, std::uint64_t area, OutputFile const &file) {
+    if(settings.sizeBytes > 0) {
+        return file.size() < settings.sizeBytes && area < 99999999;
+    }
+    return area < settings.areas;
+}
+
+struct Written {
+    std::uint64_t areas;
+    std::uint64_t rows;
+    std::uint64_t bytes;
+};
+
+/*
+  Write a dataset file in the WelshStatsJSON format of `src`.
+*/
+Written writeWelshStatsJSON(Settings const &settings, BethYw::InputFileSource const &src) {
+    using namespace BethYw;
+
+    auto has = [&src](SourceColumn column) {
+        return src.COLS.find(column) != src.COLS.end();
+    };
+
+    bool multipleMeasures = has(MEASURE_CODE);
+    std::uint64_t measures = multipleMeasures ? settings.measures : 1;
+
+    Random random(settings.seed, src.CODE);
+    OutputFile file(settings.out + src.FILE);
+    file.write("{\n  \"odata.metadata\":\"http://open.statswales.gov.wales/en-gb/dataset/$metadata#"
+               + src.CODE + "\",\"value\":[\n");
+
+    Written written{0, 0, 0};
+    std::string row;
+
+    for(std::uint64_t area = 0; wantsArea(settings, area, file); area++) {
+        std::string code = areaCode(area);
+        std::string name = englishName(area);
+
+        for(std::uint64_t measure = 0; measure < measures; measure++) {
+            std::string measureCode = "M" + std::to_string(measure + 1);
+            std::string measureName = "Synthetic measure " + std::to_string(measure + 1);
+            double value = random.start();
+
+            for(int year = settings.firstYear; year <= settings.lastYear; year++) {
+                value = random.step(value);
+                if(random.chance(settings.sparsity)) {
+                    continue;
+                }
+
+                //the value first, then the columns in the order of
+                //SourceColumn, as in the bundled files
+                row = written.rows == 0 ? "    {\n      " : ",{\n      ";
+                row += jsonString(src.COLS.at(VALUE)) + ":" + number(value);
+                row += "," + jsonString(src.COLS.at(AUTH_CODE)) + ":" + jsonString(code);
+                if(has(AUTH_NAME_ENG)) {
+                    row += "," + jsonString(src.COLS.at(AUTH_NAME_ENG)) + ":" + jsonString(name);
+                }
+                if(has(AUTH_NAME_CYM)) {
+                    row += "," + jsonString(src.COLS.at(AUTH_NAME_CYM)) + ":"
+                           + jsonString(welshName(area));
+                }
+                if(multipleMeasures) {
+                    row += "," + jsonString(src.COLS.at(MEASURE_CODE)) + ":" + jsonString(measureCode);
+
+                    //some datasets use the same column for the code and name
+                    if(src.COLS.at(MEASURE_NAME) != src.COLS.at(MEASURE_CODE)) {
+                        row += "," + jsonString(src.COLS.at(MEASURE_NAME)) + ":"
+                               + jsonString(measureName);
+                    }
+                }
+                row += "," + jsonString(src.COLS.at(YEAR)) + ":" + jsonString(std::to_string(year));
+
+                char rowKey[64];
+                std::snprintf(rowKey, sizeof(rowKey), ",\"RowKey\":\"%016llx\",\"PartitionKey\":\"\"\n    }",
+                              static_cast<unsigned long long>(written.rows));
+                row += rowKey;
+
+                file.write(row);
+                written.rows++;
+            }
+        }
+
+        written.areas = area + 1;
+    }
+
+    file.write("\n  ]\n}");
+    file.close();
+
+    written.bytes = file.size();
+    return written;
+}
+
+/*
+  Write a dataset file in the AuthorityByYearCSV format of `src`.
+*/
+Written writeAuthorityByYearCSV(Settings const &settings, BethYw::InputFileSource const &src) {
+    Random random(settings.seed, src.CODE);
+    OutputFile file(settings.out + src.FILE);
+
+    std::string header = src.COLS.at(BethYw::AUTH_CODE);
+    for(int year = settings.firstYear; year <= settings.lastYear; year++) {
+        header += "," + std::to_string(year);
+    }
+    file.write(header);
+
+    Written written{0, 0, 0};
+    std::string row;
+
+    for(std::uint64_t area = 0; wantsArea(settings, area, file); area++) {
+        written.areas = area + 1;
+
+        //every year must have a value, so sparsity leaves out whole areas
+        if(random.chance(settings.sparsity)) {
+            continue;
+        }
+
+        row = "\n" + areaCode(area);
+        double value = random.start();
+        for(int year = settings.firstYear; year <= settings.lastYear; year++) {
+            value = random.step(value);
+            row += "," + number(value);
+        }
+
+        file.write(row);
+        written.rows += static_cast<std::uint64_t>(settings.lastYear - settings.firstYear + 1);
+    }
+
+    file.close();
+
+    written.bytes = file.size();
+    return written;
+}
+
+/*
+  Write areas.csv with the code and names of `areas` areas.
+*/
+Written writeAreas(Settings const &settings, std::uint64_t areas) {
+    auto const &src = BethYw::InputFiles::AREAS;
+    OutputFile file(settings.out + src.FILE);
+
+    file.write(src.COLS.at(BethYw::AUTH_CODE) + ","
+               + src.COLS.at(BethYw::AUTH_NAME_ENG) + ","
+               + src.COLS.at(BethYw::AUTH_NAME_CYM));
+
+    for(std::uint64_t area = 0; area < areas; area++) {
+        file.write("\n" + areaCode(area) + "," + englishName(area) + "," + welshName(area));
+    }
+
+    file.close();
+    return Written{areas, areas, file.size()};
+}
+
+void report(std::string const &file, Written const &written) {
+    std::printf("%-32s %10llu areas %12llu rows %14llu bytes\n",
+                file.c_str(),
+                static_cast<unsigned long long>(written.areas),
+                static_cast<unsigned long long>(written.rows),
+                static_cast<unsigned long long>(written.bytes));
+}
+
+cxxopts::Options cxxoptsSetup() {
+    cxxopts::Options cxxopts(
+            "bethyw-generate",
+            "Writes a synthetic data directory for Beth Yw?, with the files and "
+            "columns of datasets.h, for testing at scale.\n");
+
+    cxxopts.add_options()(
+        "out",
+        "The directory to write the files to (created if needed)",
+        cxxopts::value<std::string>())(
+
+        "areas",
+        "The number of areas",
+        cxxopts::value<std::uint64_t>()->default_value("1909"))(
+
+        "measures",
+        "The number of measures in each multi-measure dataset",
+        cxxopts::value<std::uint64_t>()->default_value("24"))(
+
+        "years",
+        "The inclusive range of years (YYYY-ZZZZ)",
+        cxxopts::value<std::string>()->default_value("1991-2020"))(
+
+        "sparsity",
+        "The fraction (0 to 1) of values, or of by-year CSV rows, to leave out",
+        cxxopts::value<double>()->default_value("0"))(
+
+        "size",
+        "Instead of --areas, fill each dataset file with areas until it is "
+        "about this many megabytes",
+        cxxopts::value<double>())(
+
+        "seed",
+        "The seed of the random values",
+        cxxopts::value<std::uint64_t>()->default_value("1"))(
+
+        "h,help",
+        "Print usage.");
+
+    return cxxopts;
+}
+
+Settings parseSettings(cxxopts::ParseResult &args) {
+    if(!args.count("out")) {
+        throw std::invalid_argument("No output directory given (--out)");
+    }
+    if(args.count("size") && args.count("areas")) {
+        throw std::invalid_argument("Give either --areas or --size, not both");
+    }
+
+    Settings settings;
+    settings.out = args["out"].as<std::string>() + DIR_SEP;
+    settings.areas = args["areas"].as<std::uint64_t>();
+    settings.measures = args["measures"].as<std::uint64_t>();
+    settings.sparsity = args["sparsity"].as<double>();
+    settings.seed = args["seed"].as<std::uint64_t>();
+    settings.sizeBytes = 0;
+
+    if(args.count("size")) {
+        double megabytes = args["size"].as<double>();
+        if(!(megabytes > 0)) {
+            throw std::invalid_argument("Invalid input for size argument");
+        }
+        settings.sizeBytes = static_cast<std::uint64_t>(megabytes * 1e6);
+    }
+
+    if(settings.areas < 1 || settings.areas > 99999999) {
+        throw std::invalid_argument("Invalid input for areas argument");
+    }
+    if(settings.measures < 1) {
+        throw std::invalid_argument("Invalid input for measures argument");
+    }
+    if(!(settings.sparsity >= 0 && settings.sparsity < 1)) {
+        throw std::invalid_argument("Invalid input for sparsity argument");
+    }
+
+    std::string years = args["years"].as<std::string>();
+    if(std::sscanf(years.c_str(), "%d-%d", &settings.firstYear, &settings.lastYear) != 2
+       || settings.firstYear < 1000 || settings.lastYear > 9999
+       || settings.firstYear > settings.lastYear) {
+        throw std::invalid_argument("Invalid input for years argument");
+    }
+
+    return settings;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    auto cxxopts = cxxoptsSetup();
+
+    try {
+        auto args = cxxopts.parse(argc, argv);
+        if(args.count("help")) {
+            std::cerr << cxxopts.help() << std::endl;
+            return 0;
+        }
+
+        Settings settings = parseSettings(args);
+
+#ifdef _WIN32
+        _mkdir(settings.out.c_str());
+#else
+        mkdir(settings.out.c_str(), 0777);
+#endif
+
+        std::uint64_t areas = 0;
+        for(auto const &src : BethYw::InputFiles::DATASETS) {
+            Written written;
+            if(src.PARSER == BethYw::WelshStatsJSON) {
+                written = writeWelshStatsJSON(settings, src);
+            } else if(src.PARSER == BethYw::AuthorityByYearCSV) {
+                written = writeAuthorityByYearCSV(settings, src);
+            } else {
+                throw std::runtime_error("No generator for the parser of dataset " + src.CODE);
+            }
+
+            report(src.FILE, written);
+            areas = std::max(areas, written.areas);
+        }
+
+        report(BethYw::InputFiles::AREAS.FILE, writeAreas(settings, areas));
+    } catch(std::exception &e) {
+        std::cerr << "bethyw-generate: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,510 @@
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the GzipInflater class. The
+  DEFLATE decoder follows the structure of the RFC 1951 reference decoder,
+  with a lookup table added for Huffman codes of up to FAST_BITS bits (which
+  covers almost every symbol in practice) so that most symbols are decoded
+  with a single table access rather than one bit at a time.
+*/
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "inflate.h"
+
+/*
+  Decompressed data is handed to the sink in chunks of this size.
+*/
+static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+/*
+  The size of the DEFLATE sliding window (the furthest back a match can be).
+*/
+static constexpr std::size_t WINDOW_SIZE = 32 * 1024;
+
+/*
+  Update a CRC-32 (as used by gzip) with some more data.
+*/
+static std::uint32_t crc32Update(std::uint32_t crc, const char *data, std::size_t length) {
+    static const auto table = []() {
+        std::vector<std::uint32_t> t(256);
+        for(std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t c = i;
+            for(int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for(std::size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+bool isGzip(const char *data, std::size_t length) {
+    return length >= 2
+           && static_cast<unsigned char>(data[0]) == 0x1f
+           && static_cast<unsigned char>(data[1]) == 0x8b;
+}
+
+bool isZstd(const char *data, std::size_t length) {
+    return length >= 4
+           && static_cast<unsigned char>(data[0]) == 0x28
+           && static_cast<unsigned char>(data[1]) == 0xb5
+           && static_cast<unsigned char>(data[2]) == 0x2f
+           && static_cast<unsigned char>(data[3]) == 0xfd;
+}
+
+/*
+  GzipInflater::GzipInflater(source, sink)
+
+  Construct an inflater that reads gzip data from `source` and passes the
+  decompressed data to `sink`.
+
+  @param source
+    The stream buffer to read compressed data from
+
+  @param sink
+    A callback receiving each decompressed chunk. The chunk may be moved from.
+
+  @example
+    std::ifstream file("data/popu1009.json.gz", std::ios::binary);
+    std::string json;
+    GzipInflater inflater(*file.rdbuf(), [&](std::string &chunk) {
+        json += chunk;
+        return true;
+    });
+    inflater.run();
+*/
+GzipInflater::GzipInflater(std::streambuf &source, Sink sink)
+    : source(source), sink(std::move(sink)), input(CHUNK_SIZE), window(WINDOW_SIZE) {
+    chunk.reserve(CHUNK_SIZE);
+}
+
+/*
+  GzipInflater::run()
+
+  Decompress every gzip member in the source, until the source ends or the
+  sink asks to stop.
+
+  @throws
+    std::runtime_error if the data is not gzip data, is truncated or corrupt
+*/
+void GzipInflater::run() {
+    do {
+        if(!member()) {
+            return;
+        }
+    } while(peekByte() == 0x1f);
+}
+
+bool GzipInflater::fillInput() {
+    inputPos = 0;
+    inputEnd = static_cast<std::size_t>(source.sgetn(input.data(), input.size()));
+    return inputEnd > 0;
+}
+
+int GzipInflater::nextByte() {
+    if(inputPos == inputEnd && !fillInput()) {
+        return -1;
+    }
+    return static_cast<unsigned char>(input[inputPos++]);
+}
+
+/*
+  Look at the next whole byte without consuming it. Only valid on a byte
+  boundary (i.e. after alignToByte()).
+*/
+int GzipInflater::peekByte() {
+    if(bitCount >= 8) {
+        return static_cast<int>(bitBuffer & 0xff);
+    }
+
+    int byte = nextByte();
+    if(byte >= 0) {
+        bitBuffer |= static_cast<std::uint64_t>(byte) << bitCount;
+        bitCount += 8;
+    }
+    return byte;
+}
+
+std::uint32_t GzipInflater::bits(int need) {
+    while(bitCount < need) {
+        int byte = nextByte();
+        if(byte < 0) {
+            throw std::runtime_error("GzipInflater::run: Unexpected end of compressed data");
+        }
+        bitBuffer |= static_cast<std::uint64_t>(byte) << bitCount;
+        bitCount += 8;
+    }
+
+    auto value = static_cast<std::uint32_t>(bitBuffer & ((1ull << need) - 1));
+    bitBuffer >>= need;
+    bitCount -= need;
+    return value;
+}
+
+void GzipInflater::alignToByte() {
+    bitBuffer >>= bitCount % 8;
+    bitCount -= bitCount % 8;
+}
+
+void GzipInflater::output(unsigned char byte) {
+    window[windowPos++ % WINDOW_SIZE] = byte;
+    chunk.push_back(static_cast<char>(byte));
+    produced++;
+
+    if(chunk.size() >= CHUNK_SIZE) {
+        flushChunk();
+    }
+}
+
+void GzipInflater::flushChunk() {
+    if(chunk.empty() || stopped) {
+        return;
+    }
+
+    crc = crc32Update(crc, chunk.data(), chunk.size());
+    if(!sink(chunk)) {
+        stopped = true;
+    }
+
+    chunk.clear();
+    chunk.reserve(CHUNK_SIZE);
+}
+
+/*
+  Build the canonical Huffman code for `n` symbols with the given code
+  lengths (0 meaning the symbol is unused).
+*/
+void GzipInflater::buildHuffman(Huffman &h, const std::uint8_t *lengths, int n) {
+    std::memset(h.count, 0, sizeof(h.count));
+    std::memset(h.fast, 0, sizeof(h.fast));
+
+    for(int s = 0; s < n; s++) {
+        h.count[lengths[s]]++;
+    }
+
+    int left = 1;
+    for(int len = 1; len < 16; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if(left < 0) {
+            throw std::runtime_error("GzipInflater::run: Invalid Huffman code lengths");
+        }
+    }
+
+    std::uint16_t offsets[16];
+    std::uint16_t nextCode[16];
+    offsets[1] = 0;
+    nextCode[1] = 0;
+    for(int len = 1; len < 15; len++) {
+        offsets[len + 1] = offsets[len] + h.count[len];
+        nextCode[len + 1] = (nextCode[len] + h.count[len]) << 1;
+    }
+
+    for(int s = 0; s < n; s++) {
+        int len = lengths[s];
+        if(len == 0) {
+            continue;
+        }
+
+        h.symbol[offsets[len]++] = static_cast<std::uint16_t>(s);
+
+        //codes are stored most significant bit first in the stream, so the
+        //table is indexed by the bit-reversed code
+        unsigned code = nextCode[len]++;
+        if(len <= Huffman::FAST_BITS) {
+            unsigned reversed = 0;
+            for(int i = 0; i < len; i++) {
+                reversed = (reversed << 1) | ((code >> i) & 1);
+            }
+
+            for(unsigned i = reversed; i < (1u << Huffman::FAST_BITS); i += 1u << len) {
+                h.fast[i] = static_cast<std::uint16_t>(s | (len << 9));
+            }
+        }
+    }
+}
+
+int GzipInflater::decodeSymbol(const Huffman &h) {
+    while(bitCount < Huffman::FAST_BITS) {
+        int byte = nextByte();
+        if(byte < 0) {
+            break;
+        }
+        bitBuffer |= static_cast<std::uint64_t>(byte) << bitCount;
+        bitCount += 8;
+    }
+
+    if(bitCount >= Huffman::FAST_BITS) {
+        std::uint16_t entry = h.fast[bitBuffer & ((1u << Huffman::FAST_BITS) - 1)];
+        if(entry != 0) {
+            int len = entry >> 9;
+            bitBuffer >>= len;
+            bitCount -= len;
+            return entry & 0x1ff;
+        }
+    }
+
+    //long code (or the end of the data): decode one bit at a time
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for(int len = 1; len < 16; len++) {
+        code |= static_cast<int>(bits(1));
+        int count = h.count[len];
+        if(code - count < first) {
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    throw std::runtime_error("GzipInflater::run: Invalid Huffman code");
+}
+
+/*
+  Decompress one gzip member (header, DEFLATE blocks and trailer).
+
+  @return
+    false if the sink asked to stop
+*/
+bool GzipInflater::member() {
+    header();
+    crc = 0;
+    produced = 0;
+
+    bool last = false;
+    while(!last && !stopped) {
+        last = bits(1) == 1;
+
+        switch(bits(2)) {
+            case 0:
+                storedBlock();
+                break;
+
+            case 1:
+                fixedBlock();
+                break;
+
+            case 2:
+                dynamicBlock();
+                break;
+
+            default:
+                throw std::runtime_error("GzipInflater::run: Invalid block type");
+        }
+    }
+
+    flushChunk();
+    if(stopped) {
+        return false;
+    }
+
+    alignToByte();
+    std::uint32_t expectedCrc = bits(16);
+    expectedCrc |= bits(16) << 16;
+    std::uint32_t expectedSize = bits(16);
+    expectedSize |= bits(16) << 16;
+
+    if(expectedCrc != crc || expectedSize != static_cast<std::uint32_t>(produced)) {
+        throw std::runtime_error("GzipInflater::run: Corrupt compressed data (checksum mismatch)");
+    }
+
+    return true;
+}
+
+void GzipInflater::header() {
+    if(bits(8) != 0x1f || bits(8) != 0x8b) {
+        throw std::runtime_error("GzipInflater::run: Not gzip data");
+    }
+
+    if(bits(8) != 8) {
+        throw std::runtime_error("GzipInflater::run: Unsupported compression method");
+    }
+
+    std::uint32_t flags = bits(8);
+
+    //modification time, extra flags and operating system
+    for(int i = 0; i < 6; i++) {
+        bits(8);
+    }
+
+    if(flags & 0x04) { //FEXTRA
+        std::uint32_t length = bits(16);
+        while(length-- > 0) {
+            bits(8);
+        }
+    }
+
+    if(flags & 0x08) { //FNAME
+        while(bits(8) != 0) {}
+    }
+
+    if(flags & 0x10) { //FCOMMENT
+        while(bits(8) != 0) {}
+    }
+
+    if(flags & 0x02) { //FHCRC
+        bits(16);
+    }
+}
+
+void GzipInflater::storedBlock() {
+    alignToByte();
+
+    std::uint32_t length = bits(16);
+    std::uint32_t complement = bits(16);
+    if(length != (~complement & 0xffff)) {
+        throw std::runtime_error("GzipInflater::run: Corrupt stored block");
+    }
+
+    while(length-- > 0) {
+        output(static_cast<unsigned char>(bits(8)));
+    }
+}
+
+void GzipInflater::codesBlock(const Huffman &lengths, const Huffman &distances) {
+    static const std::uint16_t lengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const std::uint8_t lengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const std::uint16_t distanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577};
+    static const std::uint8_t distanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    while(!stopped) {
+        int symbol = decodeSymbol(lengths);
+
+        if(symbol < 256) {
+            output(static_cast<unsigned char>(symbol));
+        } else if(symbol == 256) {
+            return;
+        } else {
+            symbol -= 257;
+            if(symbol >= 29) {
+                throw std::runtime_error("GzipInflater::run: Invalid length symbol");
+            }
+            std::size_t length = lengthBase[symbol] + bits(lengthExtra[symbol]);
+
+            symbol = decodeSymbol(distances);
+            if(symbol >= 30) {
+                throw std::runtime_error("GzipInflater::run: Invalid distance symbol");
+            }
+            std::size_t distance = distanceBase[symbol] + bits(distanceExtra[symbol]);
+
+            if(distance > produced) {
+                throw std::runtime_error("GzipInflater::run: Distance too far back");
+            }
+
+            while(length-- > 0) {
+                output(window[(windowPos - distance) % WINDOW_SIZE]);
+            }
+        }
+    }
+}
+
+void GzipInflater::fixedBlock() {
+    static const std::pair<Huffman, Huffman> codes = []() {
+        std::pair<Huffman, Huffman> fixed;
+        std::uint8_t lengths[288];
+
+        for(int s = 0; s < 144; s++) lengths[s] = 8;
+        for(int s = 144; s < 256; s++) lengths[s] = 9;
+        for(int s = 256; s < 280; s++) lengths[s] = 7;
+        for(int s = 280; s < 288; s++) lengths[s] = 8;
+        buildHuffman(fixed.first, lengths, 288);
+
+        for(int s = 0; s < 30; s++) lengths[s] = 5;
+        buildHuffman(fixed.second, lengths, 30);
+
+        return fixed;
+    }();
+
+    codesBlock(codes.first, codes.second);
+}
+
+void GzipInflater::dynamicBlock() {
+    static const std::uint8_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+    int lengthCount = static_cast<int>(bits(5)) + 257;
+    int distanceCount = static_cast<int>(bits(5)) + 1;
+    int codeCount = static_cast<int>(bits(4)) + 4;
+    if(lengthCount > 286 || distanceCount > 30) {
+        throw std::runtime_error("GzipInflater::run: Invalid dynamic block header");
+    }
+
+    std::uint8_t lengths[286 + 30] = {0};
+    for(int i = 0; i < codeCount; i++) {
+        lengths[order[i]] = static_cast<std::uint8_t>(bits(3));
+    }
+
+    Huffman codeLengths;
+    buildHuffman(codeLengths, lengths, 19);
+    std::memset(lengths, 0, 19);
+
+    int index = 0;
+    while(index < lengthCount + distanceCount) {
+        int symbol = decodeSymbol(codeLengths);
+
+        if(symbol < 16) {
+            lengths[index++] = static_cast<std::uint8_t>(symbol);
+        } else {
+            std::uint8_t length = 0;
+            int repeat;
+
+            if(symbol == 16) {
+                if(index == 0) {
+                    throw std::runtime_error("GzipInflater::run: Repeat with no previous length");
+                }
+                length = lengths[index - 1];
+                repeat = 3 + static_cast<int>(bits(2));
+            } else if(symbol == 17) {
+                repeat = 3 + static_cast<int>(bits(3));
+            } else {
+                repeat = 11 + static_cast<int>(bits(7));
+            }
+
+            if(index + repeat > lengthCount + distanceCount) {
+                throw std::runtime_error("GzipInflater::run: Too many code lengths");
+            }
+
+            while(repeat-- > 0) {
+                lengths[index++] = length;
+            }
+        }
+    }
+
+    if(lengths[256] == 0) {
+        throw std::runtime_error("GzipInflater::run: Missing end-of-block code");
+    }
+
+    Huffman lengthCode;
+    Huffman distanceCode;
+    buildHuffman(lengthCode, lengths, lengthCount);
+    buildHuffman(distanceCode, lengths + lengthCount, distanceCount);
+
+    codesBlock(lengthCode, distanceCode);
+}
@@ -0,0 +1,98 @@
+#ifndef INFLATE_H_
+#define INFLATE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the declaration of the GzipInflater class, which
+  decompresses gzip (RFC 1952) data holding DEFLATE (RFC 1951) compressed
+  blocks. It is self-contained so that Beth Yw? can read compressed datasets
+  without depending on an external library such as zlib.
+
+  Decompression is streaming: compressed bytes are pulled from a
+  std::streambuf as they are needed, and the decompressed bytes are handed to
+  a callback in chunks, so neither side needs to be held in memory in full.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/*
+  Returns true if `data` starts with the gzip magic bytes (1f 8b).
+*/
+bool isGzip(const char *data, std::size_t length);
+
+/*
+  Returns true if `data` starts with the zstd frame magic bytes.
+*/
+bool isZstd(const char *data, std::size_t length);
+
+class GzipInflater {
+public:
+    /*
+      The callback that receives decompressed data. Returning false stops
+      decompression early (e.g. because the reader has gone away).
+    */
+    using Sink = std::function<bool(std::string &chunk)>;
+
+    GzipInflater(std::streambuf &source, Sink sink);
+
+    void run();
+
+private:
+    /*
+      A canonical Huffman code, with a lookup table for short codes.
+    */
+    struct Huffman {
+        static constexpr int FAST_BITS = 9;
+
+        std::uint16_t count[16];
+        std::uint16_t symbol[288];
+        std::uint16_t fast[1 << FAST_BITS];
+    };
+
+    std::streambuf &source;
+    Sink sink;
+
+    std::vector<char> input;
+    std::size_t inputPos = 0;
+    std::size_t inputEnd = 0;
+
+    std::uint64_t bitBuffer = 0;
+    int bitCount = 0;
+
+    std::vector<unsigned char> window;
+    std::size_t windowPos = 0;
+    std::string chunk;
+    std::uint32_t crc = 0;
+    std::uint64_t produced = 0;
+    bool stopped = false;
+
+    bool fillInput();
+    int nextByte();
+    int peekByte();
+    std::uint32_t bits(int need);
+    void alignToByte();
+
+    void output(unsigned char byte);
+    void flushChunk();
+
+    static void buildHuffman(Huffman &h, const std::uint8_t *lengths, int n);
+    int decodeSymbol(const Huffman &h);
+
+    bool member();
+    void header();
+    void storedBlock();
+    void codesBlock(const Huffman &lengths, const Huffman &distances);
+    void fixedBlock();
+    void dynamicBlock();
+};
+
+#endif // INFLATE_H_
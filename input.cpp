@@ -17,7 +17,172 @@
   functions not specified.
  */
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BETHYW_IO_URING
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+#include "inflate.h"
 #include "input.h"
+#include "pipeline.h"
+
+/*
+  The number of decompressed chunks that may be waiting to be parsed.
+*/
+static constexpr std::size_t INFLATE_QUEUE_DEPTH = 4;
+
+/*
+  A read-only stream over a block of memory that is owned by someone else
+  (here, an InputBuffer). Unlike std::istringstream, no copy of the data is
+  made.
+*/
+class MemoryStream : public std::istream {
+private:
+    class MemoryStreambuf : public std::streambuf {
+    public:
+        MemoryStreambuf(const char *data, std::size_t length) {
+            char *begin = const_cast<char *>(data);
+            setg(begin, begin, begin + length);
+        }
+    };
+
+    MemoryStreambuf buffer;
+
+public:
+    MemoryStream(const char *data, std::size_t length)
+        : std::istream(nullptr), buffer(data, length) {
+        rdbuf(&buffer);
+    }
+};
+
+/*
+  A stream of the decompressed contents of a gzip-compressed source stream.
+  Decompression runs on its own thread, a few chunks ahead of whoever is
+  reading the stream, so that it overlaps with parsing.
+
+  Errors raised while decompressing are rethrown to the reader, as the
+  stream has badbit set in its exception mask.
+*/
+class InflatingStream : public std::istream {
+private:
+    class InflatingStreambuf : public std::streambuf {
+    private:
+        std::unique_ptr<std::istream> source;
+        BoundedQueue<std::string> chunks;
+        std::string current;
+        std::exception_ptr error;
+        std::thread worker;
+
+    public:
+        explicit InflatingStreambuf(std::unique_ptr<std::istream> compressed)
+            : source(std::move(compressed)), chunks(INFLATE_QUEUE_DEPTH) {
+            worker = std::thread([this]() {
+                try {
+                    GzipInflater inflater(*source->rdbuf(), [this](std::string &chunk) {
+                        return chunks.push(std::move(chunk));
+                    });
+                    inflater.run();
+                } catch(...) {
+                    error = std::current_exception();
+                }
+                chunks.close();
+            });
+        }
+
+        ~InflatingStreambuf() override {
+            //stops the worker if the reader gave up before the end
+            chunks.close();
+            worker.join();
+        }
+
+    protected:
+        int_type underflow() override {
+            if(gptr() < egptr()) {
+                return traits_type::to_int_type(*gptr());
+            }
+
+            if(!chunks.pop(current)) {
+                if(error) {
+                    std::rethrow_exception(error);
+                }
+                return traits_type::eof();
+            }
+
+            char *begin = &current[0];
+            setg(begin, begin, begin + current.size());
+            return traits_type::to_int_type(*gptr());
+        }
+    };
+
+    InflatingStreambuf buffer;
+
+public:
+    explicit InflatingStream(std::unique_ptr<std::istream> compressed)
+        : std::istream(nullptr), buffer(std::move(compressed)) {
+        rdbuf(&buffer);
+        exceptions(std::ios_base::badbit);
+    }
+};
+
+/*
+  Wrap `stream` so that it is transparently decompressed if `magic` (the
+  first bytes of the source) shows the source is compressed.
+
+  @throws
+    std::runtime_error if the source is compressed in a format we cannot read
+*/
+static std::unique_ptr<std::istream> decompressIfNeeded(
+        std::unique_ptr<std::istream> stream,
+        const char *magic,
+        std::size_t length,
+        const std::string &source) {
+    if(isGzip(magic, length)) {
+        return std::unique_ptr<std::istream>(new InflatingStream(std::move(stream)));
+    } else if(isZstd(magic, length)) {
+        throw std::runtime_error("InputFile::open: Unsupported compression (zstd) in file " + source);
+    }
+
+    return stream;
+}
+
+/*
+  finishInput(stream)
+
+  Read the rest of a stream, if it is being decompressed, so that the gzip
+  trailer is checked. Other streams hold no such checks, so are left as
+  they are.
+
+  @param stream
+    A stream returned by InputFile::open() or InputBuffer::open()
+
+  @throws
+    std::runtime_error if the rest of the source is corrupt
+*/
+void finishInput(std::istream &stream) {
+    if(dynamic_cast<InflatingStream *>(&stream) != nullptr) {
+        stream.ignore(std::numeric_limits<std::streamsize>::max());
+    }
+}
 
 /*
   TODO: InputSource::InputSource(source)
@@ -79,47 +244,535 @@ InputFile::InputFile(const std::string& filePath) : InputSource(filePath) {
 std::unique_ptr<std::istream> InputFile::open() {
 
     auto init_buf = std::make_unique<std::filebuf>();
-    //return a unique istream if the file opens, otherwise, throw an exception
-    return std::make_unique<std::istream>(
-            init_buf->open(getSource(), std::ios_base::in)
-            ? init_buf.release()
-            : throw std::runtime_error("InputFile::open: Failed to open file " + getSource())
-            );
+    if(!init_buf->open(getSource(), std::ios_base::in | std::ios_base::binary)) {
+        throw std::runtime_error("InputFile::open: Failed to open file " + getSource());
+    }
+
+    //look at the first few bytes to see if the file is compressed
+    char magic[4];
+    auto length = static_cast<std::size_t>(init_buf->sgetn(magic, sizeof(magic)));
+    init_buf->pubseekpos(0, std::ios_base::in);
+
+    return decompressIfNeeded(
+            std::make_unique<std::istream>(init_buf.release()),
+            magic,
+            length,
+            getSource());
+}
+
+/*
+  InputFile::read()
+
+  Read the whole file at the path retrievable from getSource() into memory.
+  This is used by the I/O stage of BethYw::loadDatasets() so that the disk
+  read for one dataset can happen while another dataset is being parsed.
+
+  @return
+    The contents of the file
+
+  @throws
+    std::runtime_error if there is an issue opening the file, with the message:
+    InputFile::open: Failed to open file <file name>
+
+  @example
+    InputFile input("data/areas.csv");
+    std::string contents = input.read();
+*/
+std::string InputFile::read() {
+    std::ifstream file(getSource(), std::ios_base::in | std::ios_base::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error("InputFile::open: Failed to open file " + getSource());
+    }
+
+    std::string contents;
+    file.seekg(0, std::ios_base::end);
+    std::streamoff length = file.tellg();
+    if(length > 0) {
+        contents.resize(static_cast<std::size_t>(length));
+        file.seekg(0, std::ios_base::beg);
+        file.read(&contents[0], length);
+    }
+
+    return contents;
+}
+
+/*
+  InputBuffer::InputBuffer(source, contents)
+
+  Constructor for a source that has already been read into memory.
+
+  @param source
+    A unique identifier for the source (i.e. the path it was read from)
+
+  @param contents
+    The data of the source
+
+  @example
+    InputFile file("data/areas.csv");
+    InputBuffer input("data/areas.csv", file.read());
+*/
+InputBuffer::InputBuffer(const std::string& source, std::string contents)
+    : InputSource(source), contents(std::move(contents)) {
+}
+
+/*
+  InputBuffer::open()
+
+  Open a stream over the in-memory contents. The stream reads directly from
+  the buffer held by this InputBuffer. If the contents are gzip-compressed,
+  the stream returns the decompressed data.
+
+  @return
+    A standard input stream over the contents
+*/
+std::unique_ptr<std::istream> InputBuffer::open() {
+    return decompressIfNeeded(
+            std::unique_ptr<std::istream>(new MemoryStream(contents.data(), contents.size())),
+            contents.data(),
+            contents.size(),
+            getSource());
+}
+
+/*
+  InputFileBatch::InputFileBatch(filePaths)
+
+  Constructor for a batch of file-based sources.
+
+  @param filePaths
+    The complete paths of the files to read
+
+  @example
+    InputFileBatch batch({"data/popu1009.json", "data/econ0080.json"});
+*/
+InputFileBatch::InputFileBatch(const std::vector<std::string>& filePaths)
+    : filePaths(filePaths) {
+}
+
+#ifndef _WIN32
+namespace {
+
+/*
+  A file of the batch that is being read with a plain file descriptor.
+*/
+struct BatchFile {
+    int fd = -1;
+    std::size_t offset = 0;
+    bool done = false;
+};
+
+/*
+  Read the rest of an open file from `file.offset` with pread(), growing the
+  buffer if the file turns out to be longer than its size when opened.
+*/
+void preadRemaining(BatchFile &file, std::string &contents, const std::string &path) {
+    while(true) {
+        if(file.offset == contents.size()) {
+            contents.resize(contents.size() + 4096);
+        }
+
+        ssize_t count = pread(file.fd,
+                              &contents[file.offset],
+                              contents.size() - file.offset,
+                              static_cast<off_t>(file.offset));
+        if(count < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("InputFile::read: Failed to read file " + path);
+        } else if(count == 0) {
+            break;
+        }
+
+        file.offset += static_cast<std::size_t>(count);
+    }
+
+    contents.resize(file.offset);
+    file.done = true;
+}
+
+#ifdef BETHYW_IO_URING
+/*
+  A minimal io_uring submission/completion ring set up with the raw system
+  calls, so that no extra library is needed to build Beth Yw?
+*/
+class Uring {
+private:
+    int fd = -1;
+    unsigned entries = 0;
+
+    void *sqRing = MAP_FAILED;
+    void *cqRing = MAP_FAILED;
+    std::size_t sqRingSize = 0;
+    std::size_t cqRingSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    std::size_t sqesSize = 0;
+
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    unsigned pending = 0;
+
+public:
+    Uring() = default;
+    Uring(Uring const &) = delete;
+    Uring &operator=(Uring const &) = delete;
+
+    ~Uring() {
+        if(sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if(cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if(sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if(fd >= 0) close(fd);
+    }
+
+    /*
+      Create the ring with room for at least `size` submissions.
+
+      @return
+        false if io_uring is not available
+    */
+    bool setup(unsigned size) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, size, &params));
+        if(fd < 0) {
+            return false;
+        }
+
+        entries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if(sqRing == MAP_FAILED) {
+            return false;
+        }
+
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if(cqRing == MAP_FAILED) {
+                return false;
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if(sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char *sq = static_cast<char *>(sqRing);
+        char *cq = static_cast<char *>(cqRing);
+        sqTail  = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask  = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead  = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail  = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask  = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes    = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    unsigned capacity() const {
+        return entries;
+    }
+
+    /*
+      Pin the buffers in memory so reads can use IORING_OP_READ_FIXED.
+
+      @return
+        false if the kernel refused (e.g. because of RLIMIT_MEMLOCK)
+    */
+    bool registerBuffers(const std::vector<iovec> &buffers) {
+        return syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+                       buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    }
+
+    /*
+      Queue a read of `length` bytes at `offset` of `fileFd` into `buffer`.
+      If `bufferIndex` is not negative, the buffer is the registered buffer
+      with that index.
+    */
+    void queueRead(int fileFd, char *buffer, std::size_t length, std::size_t offset,
+                   int bufferIndex, std::uint64_t userData) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+
+        io_uring_sqe &sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = bufferIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd = fileFd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = static_cast<unsigned>(length);
+        sqe.off = offset;
+        sqe.buf_index = static_cast<std::uint16_t>(bufferIndex >= 0 ? bufferIndex : 0);
+        sqe.user_data = userData;
+
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        pending++;
+    }
+
+    /*
+      Submit every queued read and wait until at least one has completed.
+
+      @return
+        false if the submission failed
+    */
+    bool submitAndWait() {
+        while(true) {
+            long result = syscall(__NR_io_uring_enter, fd, pending, 1,
+                                  IORING_ENTER_GETEVENTS, nullptr, 0);
+            if(result >= 0) {
+                pending -= static_cast<unsigned>(result);
+                return true;
+            } else if(errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
     /*
-    std::string source = getSource();
+      Wait, without submitting anything, until at least one completion is
+      on the ring.
+
+      @return
+        false if the wait failed
+    */
+    bool wait() {
+        while(true) {
+            long result = syscall(__NR_io_uring_enter, fd, 0, 1,
+                                  IORING_ENTER_GETEVENTS, nullptr, 0);
+            if(result >= 0) {
+                return true;
+            } else if(errno != EINTR) {
+                return false;
+            }
+        }
+    }
 
+    /*
+      The number of queued reads the kernel has not been given yet.
+    */
+    unsigned unsubmitted() const {
+        return pending;
+    }
 
-    std::cout<<"trying to open " + source << std::endl;
-    std::filebuf fileBuffer;
+    /*
+      Take the next completion off the ring, if there is one.
+    */
+    bool nextCompletion(io_uring_cqe &completion) {
+        unsigned head = *cqHead;
+        if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+
+        completion = cqes[head & *cqMask];
+        __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+
+/*
+  The most bytes asked for by a single read, as the length of a read is 32
+  bits (and Linux reads at most 2 GiB at a time anyway). Larger files are
+  read in several parts.
+*/
+constexpr std::size_t URING_MAX_READ = std::size_t(1) << 30;
 
-    if(fileBuffer.open(source, std::ios::in)) {
+/*
+  Read every file in `files` that is not already done, and whose size is
+  known, with io_uring.
 
-        std::istream s(&fileBuffer);
-        while(!s.eof()) {
-            char c = s.get();
-            std::cout<< c;
+  @return
+    false if io_uring could not be used, in which case the caller should
+    finish the remaining files with pread()
+*/
+bool uringReadAll(std::vector<BatchFile> &files,
+                  std::vector<InputFileBatch::Result> &results) {
+    std::vector<std::size_t> todo;
+    for(std::size_t i = 0; i < files.size(); i++) {
+        if(!files[i].done && !results[i].contents.empty()) {
+            todo.push_back(i);
         }
+    }
 
-       return &s;
-    } else {
+    if(todo.empty()) {
+        return true;
+    }
 
+    Uring ring;
+    if(!ring.setup(static_cast<unsigned>(std::min<std::size_t>(todo.size(), 64)))) {
+        return false;
     }
 
-    std::ifstream is(source);
+    //try to pin the buffers; plain reads work just as well if we can't
+    std::vector<iovec> buffers;
+    std::vector<int> bufferIndex(files.size(), -1);
+    for(std::size_t i : todo) {
+        std::string &contents = results[i].contents;
+        bufferIndex[i] = static_cast<int>(buffers.size());
+        buffers.push_back(iovec{&contents[0], contents.size()});
+    }
 
-    std::string test;
-    is >> test;
+    if(!ring.registerBuffers(buffers)) {
+        std::fill(bufferIndex.begin(), bufferIndex.end(), -1);
+    }
 
-    if(!is.fail()) {
-        std::istream &s = is;
+    std::size_t next = 0;
+    std::size_t inFlight = 0;
+    std::vector<std::size_t> resubmit;
+
+    //before giving up, wait for every read the kernel was given, so that
+    //none is still writing to a buffer once pread() takes over (the offsets
+    //of the files are left where they were, so pread() reads those parts
+    //again)
+    auto abandon = [&ring, &inFlight]() {
+        io_uring_cqe completion;
+        while(inFlight > ring.unsubmitted() && ring.wait()) {
+            while(ring.nextCompletion(completion)) {
+                inFlight--;
+            }
+        }
+        return false;
+    };
+
+    while(next < todo.size() || inFlight > 0 || !resubmit.empty()) {
+        //reads cut short are queued again first, then files not started yet
+        while(inFlight < ring.capacity() && (!resubmit.empty() || next < todo.size())) {
+            std::size_t i;
+            if(!resubmit.empty()) {
+                i = resubmit.back();
+                resubmit.pop_back();
+            } else {
+                i = todo[next++];
+            }
+
+            std::string &contents = results[i].contents;
+            ring.queueRead(files[i].fd,
+                           &contents[files[i].offset],
+                           std::min(contents.size() - files[i].offset, URING_MAX_READ),
+                           files[i].offset,
+                           bufferIndex[i],
+                           i);
+            inFlight++;
+        }
+
+        if(!ring.submitAndWait()) {
+            return abandon();
+        }
 
-        while(!s.eof()) {
-            char c = s.get();
-            std::cout<< c;
+        io_uring_cqe completion;
+        while(ring.nextCompletion(completion)) {
+            inFlight--;
+            std::size_t i = static_cast<std::size_t>(completion.user_data);
+
+            if(completion.res < 0) {
+                if(completion.res == -EINTR || completion.res == -EAGAIN) {
+                    resubmit.push_back(i);
+                } else {
+                    //leave the file for pread() to report the error
+                    continue;
+                }
+            } else if(completion.res == 0) {
+                //the file is shorter than it was when we opened it
+                results[i].contents.resize(files[i].offset);
+                files[i].done = true;
+            } else {
+                files[i].offset += static_cast<std::size_t>(completion.res);
+                if(files[i].offset == results[i].contents.size()) {
+                    files[i].done = true;
+                } else {
+                    resubmit.push_back(i);
+                }
+            }
         }
+    }
+
+    return true;
+}
+#endif // BETHYW_IO_URING
+
+} // namespace
+#endif // _WIN32
+
+/*
+  InputFileBatch::read()
+
+  Read every file of the batch into memory. A file that cannot be opened or
+  read does not stop the rest of the batch: its Result holds the exception
+  instead, so the caller can report it in the right place.
+
+  @return
+    One Result per file, in the same order as the paths given to the
+    constructor
+
+  @example
+    InputFileBatch batch({"data/popu1009.json", "data/econ0080.json"});
+    auto results = batch.read();
+*/
+std::vector<InputFileBatch::Result> InputFileBatch::read() {
+    std::vector<Result> results(filePaths.size());
+
+#ifdef _WIN32
+    for(std::size_t i = 0; i < filePaths.size(); i++) {
+        try {
+            results[i].contents = InputFile(filePaths[i]).read();
+        } catch(...) {
+            results[i].error = std::current_exception();
+        }
+    }
+#else
+    std::vector<BatchFile> files(filePaths.size());
+
+    for(std::size_t i = 0; i < filePaths.size(); i++) {
+        BatchFile &file = files[i];
+        file.fd = ::open(filePaths[i].c_str(), O_RDONLY | O_CLOEXEC);
+
+        struct stat info;
+        if(file.fd < 0 || fstat(file.fd, &info) != 0) {
+            results[i].error = std::make_exception_ptr(std::runtime_error(
+                    "InputFile::open: Failed to open file " + filePaths[i]));
+            file.done = true;
+        } else if(S_ISREG(info.st_mode)) {
+            results[i].contents.resize(static_cast<std::size_t>(info.st_size));
+        }
+        //otherwise the size is unknown, and pread() finds the end below
+    }
+
+#ifdef BETHYW_IO_URING
+    uringReadAll(files, results);
+#endif
+
+    //anything io_uring did not finish (or could not start) is read here
+    for(std::size_t i = 0; i < files.size(); i++) {
+        if(!files[i].done) {
+            try {
+                preadRemaining(files[i], results[i].contents, filePaths[i]);
+            } catch(...) {
+                results[i].error = std::current_exception();
+            }
+        }
+
+        if(files[i].fd >= 0) {
+            ::close(files[i].fd);
+        }
+    }
+#endif
 
-        return s;
-    } else {
-        throw new std::runtime_error("InputFile::open: Failed to open file " + source);
-    }*/
+    return results;
 }
@@ -22,7 +22,10 @@
  */
 
 #include <string>
+#include <exception>
 #include <fstream>
+#include <memory>
+#include <vector>
 #include <iostream> //debugging purpose only
 
 /*
@@ -57,6 +60,55 @@ class InputFile : public InputSource {
 public:
     InputFile(const std::string& filePath);
     std::unique_ptr<std::istream> open();
+    std::string read();
 };
 
-#endif // INPUT_H_
\ No newline at end of file
+/*
+  Source data that has already been read into memory, e.g. by the I/O stage
+  of the dataset loading pipeline. The buffer is owned by the InputBuffer, so
+  it must outlive any stream returned by open().
+*/
+class InputBuffer : public InputSource {
+private:
+    std::string contents;
+
+public:
+    InputBuffer(const std::string& source, std::string contents);
+    std::unique_ptr<std::istream> open();
+};
+
+/*
+  Reads a batch of files into memory at once. On Linux, the reads for every
+  file in the batch are submitted together through io_uring into registered
+  buffers, so the device can work on all of them at the same time. Where
+  io_uring is not available (older kernels, other platforms, or when it is
+  blocked by a sandbox), each file is read in turn with pread(), or with
+  InputFile::read() on Windows.
+*/
+class InputFileBatch {
+public:
+    /*
+      The outcome of reading one file of the batch: either its contents, or
+      the exception that reading it raised.
+    */
+    struct Result {
+        std::string contents;
+        std::exception_ptr error;
+    };
+
+    InputFileBatch(const std::vector<std::string>& filePaths);
+    std::vector<Result> read();
+
+private:
+    std::vector<std::string> filePaths;
+};
+
+/*
+  Read whatever a parser left of a stream returned by InputFile::open() or
+  InputBuffer::open(), so that an error only found at the end of a
+  compressed source (a gzip trailer that does not match the data) is
+  raised even if the parser stopped before it.
+*/
+void finishInput(std::istream &stream);
+
+#endif // INPUT_H_
@@ -0,0 +1,220 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the JsonWriter class.
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "lib_json.hpp"
+
+#include "jsonwriter.h"
+
+/*
+  JsonWriter::JsonWriter(os)
+
+  Create a writer. Output is buffered, and written to `os` in large blocks
+  when the buffer is full, on flush() and when the writer is destroyed.
+
+  @param os
+    The stream to write the JSON to
+*/
+JsonWriter::JsonWriter(std::ostream &os) : os(os), buffer(BUFFER_SIZE) {
+    empty.reserve(8);
+}
+
+JsonWriter::~JsonWriter() {
+    flush();
+}
+
+/*
+  Write the buffered output to the stream.
+*/
+void JsonWriter::flush() {
+    if(used > 0) {
+        os.write(buffer.data(), static_cast<std::streamsize>(used));
+        used = 0;
+    }
+}
+
+void JsonWriter::write(const char *data, std::size_t length) {
+    if(length > buffer.size() - used) {
+        flush();
+        if(length > buffer.size()) {
+            os.write(data, static_cast<std::streamsize>(length));
+            return;
+        }
+    }
+    std::memcpy(buffer.data() + used, data, length);
+    used += length;
+}
+
+/*
+  Write the comma needed before a key or value, if any.
+*/
+void JsonWriter::separate() {
+    if(afterKey) {
+        afterKey = false;
+        return;
+    }
+
+    if(!empty.empty()) {
+        if(!empty.back()) {
+            put(',');
+        }
+        empty.back() = false;
+    }
+}
+
+void JsonWriter::beginObject() {
+    separate();
+    put('{');
+    empty.push_back(true);
+}
+
+void JsonWriter::endObject() {
+    empty.pop_back();
+    put('}');
+}
+
+void JsonWriter::beginArray() {
+    separate();
+    put('[');
+    empty.push_back(true);
+}
+
+void JsonWriter::endArray() {
+    empty.pop_back();
+    put(']');
+}
+
+void JsonWriter::key(const std::string &name) {
+    separate();
+    string(name.data(), name.size());
+    put(':');
+    afterKey = true;
+}
+
+/*
+  Write an integer key (e.g. a year), which JSON requires to be a string.
+*/
+void JsonWriter::key(int name) {
+    unsigned int magnitude = name < 0 ? 0u - static_cast<unsigned int>(name)
+                                      : static_cast<unsigned int>(name);
+
+    separate();
+    put('"');
+    integer(name < 0, magnitude);
+    put('"');
+    put(':');
+    afterKey = true;
+}
+
+/*
+  Write the digits of an integer.
+*/
+void JsonWriter::integer(bool negative, std::uint64_t magnitude) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+
+    do {
+        *--start = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude > 0);
+    if(negative) {
+        *--start = '-';
+    }
+
+    write(start, static_cast<std::size_t>(end - start));
+}
+
+/*
+  Write a number in its shortest form that reads back as the same double,
+  using the same algorithm as nlohmann::json. JSON has no representation of
+  NaN or infinity, so those are written as null, as nlohmann::json does.
+*/
+void JsonWriter::value(double number) {
+    separate();
+
+    if(!std::isfinite(number)) {
+        write("null", 4);
+        return;
+    }
+
+    char digits[64];
+    char *end = nlohmann::detail::to_chars(digits, digits + sizeof(digits), number);
+    write(digits, static_cast<std::size_t>(end - digits));
+}
+
+/*
+  Write an integer (e.g. a count) without a fraction, as nlohmann::json
+  writes its integers.
+*/
+void JsonWriter::value(std::int64_t number) {
+    std::uint64_t magnitude = number < 0 ? 0u - static_cast<std::uint64_t>(number)
+                                         : static_cast<std::uint64_t>(number);
+
+    separate();
+    integer(number < 0, magnitude);
+}
+
+void JsonWriter::value(std::uint64_t number) {
+    separate();
+    integer(false, number);
+}
+
+void JsonWriter::value(const std::string &text) {
+    separate();
+    string(text.data(), text.size());
+}
+
+/*
+  Write a quoted string, escaping the characters JSON requires to be
+  escaped. Other characters (including UTF-8 sequences) are written as they
+  are.
+*/
+void JsonWriter::string(const char *data, std::size_t length) {
+    static const char hex[] = "0123456789abcdef";
+
+    put('"');
+
+    std::size_t start = 0;
+    for(std::size_t i = 0; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if(c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        write(data + start, i - start);
+        start = i + 1;
+
+        put('\\');
+        switch(c) {
+            case '"':  put('"');  break;
+            case '\\': put('\\'); break;
+            case '\b': put('b');  break;
+            case '\f': put('f');  break;
+            case '\n': put('n');  break;
+            case '\r': put('r');  break;
+            case '\t': put('t');  break;
+            default:
+                put('u');
+                put('0');
+                put('0');
+                put(hex[c >> 4]);
+                put(hex[c & 0xf]);
+        }
+    }
+    write(data + start, length - start);
+
+    put('"');
+}
@@ -0,0 +1,75 @@
+#ifndef JSONWRITER_H_
+#define JSONWRITER_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the JsonWriter class, which writes JSON straight to a
+  stream as it is produced, rather than building a document (e.g. a
+  nlohmann::json object) first and serialising it at the end. The memory it
+  uses does not depend on the size of the output.
+
+  The output is formatted exactly as nlohmann::json::dump() would format it:
+  no whitespace, numbers in their shortest round-trip form, and non-ASCII
+  characters written as they are.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class JsonWriter {
+public:
+    static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+
+    explicit JsonWriter(std::ostream &os);
+    ~JsonWriter();
+
+    JsonWriter(JsonWriter const &) = delete;
+    JsonWriter &operator=(JsonWriter const &) = delete;
+
+    void beginObject();
+    void endObject();
+
+    void beginArray();
+    void endArray();
+
+    void key(const std::string &name);
+    void key(int name);
+
+    void value(double number);
+    void value(std::int64_t number);
+    void value(std::uint64_t number);
+    void value(const std::string &text);
+
+    void flush();
+
+private:
+    std::ostream &os;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+
+    //for each open object or array, whether nothing has been written in it
+    //yet
+    std::vector<bool> empty;
+    bool afterKey = false;
+
+    void separate();
+    void put(char c) {
+        if(used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = c;
+    }
+    void write(const char *data, std::size_t length);
+    void integer(bool negative, std::uint64_t magnitude);
+    void string(const char *data, std::size_t length);
+};
+
+#endif // JSONWRITER_H_
@@ -1,2 +1,3 @@
 #define CATCH_CONFIG_MAIN 
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include "lib_catch.hpp"
@@ -18,10 +18,13 @@
   must implement has a TODO block comment. 
 */
 
+#include <algorithm>
 #include <stdexcept>
 #include <string>
 
 #include "measure.h"
+#include "measureindex.h"
+#include "tablewriter.h"
 
 /*
   TODO: Measure::Measure(codename, label);
@@ -74,7 +77,7 @@ Measure::Measure() {
     auto codename2 = measure.getCodename();
 */
 
-std::string Measure::getCodename() const{
+std::string const &Measure::getCodename() const{
     return codename;
 }
 
@@ -98,7 +101,7 @@ std::string Measure::getCodename() const{
     auto label = measure.getLabel();
 */
 
-std::string Measure::getLabel() const{
+std::string const &Measure::getLabel() const{
     return label;
 }
 
@@ -167,10 +170,73 @@ MeasureDataType Measure::getValue(int key) const {
  * This function exists only for the Area class to combine the two
  * @return The container with the labels and respective values
  */
-std::map<int, MeasureDataType> Measure::getData() const {
+std::map<int, MeasureDataType> const &Measure::getData() const {
     return data;
 }
 
+/*
+  Measure::buildIndex()
+
+  Build a MeasureIndex over the values, so that the statistics of any range
+  of years (and getAverage()) are found in constant time. The index is kept
+  until a value is set.
+*/
+void Measure::buildIndex() {
+    index = std::make_shared<const MeasureIndex>(data);
+}
+
+/*
+  Measure::hasIndex()
+
+  @return
+    true if the Measure has an up to date index of its values
+*/
+bool Measure::hasIndex() const {
+    return index != nullptr;
+}
+
+/*
+  Measure::getRangeStats(firstYear, lastYear, stats)
+
+  Calculate the count, sum, average, minimum, maximum and difference of the
+  values from firstYear to lastYear (inclusive): in constant time from the
+  index if it has been built (see buildIndex()), or by scanning the values
+  in the range if not.
+
+  @param firstYear
+    The first year of the range
+
+  @param lastYear
+    The last year of the range
+
+  @param stats
+    The statistics of the range, if it has any values
+
+  @return
+    true if the range has any values, false (leaving `stats` as it was) if
+    not
+
+  @example
+    Measure measure("pop", "Population");
+    measure.setValue(2010, 100);
+    measure.setValue(2011, 110);
+    measure.setValue(2012, 90);
+    measure.buildIndex();
+
+    RangeStats stats;
+    measure.getRangeStats(2011, 2012, stats); // stats.min is 90
+*/
+bool Measure::getRangeStats(int firstYear, int lastYear, RangeStats &stats) const {
+    if(index) {
+        return index->stats(firstYear, lastYear, stats);
+    }
+
+    if(firstYear > lastYear) {
+        return false;
+    }
+    return scanRangeStats(data.lower_bound(firstYear), data.upper_bound(lastYear), stats);
+}
+
 /*
   TODO: Measure::setValue(key, value)
 
@@ -204,6 +270,7 @@ void Measure::setValue(int key, MeasureDataType value) {
     }
 
     data[key] = value;
+    index.reset();
     (void)getValue(key); //suppresses warning that the function isn't called
 }
 
@@ -306,6 +373,10 @@ double Measure::getDifferenceAsPercentage() const{
 */
 
 double Measure::getAverage() const {
+    RangeStats all;
+    if(index && index->stats(earliestYear, latestYear, all)) {
+        return all.average;
+    }
 
     double totalValues = 0;
 
@@ -355,53 +426,7 @@ double Measure::getAverage() const {
 */
 
 std::ostream& operator<<(std::ostream& os, Measure const &measure) {
-
-    int const width = 15;
-    int const precision = 6;
-    os << std::fixed;
-    os << std::setprecision(6);
-    os << '\n' + measure.getLabel() + " (" + measure.getCodename() + ")\n";
-
-    if(measure.size() > 0) {
-
-        //I go through the data twice because I have no idea how to return to
-        //a line in c++, and if my research yielded correct information,
-        //it is impossible.
-
-        for(std::pair<int, MeasureDataType> element: measure.getData()) {
-            os.width(width);
-            os << std::right << element.first;
-        }
-
-        os.width(width);
-        os << std::right << "Average";
-
-        os.width(width);
-        os << std::right << "Diff.";
-
-        os.width(width);
-        os << std::right << "% Diff.\n";
-
-        for(std::pair<int, MeasureDataType> element: measure.getData()) {
-            os.width(width);
-            os << std::right << std::setprecision(precision) << element.second;
-        }
-
-        os.width(width);
-        os << std::right << std::setprecision(precision) << measure.getAverage();
-
-        os.width(width);
-        os << std::right << std::setprecision(precision) << measure.getDifference();
-
-        os.width(width);
-        os << std::right << std::setprecision(precision) << measure.getDifferenceAsPercentage();
-
-    } else {
-        os << "<no data>";
-    }
-
-    os << '\n';
-
+    TableWriter(os).write(measure);
     return os;
 }
 
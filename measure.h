@@ -16,6 +16,7 @@
 
 #include <string>
 #include <map>
+#include <memory>
 #include <iostream>
 #include <iomanip>
 #include<stdio.h>
@@ -32,6 +33,9 @@
 
 using MeasureDataType = double;
 
+class MeasureIndex;
+struct RangeStats;
+
 class Measure {
 private:
     std::string label;
@@ -40,12 +44,15 @@ private:
     int earliestYear;
     int latestYear;
 
+    // shared by the copies of the Measure until one of them changes
+    std::shared_ptr<const MeasureIndex> index;
+
 public:
     Measure();
     Measure(std::string const &code, const std::string &label);
 
-    std::string getLabel() const;
-    std::string getCodename() const;
+    std::string const &getLabel() const;
+    std::string const &getCodename() const;
     void setLabel(std::string const &label);
     MeasureDataType getValue(int key) const;
     void setValue(int key, MeasureDataType value);
@@ -53,7 +60,11 @@ public:
     double getDifference() const;
     double getDifferenceAsPercentage() const;
     double getAverage() const;
-    std::map<int, MeasureDataType> getData() const;
+    std::map<int, MeasureDataType> const &getData() const;
+
+    void buildIndex();
+    bool hasIndex() const;
+    bool getRangeStats(int firstYear, int lastYear, RangeStats &stats) const;
 
 
     friend bool operator==(Measure const &lhs, Measure const &rhs);
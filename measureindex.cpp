@@ -0,0 +1,153 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the MeasureIndex class.
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include "measureindex.h"
+
+/*
+  MeasureIndex::MeasureIndex(data)
+
+  Build the index over the values of a Measure, in time linear in the span
+  of its years plus n log n in the number of its values.
+
+  @param data
+    The values of the Measure, by year
+*/
+MeasureIndex::MeasureIndex(std::map<int, MeasureDataType> const &data) {
+    years.reserve(data.size());
+    values.reserve(data.size());
+    for(auto const &element : data) {
+        years.push_back(element.first);
+        values.push_back(element.second);
+    }
+
+    build();
+}
+
+/*
+  MeasureIndex::MeasureIndex(years, values)
+
+  Build the index over values that are not in a Measure, e.g. those of a
+  series of a snapshot.
+
+  @param years
+    The years of the values, in ascending order without repeats
+
+  @param values
+    The value of each year
+*/
+MeasureIndex::MeasureIndex(std::vector<int> years, std::vector<MeasureDataType> values)
+    : years(std::move(years)), values(std::move(values)) {
+    build();
+}
+
+void MeasureIndex::build() {
+    if(years.empty()) {
+        return;
+    }
+
+    std::size_t n = years.size();
+
+    //summed in the same order as Measure::getAverage(), so that the sum of
+    //all the values is exactly the same
+    prefix.reserve(n + 1);
+    double sum = 0;
+    prefix.push_back(sum);
+    for(MeasureDataType value : values) {
+        sum += value;
+        prefix.push_back(sum);
+    }
+
+    earliestYear = years.front();
+    latestYear = years.back();
+
+    before.resize(static_cast<std::size_t>(latestYear - earliestYear) + 2);
+    std::size_t next = 0;
+    for(std::size_t y = 0; y < before.size(); y++) {
+        while(next < n && years[next] < earliestYear + static_cast<int>(y)) {
+            next++;
+        }
+        before[y] = static_cast<std::uint32_t>(next);
+    }
+
+    floorLog2.assign(n + 1, 0);
+    for(std::size_t length = 2; length <= n; length++) {
+        floorLog2[length] = static_cast<std::uint8_t>(floorLog2[length / 2] + 1);
+    }
+
+    mins = values;
+    maxs = values;
+    levelStart.push_back(0);
+    for(std::size_t k = 1, width = 2; width <= n; k++, width *= 2) {
+        std::size_t previous = levelStart[k - 1];
+        std::size_t start = mins.size();
+        levelStart.push_back(start);
+
+        for(std::size_t i = 0; i + width <= n; i++) {
+            mins.push_back(std::min(mins[previous + i], mins[previous + i + width / 2]));
+            maxs.push_back(std::max(maxs[previous + i], maxs[previous + i + width / 2]));
+        }
+    }
+}
+
+/*
+  MeasureIndex::stats(firstYear, lastYear, out)
+
+  Get the statistics of the values from firstYear to lastYear (inclusive)
+  in constant time.
+
+  @param firstYear
+    The first year of the range
+
+  @param lastYear
+    The last year of the range
+
+  @param out
+    The statistics of the range, if it has any values
+
+  @return
+    true if the range has any values, false (leaving `out` as it was) if
+    not
+*/
+bool MeasureIndex::stats(int firstYear, int lastYear, RangeStats &out) const {
+    firstYear = std::max(firstYear, earliestYear);
+    lastYear = std::min(lastYear, latestYear);
+    if(firstYear > lastYear) {
+        return false;
+    }
+
+    std::size_t i = before[static_cast<std::size_t>(firstYear - earliestYear)];
+    std::size_t j = before[static_cast<std::size_t>(lastYear - earliestYear) + 1];
+    if(i >= j) {
+        return false;
+    }
+
+    std::size_t length = j - i;
+    std::uint8_t k = floorLog2[length];
+    std::size_t level = levelStart[k];
+    std::size_t second = j - (std::size_t(1) << k);
+
+    out.count = static_cast<int>(length);
+    out.firstYear = years[i];
+    out.lastYear = years[j - 1];
+    out.sum = prefix[j] - prefix[i];
+    out.average = out.sum / static_cast<double>(length);
+    out.min = std::min(mins[level + i], mins[level + second]);
+    out.max = std::max(maxs[level + i], maxs[level + second]);
+    out.difference = values[j - 1] - values[i];
+    out.differencePercentage = 100.0 * (out.difference / values[i]);
+    return true;
+}
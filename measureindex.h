@@ -0,0 +1,129 @@
+#ifndef MEASUREINDEX_H_
+#define MEASUREINDEX_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the MeasureIndex class, which a Measure can build over
+  its values (Measure::buildIndex()) to answer statistics of any range of
+  years in constant time, without scanning its values again:
+
+    - a table from each year between the Measure's first and last to the
+      number of values before it, which finds the values of a range
+    - the prefix sums of the values, for the count, sum and average
+    - sparse tables of the minimum and maximum of every run of 2^k values,
+      any range being covered by two (overlapping) runs
+
+  An index is immutable; setting a value of its Measure discards it. A
+  snapshot builds one the same way over the values of each of its series
+  (Snapshot::buildIndexes()), for server and batch mode.
+
+  A sum (and so an average) of a range that starts after the first value is
+  the difference of two prefix sums, which can differ in the last bits from
+  adding up the values of the range one by one, as scanning them does. The
+  sum of a range from the first value, and every other statistic, is the
+  same either way.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "measure.h"
+
+/*
+  The statistics of the values of a Measure in a range of years. The
+  difference and its percentage are between the first and last year of the
+  range that have values, as Measure::getDifference() and
+  Measure::getDifferenceAsPercentage() are for all the years.
+*/
+struct RangeStats {
+    int count = 0;
+    int firstYear = 0;
+    int lastYear = 0;
+    double sum = 0;
+    double average = 0;
+    double min = 0;
+    double max = 0;
+    double difference = 0;
+    double differencePercentage = 0;
+};
+
+/*
+  The statistics of a run of (year, value) pairs in order of year, found by
+  scanning them: the same as MeasureIndex::stats() of the run, but with the
+  values added up one by one.
+
+  @return
+    false (leaving `out` as it was) if the run is empty
+*/
+template <typename Iterator>
+bool scanRangeStats(Iterator first, Iterator last, RangeStats &out) {
+    if(first == last) {
+        return false;
+    }
+
+    RangeStats scanned;
+    scanned.firstYear = first->first;
+    scanned.min = first->second;
+    scanned.max = first->second;
+    double lastValue = first->second;
+    for(Iterator it = first; it != last; ++it) {
+        scanned.count++;
+        scanned.lastYear = it->first;
+        scanned.sum += it->second;
+        scanned.min = std::min(scanned.min, it->second);
+        scanned.max = std::max(scanned.max, it->second);
+        lastValue = it->second;
+    }
+
+    double firstValue = first->second;
+    scanned.average = scanned.sum / static_cast<double>(scanned.count);
+    scanned.difference = lastValue - firstValue;
+    scanned.differencePercentage = 100.0 * (scanned.difference / firstValue);
+
+    out = scanned;
+    return true;
+}
+
+class MeasureIndex {
+public:
+    MeasureIndex() = default;
+    explicit MeasureIndex(std::map<int, MeasureDataType> const &data);
+    MeasureIndex(std::vector<int> years, std::vector<MeasureDataType> values);
+
+    bool stats(int firstYear, int lastYear, RangeStats &out) const;
+
+private:
+    int earliestYear = 0;
+    int latestYear = -1;
+
+    std::vector<int> years;
+    std::vector<MeasureDataType> values;
+
+    // before[y - earliestYear] is the number of values before year y, for
+    // each year up to one after the latest
+    std::vector<std::uint32_t> before;
+
+    // prefix[i] is the sum of the first i values
+    std::vector<double> prefix;
+
+    // the sparse tables, level k holding the minimum/maximum of the 2^k
+    // values from each position, one level after another
+    std::vector<MeasureDataType> mins;
+    std::vector<MeasureDataType> maxs;
+    std::vector<std::size_t> levelStart;
+
+    // floorLog2[n] for each length n of a range
+    std::vector<std::uint8_t> floorLog2;
+
+    void build();
+};
+
+#endif // MEASUREINDEX_H_
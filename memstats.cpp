@@ -0,0 +1,382 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the MemStats class, and the
+  replacements of the global operator new and operator delete that count
+  allocations for it.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "lib_json.hpp"
+
+#include "areas.h"
+#include "memstats.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+std::atomic<bool> MemStats::on(false);
+thread_local MemStats::Subsystem MemStats::subsystem = MemStats::OTHER;
+
+namespace {
+
+std::atomic<std::uint64_t> allocations[MemStats::NUM_SUBSYSTEMS];
+std::atomic<std::uint64_t> allocatedBytes[MemStats::NUM_SUBSYSTEMS];
+std::atomic<std::uint64_t> frees[MemStats::NUM_SUBSYSTEMS];
+
+// the heap bytes of a node of a std::map or std::set, besides its value: a
+// colour and three links (the layout of both libstdc++ and MSVC)
+const std::size_t TREE_NODE = 4 * sizeof(void *);
+
+// the heap bytes of a node of a std::unordered_map, besides its value: a
+// link and the cached hash of the key
+const std::size_t HASH_NODE = 2 * sizeof(void *);
+
+/*
+  The heap bytes a string holds, which are none if its characters fit in the
+  string object itself (the small string optimisation).
+*/
+std::uint64_t heapBytes(std::string const &s) {
+    const char *object = reinterpret_cast<const char *>(&s);
+    std::less<const char *> before;
+
+    if(!before(s.data(), object) && before(s.data(), object + sizeof(s))) {
+        return 0;
+    }
+    return s.capacity() + 1;
+}
+
+void *allocate(std::size_t size) {
+    void *memory;
+    while((memory = std::malloc(size > 0 ? size : 1)) == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if(handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+
+    if(MemStats::enabled()) {
+        MemStats::countAllocation(size);
+    }
+    return memory;
+}
+
+void deallocate(void *memory) noexcept {
+    if(memory != nullptr && MemStats::enabled()) {
+        MemStats::countFree();
+    }
+    std::free(memory);
+}
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::nothrow_t const &) noexcept {
+    try {
+        return allocate(size);
+    } catch(std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void *operator new[](std::size_t size, std::nothrow_t const &) noexcept {
+    try {
+        return allocate(size);
+    } catch(std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void operator delete(void *memory) noexcept {
+    deallocate(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    deallocate(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    deallocate(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+    deallocate(memory);
+}
+
+void operator delete(void *memory, std::nothrow_t const &) noexcept {
+    deallocate(memory);
+}
+
+void operator delete[](void *memory, std::nothrow_t const &) noexcept {
+    deallocate(memory);
+}
+
+/*
+  MemStats::countAllocation(bytes)
+
+  Count an allocation of `bytes` against the subsystem this thread is
+  working for.
+
+  @param bytes
+    The size of the allocation
+*/
+void MemStats::countAllocation(std::size_t bytes) noexcept {
+    allocations[subsystem].fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes[subsystem].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/*
+  MemStats::countFree()
+
+  Count a free against the subsystem this thread is working for (which
+  need not be the subsystem that allocated the memory).
+*/
+void MemStats::countFree() noexcept {
+    frees[subsystem].fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+  MemStats::counts(of)
+
+  @param of
+    A subsystem
+
+  @return
+    The allocations counted against the subsystem so far
+*/
+MemStats::Counts MemStats::counts(Subsystem of) {
+    return Counts{allocations[of].load(std::memory_order_relaxed),
+                  allocatedBytes[of].load(std::memory_order_relaxed),
+                  frees[of].load(std::memory_order_relaxed)};
+}
+
+/*
+  MemStats::name(of)
+
+  @param of
+    A subsystem
+
+  @return
+    The name of the subsystem in reports
+*/
+const char *MemStats::name(Subsystem of) {
+    switch(of) {
+        case PARSING:
+            return "parsing";
+        case STORE:
+            return "store";
+        case FILTERING:
+            return "filtering";
+        case OUTPUT:
+            return "output";
+        default:
+            return "other";
+    }
+}
+
+/*
+  MemStats::footprint(areas)
+
+  Estimate the heap bytes taken up by an Areas store, from the sizes of the
+  containers' nodes and the capacities of the strings in them. The estimate
+  leaves out the allocator's own overhead for each block.
+
+  @param areas
+    The store
+
+  @return
+    The objects and estimated heap bytes of the areas (the Area objects and
+    their codes), their names, their measures (the Measure objects, codes
+    and labels) and the measures' values
+*/
+MemStats::Footprint MemStats::footprint(Areas const &areas) {
+    Footprint footprint;
+
+    for(auto const &area : areas.getAreas()) {
+        footprint.areas.objects++;
+        footprint.areas.bytes += TREE_NODE + sizeof(area)
+                                 + heapBytes(area.first)
+                                 + heapBytes(area.second.getLocalAuthorityCode());
+
+        auto const &names = area.second.getNamesList();
+        footprint.names.bytes += names.bucket_count() * sizeof(void *);
+        for(auto const &name : names) {
+            footprint.names.objects++;
+            footprint.names.bytes += HASH_NODE + sizeof(name)
+                                     + heapBytes(name.first)
+                                     + heapBytes(name.second);
+        }
+
+        for(auto const &measure : area.second.getMeasuresList()) {
+            footprint.measures.objects++;
+            footprint.measures.bytes += TREE_NODE + sizeof(measure)
+                                        + heapBytes(measure.first)
+                                        + heapBytes(measure.second.getCodename())
+                                        + heapBytes(measure.second.getLabel());
+
+            auto const &values = measure.second.getData();
+            footprint.values.objects += values.size();
+            footprint.values.bytes += values.size()
+                                      * (TREE_NODE + sizeof(std::pair<const int, MeasureDataType>));
+        }
+    }
+
+    return footprint;
+}
+
+/*
+  MemStats::peakResident()
+
+  @return
+    The peak resident set size of the process in bytes, or 0 where it is
+    not known
+*/
+std::uint64_t MemStats::peakResident() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/*
+  MemStats::report(os, json, areas)
+
+  Write the allocations counted against each subsystem so far, the estimated
+  footprint of a store, and the peak resident set size, as tables or as a
+  JSON object of the form {"subsystems":[{"subsystem":...,"allocations":...,
+  "bytes":...,"frees":...},...],"store":{"areas":{"objects":...,"bytes":...},
+  "names":...,"measures":...,"values":...,"total":...},
+  "peak_resident_bytes":...}.
+
+  @param os
+    The stream to write the report to
+
+  @param json
+    true to write JSON instead of tables
+
+  @param areas
+    The store to estimate the footprint of, or nullptr to leave it out
+*/
+void MemStats::report(std::ostream &os, bool json, Areas const *areas) {
+    //take the counts before the report allocates anything
+    Counts counted[NUM_SUBSYSTEMS];
+    Counts total{0, 0, 0};
+    for(int i = 0; i < NUM_SUBSYSTEMS; i++) {
+        counted[i] = counts(static_cast<Subsystem>(i));
+        total.allocations += counted[i].allocations;
+        total.bytes += counted[i].bytes;
+        total.frees += counted[i].frees;
+    }
+
+    Footprint store;
+    if(areas != nullptr) {
+        store = footprint(*areas);
+    }
+    Part storeTotal;
+    for(Part const *part : {&store.areas, &store.names, &store.measures, &store.values}) {
+        storeTotal.objects += part->objects;
+        storeTotal.bytes += part->bytes;
+    }
+
+    std::pair<const char *, Part const *> parts[] = {
+        {"areas", &store.areas},
+        {"names", &store.names},
+        {"measures", &store.measures},
+        {"values", &store.values},
+        {"total", &storeTotal}
+    };
+
+    if(json) {
+        nlohmann::json report;
+        report["subsystems"] = nlohmann::json::array();
+
+        for(int i = 0; i < NUM_SUBSYSTEMS; i++) {
+            report["subsystems"].push_back({
+                    {"subsystem", name(static_cast<Subsystem>(i))},
+                    {"allocations", counted[i].allocations},
+                    {"bytes", counted[i].bytes},
+                    {"frees", counted[i].frees}});
+        }
+
+        if(areas != nullptr) {
+            report["store"] = nlohmann::json::object();
+            for(auto const &part : parts) {
+                report["store"][part.first] = {{"objects", part.second->objects},
+                                               {"bytes", part.second->bytes}};
+            }
+        }
+
+        report["peak_resident_bytes"] = peakResident();
+        os << report.dump() << std::endl;
+        return;
+    }
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-16s %12s %16s %12s\n",
+                  "Subsystem", "Allocations", "Bytes", "Frees");
+    os << line;
+
+    auto writeCounts = [&](const char *subsystem, Counts const &counts) {
+        std::snprintf(line, sizeof(line), "%-16s %12llu %16llu %12llu\n",
+                      subsystem,
+                      static_cast<unsigned long long>(counts.allocations),
+                      static_cast<unsigned long long>(counts.bytes),
+                      static_cast<unsigned long long>(counts.frees));
+        os << line;
+    };
+
+    for(int i = 0; i < NUM_SUBSYSTEMS; i++) {
+        writeCounts(name(static_cast<Subsystem>(i)), counted[i]);
+    }
+    writeCounts("total", total);
+
+    if(areas != nullptr) {
+        std::snprintf(line, sizeof(line), "\n%-16s %12s %16s\n", "Store", "Objects", "Bytes (est.)");
+        os << line;
+
+        for(auto const &part : parts) {
+            std::snprintf(line, sizeof(line), "%-16s %12llu %16llu\n",
+                          part.first,
+                          static_cast<unsigned long long>(part.second->objects),
+                          static_cast<unsigned long long>(part.second->bytes));
+            os << line;
+        }
+    }
+
+    std::snprintf(line, sizeof(line), "\n%-16s %29llu\n", "Peak resident",
+                  static_cast<unsigned long long>(peakResident()));
+    os << line;
+    os.flush();
+}
@@ -0,0 +1,104 @@
+#ifndef MEMSTATS_H_
+#define MEMSTATS_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the MemStats class, which accounts for the memory a run
+  of Beth Yw? uses (--mem-stats).
+
+  memstats.cpp replaces the global operator new and operator delete. Whilst
+  MemStats is enabled, they count each allocation, its bytes, and each free
+  against the subsystem the allocating (or freeing) thread is working for:
+  reading and parsing the files, building the store of Areas, checking the
+  filters, or writing the output. A thread says which subsystem it works for
+  with a MemStats::Scope; the tasks of a ThreadPool work for the subsystem
+  of the thread that submitted them.
+
+  MemStats also estimates how much of the heap the final Areas store takes
+  up, broken down into the areas, their names, their measures and the
+  measures' values, and reports the peak resident set size of the process.
+
+  When MemStats is not enabled, each allocation costs one extra relaxed
+  atomic load.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+class Areas;
+
+class MemStats {
+public:
+    enum Subsystem {
+        OTHER,
+        PARSING,
+        STORE,
+        FILTERING,
+        OUTPUT,
+        NUM_SUBSYSTEMS
+    };
+
+    // the allocations counted against one subsystem
+    struct Counts {
+        std::uint64_t allocations;
+        std::uint64_t bytes;
+        std::uint64_t frees;
+    };
+
+    // the estimated heap use of one part of an Areas store
+    struct Part {
+        std::uint64_t objects = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    struct Footprint {
+        Part areas;
+        Part names;
+        Part measures;
+        Part values;
+    };
+
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+
+    static Subsystem current() { return subsystem; }
+
+    /*
+      Makes this thread work for `working` for as long as it exists.
+    */
+    class Scope {
+    public:
+        explicit Scope(Subsystem working) : previous(subsystem) { subsystem = working; }
+        ~Scope() { subsystem = previous; }
+
+        Scope(Scope const &) = delete;
+        Scope &operator=(Scope const &) = delete;
+
+    private:
+        Subsystem previous;
+    };
+
+    static void countAllocation(std::size_t bytes) noexcept;
+    static void countFree() noexcept;
+
+    static Counts counts(Subsystem of);
+    static const char *name(Subsystem of);
+
+    static Footprint footprint(Areas const &areas);
+    static std::uint64_t peakResident();
+
+    static void report(std::ostream &os, bool json, Areas const *areas);
+
+private:
+    static std::atomic<bool> on;
+    static thread_local Subsystem subsystem;
+};
+
+#endif // MEMSTATS_H_
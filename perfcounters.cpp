@@ -0,0 +1,193 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the PerfCounters class.
+ */
+
+#include <cerrno>
+#include <cstring>
+
+#include "perfcounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+  PerfCounters::Values::since(start)
+
+  @param start
+    The values read at the start of a phase, on the same thread
+
+  @return
+    The counts of the events since `start`, counted if they were counted
+    both then and now
+*/
+PerfCounters::Values PerfCounters::Values::since(Values const &start) const {
+    Values difference;
+    for(int i = 0; i < NUM_EVENTS; i++) {
+        difference.counted[i] = counted[i] && start.counted[i];
+        if(difference.counted[i] && counts[i] >= start.counts[i]) {
+            difference.counts[i] = counts[i] - start.counts[i];
+        }
+    }
+    return difference;
+}
+
+/*
+  PerfCounters::PerfCounters()
+
+  Open the counters of the calling thread, as one group so that they are
+  scheduled onto the CPU together. The first event that can be counted
+  leads the group.
+*/
+PerfCounters::PerfCounters() {
+    for(int i = 0; i < NUM_EVENTS; i++) {
+        fds[i] = -1;
+    }
+
+#ifdef __linux__
+    const std::uint64_t configs[NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for(int i = 0; i < NUM_EVENTS; i++) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP
+                           | PERF_FORMAT_TOTAL_TIME_ENABLED
+                           | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        //this thread, on any CPU
+        long fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+        if(fd < 0) {
+            if(leader < 0 && reason.empty()) {
+                reason = std::string("perf_event_open: ") + std::strerror(errno);
+            }
+            continue;
+        }
+
+        fds[i] = static_cast<int>(fd);
+        if(leader < 0) {
+            leader = fds[i];
+        }
+    }
+
+    if(leader >= 0) {
+        reason.clear();
+    }
+#else
+    reason = "hardware counters are only read on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for(int i = 0; i < NUM_EVENTS; i++) {
+        if(fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+#endif
+}
+
+/*
+  PerfCounters::thisThread()
+
+  @return
+    The counters of the calling thread, opened the first time it asks
+*/
+PerfCounters &PerfCounters::thisThread() {
+    static thread_local PerfCounters counters;
+    return counters;
+}
+
+/*
+  PerfCounters::name(event)
+
+  @param event
+    An event
+
+  @return
+    The name of the event in reports
+*/
+const char *PerfCounters::name(Event event) {
+    switch(event) {
+        case CYCLES:
+            return "cycles";
+        case INSTRUCTIONS:
+            return "instructions";
+        case CACHE_MISSES:
+            return "cache_misses";
+        case BRANCH_MISSES:
+            return "branch_misses";
+        default:
+            return "";
+    }
+}
+
+/*
+  PerfCounters::read()
+
+  Read the counts of the events on this thread so far. If the kernel had to
+  share the CPU's counters with other groups, the counts are scaled up from
+  the time they were counted for to the whole time.
+
+  @return
+    The counts, none of them counted if the counters are not available
+*/
+PerfCounters::Values PerfCounters::read() const {
+    Values values;
+
+#ifdef __linux__
+    if(leader < 0) {
+        return values;
+    }
+
+    //the number of events, the times enabled and running, then each count
+    std::uint64_t group[3 + NUM_EVENTS];
+    ssize_t bytes = ::read(leader, group, sizeof(group));
+    if(bytes < static_cast<ssize_t>(3 * sizeof(std::uint64_t))) {
+        return values;
+    }
+
+    std::uint64_t events = group[0];
+    std::uint64_t enabled = group[1];
+    std::uint64_t running = group[2];
+    double scale = running > 0 && running < enabled
+                   ? static_cast<double>(enabled) / static_cast<double>(running)
+                   : 1.0;
+
+    //the events are in the group in the order they were opened
+    std::uint64_t next = 0;
+    for(int i = 0; i < NUM_EVENTS && next < events; i++) {
+        if(fds[i] < 0) {
+            continue;
+        }
+
+        values.counts[i] = static_cast<std::uint64_t>(group[3 + next] * scale);
+        values.counted[i] = running > 0;
+        next++;
+    }
+#endif
+
+    return values;
+}
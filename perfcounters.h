@@ -0,0 +1,65 @@
+#ifndef PERFCOUNTERS_H_
+#define PERFCOUNTERS_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the PerfCounters class, which reads the CPU's hardware
+  performance counters for the calling thread (--counters): the cycles,
+  instructions, cache misses and branch misses it has taken, in user space.
+  The Profiler reads them at the start and end of each phase.
+
+  The counters are read through perf_event_open(2), so are only available
+  on Linux, and only where the kernel lets the user count their own threads
+  (see /proc/sys/kernel/perf_event_paranoid) and exposes the CPU's counters
+  (virtual machines often do not). Each thread opens its own counters the
+  first time it reads them; an event that cannot be counted is left out.
+ */
+
+#include <cstdint>
+#include <string>
+
+class PerfCounters {
+public:
+    enum Event {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        BRANCH_MISSES,
+        NUM_EVENTS
+    };
+
+    // the counts of the events, and whether each one was counted
+    struct Values {
+        std::uint64_t counts[NUM_EVENTS] = {};
+        bool counted[NUM_EVENTS] = {};
+
+        Values since(Values const &start) const;
+    };
+
+    ~PerfCounters();
+
+    PerfCounters(PerfCounters const &) = delete;
+    PerfCounters &operator=(PerfCounters const &) = delete;
+
+    static PerfCounters &thisThread();
+    static const char *name(Event event);
+
+    bool available() const { return leader >= 0; }
+    std::string const &unavailableReason() const { return reason; }
+
+    Values read() const;
+
+private:
+    PerfCounters();
+
+    int leader = -1;
+    int fds[NUM_EVENTS];
+    std::string reason;
+};
+
+#endif // PERFCOUNTERS_H_
@@ -0,0 +1,110 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the BoundedQueue class template, which is used to hand
+  work between the stages of the dataset loading pipeline (see
+  BethYw::loadDatasets() in bethyw.cpp). Each stage runs on its own thread,
+  and the queue between two stages blocks the producer once it holds
+  `capacity` items, so a stage can never get more than `capacity` items
+  ahead of the next. (The I/O stage also holds the rest of the batch it is
+  reading, which is bounded separately; see READ_BATCH_BYTES in bethyw.h.)
+
+  As this is a template, the implementation lives in this header.
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/*
+  A first-in first-out queue with a fixed capacity that can be shared between
+  one or more producer and consumer threads.
+
+  Once close() is called, push() refuses any new items and pop() drains the
+  remaining items before reporting that the queue is finished. Closing is also
+  how a consumer tells a producer to stop early (e.g. after an error).
+*/
+template <typename T>
+class BoundedQueue {
+private:
+    std::deque<T> items;
+    std::size_t capacity;
+    bool closed = false;
+
+    std::mutex lock;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+    BoundedQueue(BoundedQueue const &) = delete;
+    BoundedQueue &operator=(BoundedQueue const &) = delete;
+
+    /*
+      Add an item to the back of the queue, waiting while the queue is full.
+
+      @param item
+        The item to move into the queue
+
+      @return
+        true if the item was queued, false if the queue has been closed
+    */
+    bool push(T item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notFull.wait(guard, [this] { return closed || items.size() < capacity; });
+
+        if(closed) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /*
+      Remove the item at the front of the queue, waiting while the queue is
+      empty.
+
+      @param item
+        Receives the item removed from the queue
+
+      @return
+        true if an item was removed, false if the queue is closed and empty
+    */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait(guard, [this] { return closed || !items.empty(); });
+
+        if(items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /*
+      Stop accepting new items and wake up every thread waiting on the queue.
+    */
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+};
+
+#endif // PIPELINE_H_
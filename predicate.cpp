@@ -0,0 +1,652 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the Predicate class.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "areas.h"
+#include "Helper.h"
+#include "predicate.h"
+
+/*
+  Predicate::Predicate(expression)
+
+  Compile a condition on the values of a year of an area.
+
+  @param expression
+    The condition, e.g. "pop>100000 and dens<50"
+
+  @throws
+    std::invalid_argument if the expression is empty or not a valid
+    condition
+*/
+Predicate::Predicate(std::string const &expression) {
+    tokenise(expression);
+    if(tokens.empty()) {
+        throw std::invalid_argument("Predicate::Predicate: Empty condition");
+    }
+
+    compileOr();
+    if(position < tokens.size()) {
+        throw std::invalid_argument("Predicate::Predicate: Unexpected '" + tokens[position]
+                                    + "' in condition: " + expression);
+    }
+
+    for(std::string const &token : tokens) {
+        text += (text.empty() ? "" : " ") + token;
+    }
+
+    //only needed while compiling
+    tokens.clear();
+    tokens.shrink_to_fit();
+}
+
+/*
+  The condition in a canonical form, its tokens separated by single spaces
+  (e.g. "pop > 100000 and dens < 50"), which conditions that differ only in
+  spacing or case share.
+*/
+std::string const &Predicate::describe() const {
+    return text;
+}
+
+/*
+  The codes of the measures the condition compares.
+*/
+std::vector<std::string> const &Predicate::getMeasures() const {
+    return measures;
+}
+
+/*
+  Predicate::importFilter(measuresFilter)
+
+  The measures to import for a query with this condition: those of the
+  query's measure filter, and those the condition compares, which have to
+  be imported for it to be evaluated whether or not they are output.
+
+  @param measuresFilter
+    The measure filter of the query, or empty for all measures
+
+  @return
+    The measure filter to import with, which filter() then narrows back to
+    `measuresFilter`
+*/
+StringFilterSet Predicate::importFilter(StringFilterSet const &measuresFilter) const {
+    StringFilterSet imported = measuresFilter;
+    if(!imported.empty()) {
+        imported.insert(measures.begin(), measures.end());
+    }
+    return imported;
+}
+
+/*
+  Split an expression into numbers, measure codes (in lower case), keywords
+  (in lower case), operators and parentheses.
+*/
+void Predicate::tokenise(std::string const &expression) {
+    static const char *const OPERATORS[] = {"<=", ">=", "==", "!=", "<>", "&&", "||",
+                                            "<", ">", "=", "!", "(", ")"};
+
+    std::size_t i = 0;
+    while(i < expression.size()) {
+        unsigned char c = static_cast<unsigned char>(expression[i]);
+        if(std::isspace(c)) {
+            i++;
+            continue;
+        }
+
+        if(std::isalpha(c) || c == '_') {
+            std::size_t start = i;
+            while(i < expression.size()
+                  && (std::isalnum(static_cast<unsigned char>(expression[i]))
+                      || std::strchr("_-.", expression[i]) != nullptr)) {
+                i++;
+            }
+            tokens.push_back(lowerString(expression.substr(start, i - start)));
+            continue;
+        }
+
+        if(std::isdigit(c) || c == '.' || c == '-' || c == '+') {
+            const char *start = expression.c_str() + i;
+            char *end = nullptr;
+            std::strtod(start, &end);
+            if(end == start) {
+                throw std::invalid_argument("Predicate::Predicate: Invalid number in condition: "
+                                            + expression);
+            }
+            tokens.emplace_back(start, static_cast<std::size_t>(end - start));
+            i += static_cast<std::size_t>(end - start);
+            continue;
+        }
+
+        bool matched = false;
+        for(const char *op : OPERATORS) {
+            std::size_t length = std::strlen(op);
+            if(expression.compare(i, length, op) == 0) {
+                tokens.emplace_back(op);
+                i += length;
+                matched = true;
+                break;
+            }
+        }
+
+        if(!matched) {
+            throw std::invalid_argument(std::string("Predicate::Predicate: Unexpected '")
+                                        + expression[i] + "' in condition: " + expression);
+        }
+    }
+}
+
+/*
+  Move past the next token if it is one of the alternatives.
+*/
+bool Predicate::accept(std::initializer_list<const char *> alternatives) {
+    if(position >= tokens.size()) {
+        return false;
+    }
+
+    for(const char *alternative : alternatives) {
+        if(tokens[position] == alternative) {
+            position++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+  Compile a condition of one or more conditions joined by or.
+*/
+void Predicate::compileOr() {
+    compileAnd();
+    while(accept({"or", "||"})) {
+        std::size_t jump = program.size();
+        program.push_back({OR, EQUAL, 0, 0, 0, 0});
+        compileAnd();
+        program[jump].jump = program.size();
+    }
+}
+
+/*
+  Compile a condition of one or more conditions joined by and.
+*/
+void Predicate::compileAnd() {
+    compileNot();
+    while(accept({"and", "&&"})) {
+        std::size_t jump = program.size();
+        program.push_back({AND, EQUAL, 0, 0, 0, 0});
+        compileNot();
+        program[jump].jump = program.size();
+    }
+}
+
+/*
+  Compile a condition that may be negated with not.
+*/
+void Predicate::compileNot() {
+    if(accept({"not", "!"})) {
+        compileNot();
+        program.push_back({NOT, EQUAL, 0, 0, 0, 0});
+    } else {
+        compileComparison();
+    }
+}
+
+/*
+  Compile a comparison, or a condition in parentheses.
+*/
+void Predicate::compileComparison() {
+    if(accept({"("})) {
+        compileOr();
+        if(!accept({")"})) {
+            throw std::invalid_argument("Predicate::Predicate: Missing ')' in condition");
+        }
+        return;
+    }
+
+    if(position + 3 > tokens.size()) {
+        throw std::invalid_argument("Predicate::Predicate: Incomplete comparison in condition");
+    }
+
+    std::string const &left = tokens[position];
+    std::string const &op = tokens[position + 1];
+    std::string const &right = tokens[position + 2];
+
+    //a comparison with the operands swapped, so that a number is on the
+    //right
+    Comparison comparison, swapped;
+    if(op == "<") {
+        comparison = LESS;
+        swapped = GREATER;
+    } else if(op == "<=") {
+        comparison = LESS_EQUAL;
+        swapped = GREATER_EQUAL;
+    } else if(op == ">") {
+        comparison = GREATER;
+        swapped = LESS;
+    } else if(op == ">=") {
+        comparison = GREATER_EQUAL;
+        swapped = LESS_EQUAL;
+    } else if(op == "=" || op == "==") {
+        comparison = swapped = EQUAL;
+    } else if(op == "!=" || op == "<>") {
+        comparison = swapped = NOT_EQUAL;
+    } else {
+        throw std::invalid_argument("Predicate::Predicate: Expected a comparison operator, not '"
+                                    + op + "'");
+    }
+
+    auto isMeasure = [](std::string const &token) {
+        unsigned char c = static_cast<unsigned char>(token[0]);
+        return std::isalpha(c) || c == '_';
+    };
+    auto isNumber = [](std::string const &token) {
+        unsigned char c = static_cast<unsigned char>(token[0]);
+        return std::isdigit(c) || c == '.' || c == '-' || c == '+';
+    };
+
+    for(std::string const *operand : {&left, &right}) {
+        if(!isMeasure(*operand) && !isNumber(*operand)) {
+            throw std::invalid_argument("Predicate::Predicate: Expected a measure or a number, not '"
+                                        + *operand + "'");
+        }
+    }
+
+    if(isMeasure(left) && isMeasure(right)) {
+        program.push_back({COMPARE_MEASURES, comparison, slot(left), slot(right), 0, 0});
+    } else if(isMeasure(left)) {
+        program.push_back({COMPARE_CONSTANT, comparison, slot(left), 0,
+                           std::strtod(right.c_str(), nullptr), 0});
+    } else if(isMeasure(right)) {
+        program.push_back({COMPARE_CONSTANT, swapped, slot(right), 0,
+                           std::strtod(left.c_str(), nullptr), 0});
+    } else {
+        throw std::invalid_argument("Predicate::Predicate: Comparison of two numbers: "
+                                    + left + " " + op + " " + right);
+    }
+
+    position += 3;
+}
+
+/*
+  The slot of the values of a measure, given one when it is first compared.
+*/
+std::size_t Predicate::slot(std::string const &code) {
+    auto existing = slots.find(code);
+    if(existing != slots.end()) {
+        return existing->second;
+    }
+
+    slots.emplace(code, measures.size());
+    measures.push_back(code);
+    return measures.size() - 1;
+}
+
+bool Predicate::compare(Comparison comparison, MeasureDataType a, MeasureDataType b) {
+    switch(comparison) {
+        case LESS:
+            return a < b;
+        case LESS_EQUAL:
+            return a <= b;
+        case GREATER:
+            return a > b;
+        case GREATER_EQUAL:
+            return a >= b;
+        case EQUAL:
+            return a == b;
+        default:
+            return a != b;
+    }
+}
+
+/*
+  Run the program over the values of the measures in a year.
+
+  @param values
+    The value of each slot in the year
+
+  @param stack
+    The stack to evaluate the program on, reused between calls
+
+  @return
+    Whether the condition holds in the year
+*/
+bool Predicate::evaluate(std::vector<Slot> const &values, std::vector<char> &stack) const {
+    stack.clear();
+
+    std::size_t pc = 0;
+    while(pc < program.size()) {
+        Instruction const &instruction = program[pc];
+        switch(instruction.operation) {
+            case COMPARE_CONSTANT: {
+                Slot const &left = values[instruction.left];
+                stack.push_back(left.present
+                                && compare(instruction.comparison, left.value, instruction.constant));
+                break;
+            }
+            case COMPARE_MEASURES: {
+                Slot const &left = values[instruction.left];
+                Slot const &right = values[instruction.right];
+                stack.push_back(left.present && right.present
+                                && compare(instruction.comparison, left.value, right.value));
+                break;
+            }
+            case NOT:
+                stack.back() = !stack.back();
+                break;
+            case AND:
+            case OR:
+                //the left-hand side decides the result
+                if(static_cast<bool>(stack.back()) == (instruction.operation == OR)) {
+                    pc = instruction.jump;
+                    continue;
+                }
+                stack.pop_back();
+                break;
+        }
+        pc++;
+    }
+
+    return stack.back();
+}
+
+/*
+  Predicate::filter(areas, measuresFilter)
+
+  Keep only the years of each area in which the condition holds. The values
+  of an area's other years are dropped, as are the measures and areas left
+  without any values. The measures that were only imported to evaluate the
+  condition (see importFilter()) are dropped as well.
+
+  @param areas
+    The Areas to filter, imported with importFilter(measuresFilter)
+
+  @param measuresFilter
+    The measure filter of the query, or empty for all measures
+
+  @return
+    The values of `areas` in the years that pass
+*/
+Areas Predicate::filter(Areas const &areas, StringFilterSet const &measuresFilter) const {
+    Areas filtered;
+
+    std::vector<std::map<int, MeasureDataType> const *> compared(measures.size());
+    std::vector<Slot> values(measures.size());
+    std::vector<char> stack;
+    std::vector<int> years;
+    std::vector<int> kept;
+
+    for(auto const &area : areas.getAreas()) {
+        auto const &areaMeasures = area.second.getMeasuresList();
+
+        //whether every measure of the area is output
+        bool allShown = true;
+        if(!measuresFilter.empty()) {
+            for(auto const &measure : areaMeasures) {
+                allShown = allShown
+                           && filterCheck(&measuresFilter, measure.first, measure.second.getLabel());
+            }
+        }
+
+        for(std::size_t i = 0; i < measures.size(); i++) {
+            auto measure = areaMeasures.find(measures[i]);
+            compared[i] = measure == areaMeasures.end() ? nullptr : &measure->second.getData();
+        }
+
+        //the years the area has any values in
+        years.clear();
+        for(auto const &measure : areaMeasures) {
+            for(auto const &element : measure.second.getData()) {
+                years.push_back(element.first);
+            }
+        }
+        std::sort(years.begin(), years.end());
+        years.erase(std::unique(years.begin(), years.end()), years.end());
+
+        kept.clear();
+        for(int year : years) {
+            for(std::size_t i = 0; i < measures.size(); i++) {
+                values[i].present = false;
+                if(compared[i] != nullptr) {
+                    auto value = compared[i]->find(year);
+                    if(value != compared[i]->end()) {
+                        values[i].present = true;
+                        values[i].value = value->second;
+                    }
+                }
+            }
+
+            if(evaluate(values, stack)) {
+                kept.push_back(year);
+            }
+        }
+
+        if(kept.empty()) {
+            continue;
+        }
+
+        if(kept.size() == years.size() && allShown) {
+            filtered.setArea(area.first, area.second);
+            continue;
+        }
+
+        Area result(area.first);
+        for(auto const &name : area.second.getNamesList()) {
+            result.setName(name.first, name.second);
+        }
+
+        bool hasMeasures = false;
+        for(auto const &measure : areaMeasures) {
+            if(!allShown && !filterCheck(&measuresFilter, measure.first, measure.second.getLabel())) {
+                continue;
+            }
+
+            Measure passed(measure.second.getCodename(), measure.second.getLabel());
+            auto const &data = measure.second.getData();
+            for(int year : kept) {
+                auto value = data.find(year);
+                if(value != data.end()) {
+                    passed.setValue(year, value->second);
+                }
+            }
+
+            if(passed.size() > 0) {
+                result.setMeasure(measure.first, passed);
+                hasMeasures = true;
+            }
+        }
+
+        if(hasMeasures) {
+            filtered.setArea(area.first, result);
+        }
+    }
+
+    return filtered;
+}
+
+/*
+  The value of a Measure of a snapshot view in a year, if it has one.
+*/
+static bool valueIn(std::vector<std::pair<int, MeasureDataType>> const &data,
+                    int year,
+                    MeasureDataType &out) {
+    auto element = std::lower_bound(data.begin(), data.end(), year,
+                                    [](std::pair<int, MeasureDataType> const &value, int year) {
+                                        return value.first < year;
+                                    });
+    if(element == data.end() || element->first != year) {
+        return false;
+    }
+    out = element->second;
+    return true;
+}
+
+/*
+  Predicate::filter(area, measuresFilter, passed)
+
+  Keep only the years of an area of a snapshot in which the condition
+  holds, as filter(areas, measuresFilter) does for each Area.
+
+  @param area
+    The area, merged with Snapshot::forEachArea() from a query prepared
+    with importFilter(measuresFilter), with its values
+
+  @param measuresFilter
+    The measure filter of the query, or empty for all measures
+
+  @param passed
+    Set to the area with the values of the years that pass, if any do
+
+  @return
+    true if the area has any values left, false if it is dropped
+*/
+bool Predicate::filter(SnapshotAreaView const &area,
+                       StringFilterSet const &measuresFilter,
+                       SnapshotAreaView &passed) const {
+    //whether every measure of the area is output
+    bool allShown = true;
+    if(!measuresFilter.empty()) {
+        for(auto const &measure : area.measures) {
+            allShown = allShown && filterCheck(&measuresFilter, measure.code, measure.label);
+        }
+    }
+
+    std::vector<std::vector<std::pair<int, MeasureDataType>> const *> compared(measures.size());
+    for(std::size_t i = 0; i < measures.size(); i++) {
+        auto measure = std::lower_bound(area.measures.begin(), area.measures.end(), measures[i],
+                                        [](SnapshotMeasureView const &view, std::string const &code) {
+                                            return view.code < code;
+                                        });
+        compared[i] = measure == area.measures.end() || measure->code != measures[i] ? nullptr
+                                                                                      : &measure->data;
+    }
+
+    //the years the area has any values in
+    std::vector<int> years;
+    for(auto const &measure : area.measures) {
+        for(auto const &element : measure.data) {
+            years.push_back(element.first);
+        }
+    }
+    std::sort(years.begin(), years.end());
+    years.erase(std::unique(years.begin(), years.end()), years.end());
+
+    std::vector<Slot> values(measures.size());
+    std::vector<char> stack;
+    std::vector<int> kept;
+    for(int year : years) {
+        for(std::size_t i = 0; i < measures.size(); i++) {
+            values[i].present = compared[i] != nullptr && valueIn(*compared[i], year, values[i].value);
+        }
+
+        if(evaluate(values, stack)) {
+            kept.push_back(year);
+        }
+    }
+
+    if(kept.empty()) {
+        return false;
+    }
+
+    if(kept.size() == years.size() && allShown) {
+        passed = area;
+        return true;
+    }
+
+    passed.code = area.code;
+    passed.names = area.names;
+    passed.measures.clear();
+    for(auto const &measure : area.measures) {
+        if(!allShown && !filterCheck(&measuresFilter, measure.code, measure.label)) {
+            continue;
+        }
+
+        SnapshotMeasureView result{measure.code, measure.label, {}, RangeStats()};
+        auto value = measure.data.begin();
+        for(int year : kept) {
+            while(value != measure.data.end() && value->first < year) {
+                ++value;
+            }
+            if(value != measure.data.end() && value->first == year) {
+                result.data.push_back(*value);
+            }
+        }
+
+        if(scanRangeStats(result.data.begin(), result.data.end(), result.stats)) {
+            passed.measures.push_back(std::move(result));
+        }
+    }
+
+    return !passed.measures.empty();
+}
+
+/*
+  Predicate::filter(snapshot, datasets, query, measuresFilter)
+
+  Load the values of the years in which the condition holds straight from
+  a snapshot, evaluating it on each area as it is merged from the datasets
+  rather than on an Areas object loaded with all of them. The result is
+  that of loading the query and then filtering it with
+  filter(areas, measuresFilter).
+
+  @param snapshot
+    The snapshot to load from
+
+  @param datasets
+    The datasets to load, in the order they are merged
+
+  @param query
+    The filters of the query, prepared for `snapshot` with
+    importFilter(measuresFilter) as its measure filter
+
+  @param measuresFilter
+    The measure filter of the query, or empty for all measures
+
+  @return
+    The values of the areas in the years that pass
+
+  @throws
+    std::runtime_error if a dataset is not in the snapshot
+*/
+Areas Predicate::filter(Snapshot const &snapshot,
+                        std::vector<BethYw::InputFileSource> const &datasets,
+                        SnapshotQuery const &query,
+                        StringFilterSet const &measuresFilter) const {
+    Areas filtered;
+    SnapshotAreaView passed;
+    snapshot.forEachArea(datasets, query, true, [&](SnapshotAreaView const &area) {
+        if(!filter(area, measuresFilter, passed)) {
+            return;
+        }
+
+        Area result(passed.code);
+        for(auto const &name : passed.names) {
+            result.setName(name.first, name.second);
+        }
+        for(auto const &measure : passed.measures) {
+            Measure values(measure.code, measure.label);
+            for(auto const &element : measure.data) {
+                values.setValue(element.first, element.second);
+            }
+            result.setMeasure(measure.code, values);
+        }
+        filtered.setArea(passed.code, result);
+    });
+
+    return filtered;
+}
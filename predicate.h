@@ -0,0 +1,121 @@
+#ifndef PREDICATE_H_
+#define PREDICATE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the Predicate class, which filters the values of Areas
+  by a condition on them (--where): e.g. pop>100000 and dens<50 keeps the
+  years in which an area had more than 100000 people and fewer than 50 per
+  square kilometre, and drops the rest.
+
+  A condition is evaluated for each year of each area, comparing the values
+  of the area's measures in that year with numbers or with each other. It
+  is made of comparisons (<, <=, >, >=, = or ==, != or <>) of a measure code
+  with a number or another measure code, combined with and (&&), or (||),
+  not (!) and parentheses. A comparison with a measure that has no value in
+  the year is false. The measures compared are imported even if --measures
+  leaves them out, and dropped again once the condition has been evaluated.
+
+  A condition is compiled once into a flat program of instructions, in the
+  order they are evaluated: each comparison is typed by what it compares
+  (a measure with a number, or two measures), and each and/or jumps over its
+  right-hand side when the left-hand side decides the result.
+
+  On the command line the condition filters the Areas once they are loaded,
+  as comparisons can span datasets that are parsed separately. In server
+  and batch mode it is evaluated on each area as the datasets are merged
+  from the snapshot (see Snapshot::forEachArea()), so the years it drops
+  are never put in an Areas object, and aggregates and top areas are worked
+  out without one.
+ */
+
+#include <cstddef>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "areas.h"
+#include "datasets.h"
+#include "measure.h"
+#include "snapshot.h"
+
+class Predicate {
+public:
+    explicit Predicate(std::string const &expression);
+
+    std::string const &describe() const;
+    std::vector<std::string> const &getMeasures() const;
+
+    StringFilterSet importFilter(StringFilterSet const &measuresFilter) const;
+    Areas filter(Areas const &areas, StringFilterSet const &measuresFilter) const;
+    Areas filter(Snapshot const &snapshot,
+                 std::vector<BethYw::InputFileSource> const &datasets,
+                 SnapshotQuery const &query,
+                 StringFilterSet const &measuresFilter) const;
+    bool filter(SnapshotAreaView const &area,
+                StringFilterSet const &measuresFilter,
+                SnapshotAreaView &passed) const;
+
+private:
+    enum Comparison { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, EQUAL, NOT_EQUAL };
+
+    enum Operation {
+        // push whether the measure `left` compares with `constant`
+        COMPARE_CONSTANT,
+        // push whether the measure `left` compares with the measure `right`
+        COMPARE_MEASURES,
+        // negate the top of the stack
+        NOT,
+        // if the top of the stack is false (AND) or true (OR), jump to `jump`
+        // leaving it as the result, otherwise pop it
+        AND,
+        OR
+    };
+
+    struct Instruction {
+        Operation operation;
+        Comparison comparison;
+        std::size_t left;
+        std::size_t right;
+        MeasureDataType constant;
+        std::size_t jump;
+    };
+
+    // a value of a measure in the year evaluated, if it has one
+    struct Slot {
+        bool present;
+        MeasureDataType value;
+    };
+
+    // the tokens of the expression being compiled
+    std::vector<std::string> tokens;
+    std::size_t position = 0;
+
+    // the tokens separated by spaces, e.g. "pop > 100000 and dens < 50"
+    std::string text;
+
+    // the measure codes the program compares, by slot
+    std::vector<std::string> measures;
+    std::map<std::string, std::size_t> slots;
+
+    std::vector<Instruction> program;
+
+    void tokenise(std::string const &expression);
+    bool accept(std::initializer_list<const char *> alternatives);
+    void compileOr();
+    void compileAnd();
+    void compileNot();
+    void compileComparison();
+    std::size_t slot(std::string const &code);
+
+    bool evaluate(std::vector<Slot> const &values, std::vector<char> &stack) const;
+    static bool compare(Comparison comparison, MeasureDataType a, MeasureDataType b);
+};
+
+#endif // PREDICATE_H_
@@ -0,0 +1,231 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the Profiler class.
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <utility>
+
+#include "lib_json.hpp"
+
+#include "profile.h"
+
+Profiler *Profiler::current = nullptr;
+
+/*
+  Whether the instructions per cycle of a phase are known.
+*/
+static bool instructionsPerCycle(PerfCounters::Values const &counters) {
+    return counters.counted[PerfCounters::CYCLES]
+           && counters.counted[PerfCounters::INSTRUCTIONS]
+           && counters.counts[PerfCounters::CYCLES] > 0;
+}
+thread_local Profiler::RowCounts *Profiler::rowCounts = nullptr;
+
+/*
+  The seconds elapsed since `start` on the monotonic clock.
+*/
+double Profiler::since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*
+  Profiler::start()
+
+  Mark the start of a phase on this thread.
+
+  @return
+    The time, and this thread's hardware counters if the active Profiler is
+    counting them
+*/
+Profiler::Mark Profiler::start() {
+    Mark mark;
+    Profiler *profiler = current;
+    if(profiler != nullptr && profiler->hardware) {
+        mark.counters = PerfCounters::thisThread().read();
+    }
+    mark.time = Clock::now();
+    return mark;
+}
+
+/*
+  Profiler::countHardware()
+
+  Count the hardware events of each phase recorded with a Mark from now on,
+  if this thread's hardware counters can be read.
+
+  @return
+    true if they can, false (having said why on the standard error) if the
+    phases will only be timed
+*/
+bool Profiler::countHardware() {
+    PerfCounters &counters = PerfCounters::thisThread();
+    if(!counters.available()) {
+        std::cerr << "Hardware counters are not available ("
+                  << counters.unavailableReason() << ")" << std::endl;
+        return false;
+    }
+
+    hardware = true;
+    return true;
+}
+
+/*
+  Profiler::record(phase)
+
+  Keep the measurements of a phase. Phases may be recorded from any thread,
+  and are reported in the order they were recorded.
+
+  @param phase
+    The phase's name, dataset (or empty), duration, bytes and rows
+*/
+void Profiler::record(Phase phase) {
+    std::lock_guard<std::mutex> guard(lock);
+    phases.push_back(std::move(phase));
+}
+
+/*
+  Profiler::record(phase, started)
+
+  Keep the measurements of a phase that started at `started` and ends now,
+  on the thread it started on.
+
+  @param phase
+    The phase's name, dataset (or empty), bytes and rows
+
+  @param started
+    The Mark taken at the start of the phase
+*/
+void Profiler::record(Phase phase, Mark const &started) {
+    phase.seconds = since(started.time);
+    if(hardware) {
+        phase.counters = PerfCounters::thisThread().read().since(started.counters);
+    }
+    record(std::move(phase));
+}
+
+/*
+  Profiler::report(os, json)
+
+  Write every phase recorded so far, with its rows and megabytes (10^6
+  bytes) per second, as a table or as a JSON object of the form
+  {"phases":[{"phase":...,"dataset":...,"seconds":...,"bytes":...,
+  "accepted":...,"rejected":...,"rows_per_second":...,
+  "mb_per_second":...},...]}. If the hardware counters were counted, each
+  phase also has the cycles, instructions, instructions per cycle, cache
+  misses and branch misses of the thread that ran it (or null, for an
+  event that could not be counted).
+
+  @param os
+    The stream to write the report to
+
+  @param json
+    true to write JSON instead of a table
+*/
+void Profiler::report(std::ostream &os, bool json) const {
+    std::lock_guard<std::mutex> guard(lock);
+
+    auto rate = [](double amount, double seconds) {
+        return seconds > 0 ? amount / seconds : 0.0;
+    };
+
+    if(json) {
+        nlohmann::json report;
+        report["phases"] = nlohmann::json::array();
+
+        for(auto const &phase : phases) {
+            double rows = static_cast<double>(phase.accepted + phase.rejected);
+            report["phases"].push_back({
+                    {"phase", phase.name},
+                    {"dataset", phase.dataset},
+                    {"seconds", phase.seconds},
+                    {"bytes", phase.bytes},
+                    {"accepted", phase.accepted},
+                    {"rejected", phase.rejected},
+                    {"rows_per_second", rate(rows, phase.seconds)},
+                    {"mb_per_second", rate(phase.bytes / 1e6, phase.seconds)}});
+
+            if(hardware) {
+                nlohmann::json &counted = report["phases"].back();
+                for(int i = 0; i < PerfCounters::NUM_EVENTS; i++) {
+                    auto event = static_cast<PerfCounters::Event>(i);
+                    counted[PerfCounters::name(event)] = phase.counters.counted[i]
+                            ? nlohmann::json(phase.counters.counts[i])
+                            : nlohmann::json(nullptr);
+                }
+                counted["instructions_per_cycle"] = instructionsPerCycle(phase.counters)
+                        ? nlohmann::json(rate(phase.counters.counts[PerfCounters::INSTRUCTIONS],
+                                              phase.counters.counts[PerfCounters::CYCLES]))
+                        : nlohmann::json(nullptr);
+            }
+        }
+
+        os << report.dump() << std::endl;
+        return;
+    }
+
+    char line[256];
+    //the dataset goes last, as a batch of files read together can be long
+    std::snprintf(line, sizeof(line), "%-16s %10s %12s %10s %10s %12s %9s  ",
+                  "Phase", "Seconds", "Bytes", "Accepted", "Rejected", "Rows/s",
+                  "MB/s");
+    os << line;
+    if(hardware) {
+        std::snprintf(line, sizeof(line), "%14s %14s %6s %12s %13s  ",
+                      "Cycles", "Instructions", "IPC", "Cache misses", "Branch misses");
+        os << line;
+    }
+    os << "Dataset\n";
+
+    for(auto const &phase : phases) {
+        double rows = static_cast<double>(phase.accepted + phase.rejected);
+        std::snprintf(line, sizeof(line), "%-16s %10.6f %12llu %10llu %10llu %12.0f %9.2f  ",
+                      phase.name.c_str(),
+                      phase.seconds,
+                      static_cast<unsigned long long>(phase.bytes),
+                      static_cast<unsigned long long>(phase.accepted),
+                      static_cast<unsigned long long>(phase.rejected),
+                      rate(rows, phase.seconds),
+                      rate(phase.bytes / 1e6, phase.seconds));
+        os << line;
+
+        if(hardware) {
+            auto count = [&](PerfCounters::Event event, int width) {
+                if(phase.counters.counted[event]) {
+                    std::snprintf(line, sizeof(line), "%*llu ", width,
+                                  static_cast<unsigned long long>(phase.counters.counts[event]));
+                } else {
+                    std::snprintf(line, sizeof(line), "%*s ", width, "-");
+                }
+                os << line;
+            };
+
+            count(PerfCounters::CYCLES, 14);
+            count(PerfCounters::INSTRUCTIONS, 14);
+            if(instructionsPerCycle(phase.counters)) {
+                std::snprintf(line, sizeof(line), "%6.2f ",
+                              rate(phase.counters.counts[PerfCounters::INSTRUCTIONS],
+                                   phase.counters.counts[PerfCounters::CYCLES]));
+            } else {
+                std::snprintf(line, sizeof(line), "%6s ", "-");
+            }
+            os << line;
+            count(PerfCounters::CACHE_MISSES, 12);
+            count(PerfCounters::BRANCH_MISSES, 13);
+            os << ' ';
+        }
+
+        os << phase.dataset << '\n';
+    }
+    os.flush();
+}
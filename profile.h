@@ -0,0 +1,113 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the Profiler class, which times the phases of a run of
+  Beth Yw? (--profile): parsing the arguments, loading the areas, opening,
+  parsing and merging each dataset, and writing the output. For each phase
+  it keeps the time taken, the bytes read or written, and the number of
+  rows (values) the filters accepted and rejected, and reports them on the
+  standard error when the run ends. With --counters, it also counts the
+  cycles, instructions, cache misses and branch misses of the thread that
+  ran each phase (see perfcounters.h); work a phase hands to other threads
+  is timed, but not counted.
+
+  Profiling is off unless a Profiler is made active, and costs nothing but a
+  null pointer check in each phase (and for each series or row parsed) when
+  it is off.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "perfcounters.h"
+
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // one timed phase of the run
+    struct Phase {
+        std::string name;
+        std::string dataset;
+        double seconds;
+        std::uint64_t bytes;
+        std::uint64_t accepted;
+        std::uint64_t rejected;
+        PerfCounters::Values counters = {};
+    };
+
+    // the time, and the counters of this thread, at the start of a phase
+    struct Mark {
+        Clock::time_point time;
+        PerfCounters::Values counters;
+    };
+
+    // the rows the parser on one thread has accepted and rejected
+    struct RowCounts {
+        std::uint64_t accepted = 0;
+        std::uint64_t rejected = 0;
+    };
+
+    static Profiler *active() { return current; }
+    static void setActive(Profiler *profiler) { current = profiler; }
+
+    /*
+      Count rows accepted or rejected by the filters whilst parsing, if
+      this thread is counting them (see rowCounts).
+    */
+    static void countRows(bool accepted, std::uint64_t rows = 1) {
+        RowCounts *counts = rowCounts;
+        if(counts != nullptr) {
+            (accepted ? counts->accepted : counts->rejected) += rows;
+        }
+    }
+
+    // the counts of the dataset being parsed on this thread, or nullptr
+    static thread_local RowCounts *rowCounts;
+
+    /*
+      Counts the rows parsed on this thread into `counts` (or stops them
+      being counted, if it is nullptr) for as long as it exists.
+    */
+    class CountRows {
+    public:
+        explicit CountRows(RowCounts *counts) : previous(rowCounts) { rowCounts = counts; }
+        ~CountRows() { rowCounts = previous; }
+
+        CountRows(CountRows const &) = delete;
+        CountRows &operator=(CountRows const &) = delete;
+
+    private:
+        RowCounts *previous;
+    };
+
+    static double since(Clock::time_point start);
+    static Mark start();
+
+    bool countHardware();
+    bool countsHardware() const { return hardware; }
+
+    void record(Phase phase);
+    void record(Phase phase, Mark const &started);
+    void report(std::ostream &os, bool json) const;
+
+private:
+    static Profiler *current;
+
+    mutable std::mutex lock;
+    std::vector<Phase> phases;
+    bool hardware = false;
+};
+
+#endif // PROFILE_H_
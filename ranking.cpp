@@ -0,0 +1,430 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the Ranking class.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "areas.h"
+#include "jsonwriter.h"
+#include "predicate.h"
+#include "ranking.h"
+#include "snapshot.h"
+
+/*
+  Ranking::Ranking(count, statistic, year)
+
+  @param count
+    The number of areas to find for each measure
+
+  @param statistic
+    The statistic of each Measure to rank the areas by
+
+  @param year
+    The year whose value to rank the areas by, if the statistic is VALUE
+
+  @throws
+    std::invalid_argument if the count is 0
+*/
+Ranking::Ranking(std::size_t count, Statistic statistic, int year)
+    : count(count), statistic(statistic), year(year) {
+    if(count == 0) {
+        throw std::invalid_argument("Ranking::Ranking: Cannot rank the top 0 areas");
+    }
+}
+
+std::size_t Ranking::getCount() const {
+    return count;
+}
+
+Ranking::Statistic Ranking::getStatistic() const {
+    return statistic;
+}
+
+int Ranking::getYear() const {
+    return year;
+}
+
+/*
+  The statistic ranked by, as given to --by (e.g. "pct-diff" or
+  "value:2015").
+*/
+std::string Ranking::describe() const {
+    switch(statistic) {
+        case AVERAGE:
+            return "average";
+        case DIFFERENCE:
+            return "diff";
+        case PERCENTAGE_DIFFERENCE:
+            return "pct-diff";
+        default:
+            return "value:" + std::to_string(year);
+    }
+}
+
+/*
+  The value of a year in the values of a Measure, by year.
+*/
+static bool valueIn(std::map<int, MeasureDataType> const &data, int year, double &out) {
+    auto element = data.find(year);
+    if(element == data.end()) {
+        return false;
+    }
+    out = element->second;
+    return true;
+}
+
+static bool valueIn(std::vector<std::pair<int, MeasureDataType>> const &data, int year, double &out) {
+    auto element = std::lower_bound(data.begin(), data.end(), year,
+                                    [](std::pair<int, MeasureDataType> const &value, int year) {
+                                        return value.first < year;
+                                    });
+    if(element == data.end() || element->first != year) {
+        return false;
+    }
+    out = element->second;
+    return true;
+}
+
+/*
+  The value of the statistic for a Measure, if it has one: a Measure with
+  no values (or none in the year) has none, nor does one whose statistic is
+  not a number, e.g. a percentage difference from 0. The statistics are
+  those of the Measure's RangeStats, which are worked out as
+  Measure::getAverage(), getDifference() and getDifferenceAsPercentage()
+  work them out.
+*/
+template <typename MeasureOf>
+bool Ranking::value(MeasureOf const &measure, double &out) const {
+    if(statistic == VALUE) {
+        return valueIn(dataOf(measure), year, out) && std::isfinite(out);
+    }
+
+    RangeStats stats;
+    if(!statsOf(measure, stats)) {
+        return false;
+    }
+
+    switch(statistic) {
+        case AVERAGE:
+            out = stats.average;
+            break;
+        case DIFFERENCE:
+            out = stats.difference;
+            break;
+        default:
+            out = stats.differencePercentage;
+    }
+
+    return std::isfinite(out);
+}
+
+/*
+  Whether `a` ranks above `b`: it has the higher value, or the same value
+  and the lower area code (the areas being numbered in order of code).
+*/
+bool Ranking::better(Entry const &a, Entry const &b) {
+    if(a.value != b.value) {
+        return a.value > b.value;
+    }
+    return a.area < b.area;
+}
+
+/*
+  The code and names of an area, with the name to show for it: the English
+  name, or any other if it has none, or "Unnamed".
+*/
+static void describeArea(std::pair<const std::string, Area> const &area,
+                         std::string &code,
+                         std::string &name,
+                         std::vector<std::pair<std::string, std::string>> &names) {
+    auto const &areaNames = area.second.getNamesList();
+    auto english = areaNames.find("eng");
+
+    code = area.first;
+    name = english != areaNames.end() ? english->second
+         : areaNames.empty()          ? "Unnamed"
+                                      : areaNames.begin()->second;
+    names.assign(areaNames.begin(), areaNames.end());
+    std::sort(names.begin(), names.end());
+}
+
+static void describeArea(SnapshotAreaView const &area,
+                         std::string &code,
+                         std::string &name,
+                         std::vector<std::pair<std::string, std::string>> &names) {
+    auto english = std::find_if(area.names.begin(), area.names.end(),
+                                [](std::pair<std::string, std::string> const &areaName) {
+                                    return areaName.first == "eng";
+                                });
+
+    code = area.code;
+    name = english != area.names.end() ? english->second
+         : area.names.empty()          ? "Unnamed"
+                                       : area.names.front().second;
+    names = area.names;
+}
+
+/*
+  Ranking::rank(areas)
+
+  Find the top areas of each Measure in `areas`, replacing anything ranked
+  before.
+
+  @param areas
+    The Areas to rank
+*/
+void Ranking::rank(Areas const &areas) {
+    rankAll([&areas](auto &&visit) {
+        for(auto const &area : areas.getAreas()) {
+            visit(area);
+        }
+    });
+}
+
+/*
+  Ranking::rank(snapshot, datasets, query)
+
+  Find the top areas of each Measure that loading datasets from a snapshot
+  would give, straight from the snapshot (see Snapshot::forEachArea()),
+  replacing anything ranked before. Except for the value in a year, the
+  statistics come from the snapshot's indexes, for any window of years, so
+  an average can differ from that of rank(areas) in its last bits, and two
+  areas whose averages are equal but for rounding may swap places.
+
+  @param snapshot
+    The snapshot to rank the areas of
+
+  @param datasets
+    The datasets to rank the areas of, in the order they are merged
+
+  @param query
+    The filters of the query, prepared for `snapshot`
+
+  @throws
+    std::runtime_error if a dataset is not in the snapshot
+*/
+void Ranking::rank(Snapshot const &snapshot,
+                   std::vector<BethYw::InputFileSource> const &datasets,
+                   SnapshotQuery const &query) {
+    rankAll([&](auto &&visit) {
+        snapshot.forEachArea(datasets, query, statistic == VALUE, visit);
+    });
+}
+
+/*
+  Ranking::rank(snapshot, datasets, query, where, measuresFilter)
+
+  As above, for only the years that pass a condition, which is evaluated on
+  each area as it is merged from the snapshot (see Predicate::filter()).
+
+  @param where
+    The condition the years must pass
+
+  @param measuresFilter
+    The measure filter of the query; `query` must be prepared with
+    where.importFilter(measuresFilter)
+
+  @throws
+    std::runtime_error if a dataset is not in the snapshot
+*/
+void Ranking::rank(Snapshot const &snapshot,
+                   std::vector<BethYw::InputFileSource> const &datasets,
+                   SnapshotQuery const &query,
+                   Predicate const &where,
+                   StringFilterSet const &measuresFilter) {
+    SnapshotAreaView passed;
+    rankAll([&](auto &&visit) {
+        snapshot.forEachArea(datasets, query, true, [&](SnapshotAreaView const &area) {
+            if(where.filter(area, measuresFilter, passed)) {
+                visit(static_cast<const SnapshotAreaView &>(passed));
+            }
+        });
+    });
+}
+
+/*
+  Rank the areas that `forEachArea(visit)` visits, in order of code. Only
+  the areas with a value for some Measure are kept.
+*/
+template <typename ForEachArea>
+void Ranking::rankAll(ForEachArea const &forEachArea) {
+    winners.clear();
+    areas.clear();
+
+    forEachArea([this](auto const &area) {
+        bool kept = false;
+        for(auto const &measure : measuresOf(area)) {
+            Entry entry;
+            if(!value(measure, entry.value)) {
+                continue;
+            }
+
+            if(!kept) {
+                areas.emplace_back();
+                describeArea(area, areas.back().code, areas.back().name, areas.back().names);
+                kept = true;
+            }
+            entry.area = areas.size() - 1;
+
+            Winners &measureWinners = winners[codeOf(measure)];
+            std::vector<Entry> &heap = measureWinners.entries;
+            if(heap.empty()) {
+                measureWinners.label = labelOf(measure);
+                heap.reserve(count);
+            }
+
+            //the heap is ordered by better(), so its front is the worst of
+            //the best seen so far
+            if(heap.size() < count) {
+                heap.push_back(entry);
+                std::push_heap(heap.begin(), heap.end(), better);
+            } else if(better(entry, heap.front())) {
+                std::pop_heap(heap.begin(), heap.end(), better);
+                heap.back() = entry;
+                std::push_heap(heap.begin(), heap.end(), better);
+            }
+        }
+    });
+
+    for(auto &measureWinners : winners) {
+        std::sort_heap(measureWinners.second.entries.begin(),
+                       measureWinners.second.entries.end(),
+                       better);
+    }
+}
+
+/*
+  Ranking::writeTable(os)
+
+  Write the top areas of each measure as a table, headed by the label and
+  code of the measure, with a blank line between measures.
+
+  @param os
+    The stream to write to
+*/
+void Ranking::writeTable(std::ostream &os) const {
+    if(winners.empty()) {
+        os << "<No values>" << std::endl;
+        return;
+    }
+
+    std::string heading = describe();
+    heading[0] = static_cast<char>(heading[0] - 'a' + 'A');
+
+    char cell[64];
+    std::string line;
+    bool first = true;
+    for(auto const &measure : winners) {
+        std::size_t nameWidth = 4;
+        for(auto const &entry : measure.second.entries) {
+            nameWidth = std::max(nameWidth, areas[entry.area].name.size());
+        }
+
+        line.clear();
+        if(!first) {
+            line += '\n';
+        }
+        first = false;
+
+        line += measure.second.label + " (" + measure.first + ")\n";
+        std::snprintf(cell, sizeof(cell), "%4s  %-9s  ", "Rank", "Area");
+        line += cell;
+        line += "Name";
+        line.append(nameWidth - 4, ' ');
+        std::snprintf(cell, sizeof(cell), " %15s\n", heading.c_str());
+        line += cell;
+
+        std::size_t rank = 1;
+        for(auto const &entry : measure.second.entries) {
+            RankedArea const &area = areas[entry.area];
+            std::snprintf(cell, sizeof(cell), "%4zu  %-9s  ", rank++, area.code.c_str());
+            line += cell;
+            line += area.name;
+            line.append(nameWidth - area.name.size(), ' ');
+            std::snprintf(cell, sizeof(cell), " %15.6f\n", entry.value);
+            line += cell;
+        }
+
+        os << line;
+    }
+}
+
+/*
+  Ranking::writeJSON(os)
+
+  Write the top areas of each measure as a JSON array with an object for
+  each, in order of measure code and rank, e.g.
+  [{"area":"W06000015","label":"Population","measure":"pop",
+  "names":{"cym":"Caerdydd","eng":"Cardiff"},"pct-diff":12.3,"rank":1},...],
+  streamed as it is produced.
+
+  @param os
+    The stream to write to
+*/
+void Ranking::writeJSON(std::ostream &os) const {
+    enum Kind { MEASURE, LABEL, RANK, AREA, NAMES, STATISTIC };
+
+    //the fields of a row, in order of name as in all JSON output
+    std::vector<std::pair<std::string, Kind>> fields = {
+        {"measure", MEASURE}, {"label", LABEL}, {"rank", RANK},
+        {"area", AREA}, {"names", NAMES}, {describe(), STATISTIC}};
+    std::sort(fields.begin(), fields.end());
+
+    JsonWriter writer(os);
+    writer.beginArray();
+    for(auto const &measure : winners) {
+        std::uint64_t rank = 1;
+        for(auto const &entry : measure.second.entries) {
+            writer.beginObject();
+            for(auto const &field : fields) {
+                writer.key(field.first);
+                switch(field.second) {
+                    case MEASURE:
+                        writer.value(measure.first);
+                        break;
+                    case LABEL:
+                        writer.value(measure.second.label);
+                        break;
+                    case RANK:
+                        writer.value(rank);
+                        break;
+                    case AREA:
+                        writer.value(areas[entry.area].code);
+                        break;
+                    case NAMES: {
+                        writer.beginObject();
+                        for(auto const &name : areas[entry.area].names) {
+                            writer.key(name.first);
+                            writer.value(name.second);
+                        }
+                        writer.endObject();
+                        break;
+                    }
+                    default:
+                        writer.value(entry.value);
+                }
+            }
+            writer.endObject();
+            rank++;
+        }
+    }
+    writer.endArray();
+    writer.flush();
+
+    os << std::endl;
+}
@@ -0,0 +1,103 @@
+#ifndef RANKING_H_
+#define RANKING_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the Ranking class, which finds the areas with the
+  highest value of a statistic of each Measure (--top and --by): e.g. the
+  five areas whose population grew the most, with --top 5 --by pct-diff
+  -m pop.
+
+  The statistic is one of those of a Measure (its average, difference or
+  difference as a percentage, over the years imported) or its value in a
+  given year. Each measure is ranked on its own. The areas are selected in
+  one pass with a bounded heap per measure, which holds the best K seen so
+  far with the worst of them on top, so only the K winners are ever sorted.
+
+  In server and batch mode the areas are ranked straight from the snapshot
+  the data is kept in (see Snapshot::forEachArea()), rather than from an
+  Areas object loaded from it for each query.
+ */
+
+#include <cstddef>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "areas.h"
+#include "datasets.h"
+
+class Predicate;
+class Snapshot;
+struct SnapshotQuery;
+
+class Ranking {
+public:
+    enum Statistic { AVERAGE, DIFFERENCE, PERCENTAGE_DIFFERENCE, VALUE };
+
+    Ranking(std::size_t count, Statistic statistic, int year = 0);
+
+    std::size_t getCount() const;
+    Statistic getStatistic() const;
+    int getYear() const;
+    std::string describe() const;
+
+    void rank(Areas const &areas);
+    void rank(Snapshot const &snapshot,
+              std::vector<BethYw::InputFileSource> const &datasets,
+              SnapshotQuery const &query);
+    void rank(Snapshot const &snapshot,
+              std::vector<BethYw::InputFileSource> const &datasets,
+              SnapshotQuery const &query,
+              Predicate const &where,
+              StringFilterSet const &measuresFilter);
+
+    void writeTable(std::ostream &os) const;
+    void writeJSON(std::ostream &os) const;
+
+private:
+    // an area with a value of the statistic for any measure
+    struct RankedArea {
+        std::string code;
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> names;  // by language
+    };
+
+    // an area and its value of the statistic for one measure; the areas are
+    // numbered in the order they are ranked, which is in order of code
+    struct Entry {
+        double value;
+        std::size_t area;
+    };
+
+    // the areas of one measure, in a heap until rank() sorts them
+    struct Winners {
+        std::string label;
+        std::vector<Entry> entries;
+    };
+
+    std::size_t count;
+    Statistic statistic;
+    int year;
+
+    std::vector<RankedArea> areas;
+
+    // by measure code
+    std::map<std::string, Winners> winners;
+
+    template <typename ForEachArea>
+    void rankAll(ForEachArea const &forEachArea);
+
+    template <typename MeasureOf>
+    bool value(MeasureOf const &measure, double &out) const;
+    static bool better(Entry const &a, Entry const &b);
+};
+
+#endif // RANKING_H_
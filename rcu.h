@@ -0,0 +1,193 @@
+#ifndef RCU_H_
+#define RCU_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the RcuPointer class template, which publishes an
+  immutable object (the loaded datasets in server mode) to many reader
+  threads, and lets a writer replace it with a new version at any time in
+  the style of read-copy-update (RCU): readers that started on the old
+  version finish on it, and new readers see the new version.
+
+  Readers never take a lock. Each reader announces the version it is using
+  in a hazard pointer, and the writer only deletes an old version once no
+  hazard pointer refers to it any more.
+
+  As this is a template, the implementation lives in this header.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  An atomically replaceable pointer to an immutable T.
+
+  read() returns a Reader that keeps the current version alive until the
+  Reader is destroyed. publish() replaces the current version; the old
+  versions are deleted by publish() or reclaim() once they have no readers.
+*/
+template <typename T>
+class RcuPointer {
+public:
+    /*
+      The most readers that can hold a version at the same time. Further
+      readers wait (without locking) for one to finish.
+    */
+    static constexpr std::size_t MAX_READERS = 128;
+
+private:
+    //a hazard pointer, on its own cache line so that readers on different
+    //cores do not slow each other down
+    struct alignas(64) Slot {
+        std::atomic<bool> taken{false};
+        std::atomic<const T *> hazard{nullptr};
+    };
+
+    std::atomic<const T *> current;
+    Slot slots[MAX_READERS];
+
+    //only touched by writers
+    std::mutex writer;
+    std::vector<const T *> retired;
+
+    std::size_t acquireSlot() {
+        std::size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+        for(std::size_t attempt = 0; ; attempt++) {
+            std::size_t i = (start + attempt) % MAX_READERS;
+            bool expected = false;
+            if(!slots[i].taken.load(std::memory_order_relaxed)
+               && slots[i].taken.compare_exchange_strong(expected, true)) {
+                return i;
+            }
+            if(attempt % MAX_READERS == MAX_READERS - 1) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    //delete every retired version that no reader holds, with `writer` held
+    void reclaimRetired() {
+        std::vector<const T *> kept;
+        for(const T *old : retired) {
+            bool inUse = false;
+            for(Slot const &slot : slots) {
+                inUse = inUse || slot.hazard.load() == old;
+            }
+
+            if(inUse) {
+                kept.push_back(old);
+            } else {
+                delete old;
+            }
+        }
+        retired.swap(kept);
+    }
+
+public:
+    /*
+      A reader's hold on one version. The version stays valid, and does not
+      change, for as long as the Reader exists.
+    */
+    class Reader {
+    private:
+        Slot *slot;
+        const T *value;
+
+    public:
+        Reader(Slot *slot, const T *value) : slot(slot), value(value) {}
+
+        Reader(Reader &&other) : slot(other.slot), value(other.value) {
+            other.slot = nullptr;
+        }
+
+        Reader(Reader const &) = delete;
+        Reader &operator=(Reader const &) = delete;
+        Reader &operator=(Reader &&) = delete;
+
+        ~Reader() {
+            if(slot != nullptr) {
+                slot->hazard.store(nullptr);
+                slot->taken.store(false, std::memory_order_release);
+            }
+        }
+
+        const T &operator*() const { return *value; }
+        const T *operator->() const { return value; }
+    };
+
+    explicit RcuPointer(std::unique_ptr<const T> initial) : current(initial.release()) {}
+
+    RcuPointer(RcuPointer const &) = delete;
+    RcuPointer &operator=(RcuPointer const &) = delete;
+
+    /*
+      Must only be destroyed once there are no readers left.
+    */
+    ~RcuPointer() {
+        delete current.load();
+        for(const T *old : retired) {
+            delete old;
+        }
+    }
+
+    /*
+      Get the current version, without locking.
+
+      @return
+        A Reader holding the current version
+    */
+    Reader read() {
+        Slot &slot = slots[acquireSlot()];
+
+        //announce the version, then check it is still current: if it is,
+        //a writer replacing it from now on will see the hazard pointer
+        const T *value = current.load();
+        while(true) {
+            slot.hazard.store(value);
+            const T *again = current.load();
+            if(again == value) {
+                break;
+            }
+            value = again;
+        }
+
+        return Reader(&slot, value);
+    }
+
+    /*
+      Replace the current version. Readers holding the old version keep it
+      until they are done with it.
+
+      @param next
+        The new version
+    */
+    void publish(std::unique_ptr<const T> next) {
+        std::lock_guard<std::mutex> guard(writer);
+        retired.push_back(current.exchange(next.release()));
+        reclaimRetired();
+    }
+
+    /*
+      Delete the old versions that have no readers left.
+
+      @return
+        The number of old versions still held by readers
+    */
+    std::size_t reclaim() {
+        std::lock_guard<std::mutex> guard(writer);
+        reclaimRetired();
+        return retired.size();
+    }
+};
+
+#endif // RCU_H_
@@ -0,0 +1,166 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the ResultCache class.
+ */
+
+#include <functional>
+#include <iterator>
+#include <utility>
+
+#include "resultcache.h"
+
+/*
+  ResultCache::ResultCache(budgetBytes)
+
+  Create an empty cache.
+
+  @param budgetBytes
+    The most bytes of keys and outputs the cache may hold
+*/
+ResultCache::ResultCache(std::size_t budgetBytes)
+    : budget(budgetBytes), bytes(0), nextVictim(0) {}
+
+ResultCache::Shard &ResultCache::shardFor(const std::string &key) {
+    return shards[std::hash<std::string>()(key) % SHARDS];
+}
+
+/*
+  The bytes an entry is counted as, including a rough allowance for the
+  list and index nodes that hold it.
+*/
+std::size_t ResultCache::cost(const Entry &entry) {
+    return 2 * entry.key.size() + entry.output->size() + 128;
+}
+
+void ResultCache::erase(Shard &shard, std::list<Entry>::iterator entry) {
+    std::size_t entryCost = cost(*entry);
+    bytes -= entryCost;
+    shard.index.erase(entry->key);
+    shard.entries.erase(entry);
+}
+
+/*
+  ResultCache::find(key, version)
+
+  Look up the output of a query.
+
+  @param key
+    The canonical form of the query
+
+  @param version
+    The version of the data the query is asked of
+
+  @return
+    The cached output, or nullptr if there is none for this version (an
+    output of an older version is dropped)
+*/
+std::shared_ptr<const std::string> ResultCache::find(const std::string &key,
+                                                     std::uint64_t version) {
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto it = shard.index.find(key);
+    if(it == shard.index.end()) {
+        return nullptr;
+    }
+
+    if(it->second->version != version) {
+        //only an output of older data is stale; one of newer data is kept
+        //for the callers that have moved on to it
+        if(it->second->version < version) {
+            erase(shard, it->second);
+        }
+        return nullptr;
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    return it->second->output;
+}
+
+/*
+  ResultCache::insert(key, version, output)
+
+  Keep the output of a query, making room by dropping the least recently
+  used outputs, of its own shard first and then of the others. An output
+  larger than 1/MAX_ENTRY_FRACTION of the budget is not kept, nor is one of
+  older data than the output already kept for the query.
+
+  @param key
+    The canonical form of the query
+
+  @param version
+    The version of the data the output was computed from
+
+  @param output
+    The output of the query
+*/
+void ResultCache::insert(const std::string &key,
+                         std::uint64_t version,
+                         std::shared_ptr<const std::string> output) {
+    Entry entry{key, version, std::move(output)};
+    std::size_t entryCost = cost(entry);
+    if(entryCost > budget / MAX_ENTRY_FRACTION) {
+        return;
+    }
+
+    Shard &shard = shardFor(key);
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+
+        auto it = shard.index.find(key);
+        if(it != shard.index.end()) {
+            if(it->second->version > version) {
+                return;
+            }
+            erase(shard, it->second);
+        }
+
+        while(!shard.entries.empty() && bytes + entryCost > budget) {
+            erase(shard, std::prev(shard.entries.end()));
+        }
+
+        shard.entries.push_front(std::move(entry));
+        shard.index[key] = shard.entries.begin();
+        bytes += entryCost;
+    }
+
+    if(bytes > budget) {
+        evictOthers(shard);
+    }
+}
+
+/*
+  ResultCache::evictOthers(keep)
+
+  Drop the least recently used output of each of the other shards in turn
+  until the cache is back within its budget. Only one shard is locked at a
+  time, so that two threads making room at once cannot wait on each other.
+
+  @param keep
+    The shard just inserted into, which has already given up all it can
+*/
+void ResultCache::evictOthers(const Shard &keep) {
+    std::size_t emptyInARow = 0;
+    while(bytes > budget && emptyInARow < SHARDS) {
+        Shard &shard = shards[nextVictim++ % SHARDS];
+        if(&shard == &keep) {
+            emptyInARow++;
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(shard.lock);
+        if(shard.entries.empty()) {
+            emptyInARow++;
+            continue;
+        }
+        emptyInARow = 0;
+        erase(shard, std::prev(shard.entries.end()));
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef RESULTCACHE_H_
+#define RESULTCACHE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the ResultCache class, which keeps the output of recent
+  queries in server and batch mode, so that a query that is asked again is
+  answered without filtering and formatting the data again.
+ */
+
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+  A least-recently-used cache of query outputs, bounded by the number of
+  bytes it holds. Each output is stored with the version of the data it was
+  computed from, and is not returned for any other version, so the cache
+  never answers from data that has since been reloaded. Versions only grow,
+  so an output is only ever replaced by one of the same or newer data: a
+  query that was answered from the old data while the data was reloaded
+  cannot push out the answer from the new data.
+
+  The cache is split into shards, each with its own lock, so that threads
+  looking up different queries rarely wait for each other. The budget is
+  shared by all the shards: an output may take up to MAX_ENTRY_FRACTION of
+  it, whichever shard its query falls in, and room for it is made by
+  dropping the least recently used outputs of its own shard first and then
+  those of the other shards in turn. Recency is thus only kept per shard,
+  which is close enough to a true LRU for outputs spread over 16 shards.
+*/
+class ResultCache {
+public:
+    static constexpr std::size_t SHARDS = 16;
+    static constexpr std::size_t MAX_ENTRY_FRACTION = 2;
+
+    explicit ResultCache(std::size_t budgetBytes);
+
+    ResultCache(ResultCache const &) = delete;
+    ResultCache &operator=(ResultCache const &) = delete;
+
+    std::shared_ptr<const std::string> find(const std::string &key, std::uint64_t version);
+    void insert(const std::string &key,
+                std::uint64_t version,
+                std::shared_ptr<const std::string> output);
+
+private:
+    struct Entry {
+        std::string key;
+        std::uint64_t version;
+        std::shared_ptr<const std::string> output;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        std::list<Entry> entries;  // most recently used first
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    std::size_t budget;
+    std::atomic<std::size_t> bytes;
+    std::atomic<std::size_t> nextVictim;
+    Shard shards[SHARDS];
+
+    Shard &shardFor(const std::string &key);
+    static std::size_t cost(const Entry &entry);
+    void erase(Shard &shard, std::list<Entry>::iterator entry);
+    void evictOthers(const Shard &keep);
+};
+
+#endif // RESULTCACHE_H_
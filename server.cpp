@@ -0,0 +1,562 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the server mode of Beth Yw? (--serve). The datasets are
+  loaded once, unfiltered, into a read-only snapshot (see snapshot.h), and
+  each query is then answered by filtering that snapshot, rather than by
+  starting the program and importing the files again. Aggregates and top
+  areas are worked out in place from the snapshot, whose indexes give the
+  statistics of each Measure in whatever years a query asks for, and a
+  --where condition is evaluated on each area as it is merged from it; the
+  values a query outputs are loaded from it into an Areas object for the
+  writers.
+
+  Clients connect to a Unix domain socket and send one query per line. A
+  query is written just like the arguments of the program, e.g.
+
+    -d popden -a swan,cardiff -y 2010-2015 -j
+
+  with double quotes around an argument that contains spaces. If a query has
+  no datasets argument, all the datasets loaded by the server are used. Each
+  query is answered with a header line and then the output, exactly as the
+  program would have printed it:
+
+    OK <number of bytes>\n<output>
+    ERROR <number of bytes>\n<error message>
+
+  Clients may send any number of queries over a connection, and each
+  connection is served by its own thread. The queries themselves are run on
+  a ThreadPool with a worker for each core, so that many connections do not
+  make the threads compete for the cores, and their outputs are kept in a
+  ResultCache so that repeated queries are answered straight away.
+
+  While serving, a background thread watches the dataset files and imports
+  them again when they change. The new data is published through an
+  RcuPointer (see rcu.h): queries already running finish on the old data,
+  and queries never wait for a reload.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "lib_cxxopts.hpp"
+
+#include "aggregate.h"
+#include "bethyw.h"
+#include "memstats.h"
+#include "predicate.h"
+#include "ranking.h"
+#include "rcu.h"
+#include "threadpool.h"
+
+/*
+  One version of the data the server answers queries from.
+*/
+struct StoreVersion {
+    std::shared_ptr<const Snapshot> snapshot;
+    std::uint64_t version;
+};
+
+using PublishedStore = RcuPointer<StoreVersion>;
+
+/*
+  Split a query into arguments at whitespace, keeping text in double quotes
+  together.
+*/
+static std::vector<std::string> splitArguments(std::string const &line) {
+    std::vector<std::string> arguments;
+    std::string current;
+    bool inArgument = false;
+    bool quoted = false;
+
+    for(char c : line) {
+        if(c == '"') {
+            quoted = !quoted;
+            inArgument = true;
+        } else if(!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+            if(inArgument) {
+                arguments.push_back(current);
+                current.clear();
+                inArgument = false;
+            }
+        } else {
+            current += c;
+            inArgument = true;
+        }
+    }
+
+    if(quoted) {
+        throw std::invalid_argument("Unterminated quote in query");
+    }
+    if(inArgument) {
+        arguments.push_back(current);
+    }
+
+    return arguments;
+}
+
+/*
+  The canonical form of a parsed query, used as its key in the ResultCache.
+  The filter sets are sorted, so queries that list the same areas or
+  measures in a different order (or case) share a key. The order of the
+  datasets is kept, as it decides the order they are merged in.
+*/
+static std::string canonicalKey(std::vector<BethYw::InputFileSource> const &datasets,
+                                StringFilterSet const &areasFilter,
+                                StringFilterSet const &measuresFilter,
+                                YearFilterTuple const &yearsFilter,
+                                BethYw::OutputFormat format,
+                                Aggregation const *aggregation,
+                                Ranking const *ranking,
+                                Predicate const *predicate) {
+    std::string key = format == BethYw::OutputFormat::JSON    ? "json"
+                    : format == BethYw::OutputFormat::ARROW   ? "arrow"
+                                                              : "table";
+
+    //fields are separated by null characters, which no argument contains
+    auto addField = [&key](std::string const &value) {
+        key += '\0';
+        key += value;
+    };
+
+    addField("datasets");
+    for(auto const &src : datasets) {
+        addField(src.CODE);
+    }
+
+    for(auto filter : {&areasFilter, &measuresFilter}) {
+        std::vector<std::string> values(filter->begin(), filter->end());
+        std::sort(values.begin(), values.end());
+
+        addField(filter == &areasFilter ? "areas" : "measures");
+        for(auto const &value : values) {
+            addField(value);
+        }
+    }
+
+    addField("years");
+    addField(std::to_string(std::get<0>(yearsFilter)));
+    addField(std::to_string(std::get<1>(yearsFilter)));
+
+    if(aggregation != nullptr) {
+        addField("group-by");
+        for(Aggregation::Key groupBy : aggregation->getGroupBy()) {
+            addField(Aggregation::name(groupBy));
+        }
+
+        addField("agg");
+        for(Aggregation::Statistic statistic : aggregation->getStatistics()) {
+            addField(Aggregation::name(statistic));
+        }
+    }
+
+    if(ranking != nullptr) {
+        addField("top");
+        addField(std::to_string(ranking->getCount()));
+        addField(ranking->describe());
+    }
+
+    if(predicate != nullptr) {
+        addField("where");
+        addField(predicate->describe());
+    }
+
+    return key;
+}
+
+/*
+  BethYw::answerQuery(store, loadedDatasets, query, out, cache, version)
+
+  Answer one query against the datasets loaded by the server. The datasets,
+  areas, measures, years, json and format arguments have the same meaning
+  as on the command line.
+
+  @param store
+    The snapshot holding the loaded datasets
+
+  @param loadedDatasets
+    The datasets in `store`
+
+  @param query
+    The arguments of the query, as a single line
+
+  @param out
+    The stream to write the output to
+
+  @param cache
+    The cache to answer the query from, and to keep its output in, or
+    nullptr
+
+  @param version
+    The version of the data in `store`, which cached outputs must match
+
+  @throws
+    std::invalid_argument or cxxopts::OptionException if the query is
+    invalid, or asks for a dataset the server has not loaded
+*/
+void BethYw::answerQuery(Snapshot const &store,
+                         std::vector<BethYw::InputFileSource> const &loadedDatasets,
+                         std::string const &query,
+                         std::ostream &out,
+                         ResultCache *cache,
+                         std::uint64_t version) {
+    answerQuery(store, loadedDatasets, splitArguments(query), out, cache, version);
+}
+
+/*
+  BethYw::answerQuery(store, loadedDatasets, arguments, out, cache, version)
+
+  As above, with the query already split into arguments.
+*/
+void BethYw::answerQuery(Snapshot const &store,
+                         std::vector<BethYw::InputFileSource> const &loadedDatasets,
+                         std::vector<std::string> arguments,
+                         std::ostream &out,
+                         ResultCache *cache,
+                         std::uint64_t version) {
+    arguments.insert(arguments.begin(), "bethyw");
+
+    std::vector<char *> argv;
+    for(std::string &argument : arguments) {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    int argc = static_cast<int>(arguments.size());
+    char **argvp = argv.data();
+
+    auto cxxopts = BethYw::cxxoptsSetup();
+    auto args = cxxopts.parse(argc, argvp);
+
+    if(args.count("help")) {
+        out << cxxopts.help() << std::endl;
+        return;
+    }
+
+    for(const char *option : {"dir", "snapshot", "cache", "serve", "batch", "result-cache",
+                              "profile", "counters", "trace", "mem-stats"}) {
+        if(args.count(option)) {
+            throw std::invalid_argument(std::string("Option not allowed in a query: --") + option);
+        }
+    }
+
+    std::vector<BethYw::InputFileSource> datasets = loadedDatasets;
+    if(args.count("datasets")) {
+        datasets = BethYw::parseDatasetsArg(args);
+
+        for(auto const &src : datasets) {
+            if(!store.hasDataset(src.CODE)) {
+                throw std::invalid_argument("Dataset not loaded by the server: " + src.CODE);
+            }
+        }
+    }
+
+    StringFilterSet areasFilter = BethYw::parseAreasArg(args);
+    StringFilterSet measuresFilter = BethYw::parseMeasuresArg(args);
+    YearFilterTuple yearsFilter = BethYw::parseYearsArg(args);
+    BethYw::OutputFormat format = BethYw::parseFormatArg(args);
+    std::unique_ptr<Aggregation> aggregation = BethYw::parseAggregationArgs(args);
+    std::unique_ptr<Ranking> ranking = BethYw::parseRankingArgs(args);
+    std::unique_ptr<Predicate> predicate = BethYw::parseWhereArg(args);
+
+    std::string key;
+    if(cache != nullptr) {
+        key = canonicalKey(datasets, areasFilter, measuresFilter, yearsFilter, format,
+                           aggregation.get(), ranking.get(), predicate.get());
+
+        auto cached = cache->find(key, version);
+        if(cached) {
+            out << *cached;
+            return;
+        }
+    }
+
+    //aggregates and top areas are worked out straight from the snapshot,
+    //as are the values that pass a condition, which is evaluated on each
+    //area as it is merged; values are put in an Areas object, which is what
+    //their writers output
+    Areas data = Areas();
+    if(aggregation || ranking || predicate) {
+        MemStats::Scope filtering(MemStats::FILTERING);
+        StringFilterSet importFilter = predicate ? predicate->importFilter(measuresFilter) : measuresFilter;
+        SnapshotQuery prepared = store.prepare(areasFilter, importFilter, yearsFilter);
+        if(aggregation && predicate) {
+            aggregation->aggregate(store, datasets, prepared, *predicate, measuresFilter);
+        } else if(aggregation) {
+            aggregation->aggregate(store, datasets, prepared);
+        } else if(ranking && predicate) {
+            ranking->rank(store, datasets, prepared, *predicate, measuresFilter);
+        } else if(ranking) {
+            ranking->rank(store, datasets, prepared);
+        } else {
+            data = predicate->filter(store, datasets, prepared, measuresFilter);
+        }
+    } else {
+        MemStats::Scope parsing(MemStats::PARSING);
+        store.load(data, datasets, areasFilter, measuresFilter, yearsFilter);
+    }
+
+    MemStats::Scope rendering(MemStats::OUTPUT);
+    auto write = [&](std::ostream &os) {
+        if(aggregation) {
+            BethYw::writeAggregation(os, *aggregation, format);
+        } else if(ranking) {
+            BethYw::writeRanking(os, *ranking, format);
+        } else {
+            BethYw::writeOutput(os, data, format);
+        }
+    };
+
+    if(cache == nullptr) {
+        write(out);
+        return;
+    }
+
+    std::ostringstream rendered;
+    write(rendered);
+    auto output = std::make_shared<const std::string>(rendered.str());
+    cache->insert(key, version, output);
+    out << *output;
+}
+
+#ifndef _WIN32
+
+/*
+  Write all of `data` to a socket.
+
+  @return
+    false if the client has gone away
+*/
+static bool sendAll(int fd, std::string const &data) {
+    size_t sent = 0;
+    while(sent < data.size()) {
+        ssize_t n = ::write(fd, data.data() + sent, data.size() - sent);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/*
+  Answer the queries sent over one connection, until the client closes it.
+*/
+static void serveConnection(int fd,
+                            std::shared_ptr<PublishedStore> store,
+                            std::shared_ptr<ThreadPool> pool,
+                            std::shared_ptr<ResultCache> cache,
+                            std::vector<BethYw::InputFileSource> const &loadedDatasets) {
+    std::string pending;
+    char buffer[4096];
+
+    while(true) {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            break;
+        }
+        pending.append(buffer, static_cast<size_t>(n));
+
+        size_t start = 0;
+        size_t end;
+        bool open = true;
+        while(open && (end = pending.find('\n', start)) != std::string::npos) {
+            std::string query = pending.substr(start, end - start);
+            start = end + 1;
+
+            std::string response = pool->submit([&store, &cache, &loadedDatasets, &query]() {
+                std::ostringstream out;
+                std::string status = "OK";
+                try {
+                    auto current = store->read();
+                    BethYw::answerQuery(*current->snapshot,
+                                        loadedDatasets,
+                                        query,
+                                        out,
+                                        cache.get(),
+                                        current->version);
+                } catch(std::exception &e) {
+                    out.str(e.what());
+                    status = "ERROR";
+                }
+
+                std::string body = out.str();
+                return status + " " + std::to_string(body.size()) + "\n" + body;
+            }).get();
+
+            open = sendAll(fd, response);
+        }
+        pending.erase(0, start);
+
+        if(!open) {
+            break;
+        }
+    }
+
+    ::close(fd);
+}
+
+/*
+  Import the datasets again whenever their files change, and publish the
+  result. A failed import leaves the current data in place until the files
+  change again.
+*/
+static void reloadStore(std::shared_ptr<PublishedStore> store,
+                        std::string const &dir,
+                        std::vector<BethYw::InputFileSource> const &loadedDatasets,
+                        std::string const &cacheDir,
+                        std::vector<long long> loadedTimes) {
+    std::uint64_t version = 1;
+
+    while(true) {
+        std::this_thread::sleep_for(std::chrono::seconds(BethYw::RELOAD_POLL_SECONDS));
+
+        //versions replaced earlier can go once their queries are done
+        store->reclaim();
+
+        std::vector<long long> times = BethYw::sourceTimes(dir, loadedDatasets);
+        if(times == loadedTimes) {
+            continue;
+        }
+        loadedTimes = times;
+
+        try {
+            std::unique_ptr<StoreVersion> next(new StoreVersion{
+                    BethYw::loadStore(dir, loadedDatasets, cacheDir), ++version});
+            store->publish(std::move(next));
+            std::cerr << "Reloaded datasets (version " << version << ")" << std::endl;
+        } catch(std::exception &e) {
+            std::cerr << "Failed to reload datasets: " << e.what() << std::endl;
+        }
+    }
+}
+
+#endif
+
+/*
+  BethYw::serve(socketPath, dir, loadedDatasets, cacheDir, resultCacheBytes)
+
+  Import the datasets, then listen on a Unix domain socket and answer
+  queries (see the top of this file) until the program is stopped. The
+  datasets are imported again whenever their files change. Any existing file
+  at `socketPath` is replaced.
+
+  @param socketPath
+    The path of the socket to create
+
+  @param dir
+    The directory where the datasets are
+
+  @param loadedDatasets
+    The datasets to import and answer queries about
+
+  @param cacheDir
+    The parse cache directory (see importDatasets()), or empty
+
+  @param resultCacheBytes
+    The size of the cache of query outputs (see resultcache.h), or 0 for
+    no cache
+
+  @return
+    Exit code
+
+  @throws
+    std::runtime_error if the datasets cannot be imported or the socket
+    cannot be created
+*/
+int BethYw::serve(std::string const &socketPath,
+                  std::string const &dir,
+                  std::vector<BethYw::InputFileSource> const &loadedDatasets,
+                  std::string const &cacheDir,
+                  std::size_t resultCacheBytes) {
+#ifdef _WIN32
+    throw std::runtime_error("BethYw::serve: Server mode is not supported on Windows");
+#else
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("BethYw::serve: Socket path is too long: " + socketPath);
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0) {
+        throw std::runtime_error("BethYw::serve: Failed to create socket: "
+                                 + std::string(std::strerror(errno)));
+    }
+
+    ::unlink(socketPath.c_str());
+    if(::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+       || ::listen(listener, SOMAXCONN) != 0) {
+        std::string reason = std::strerror(errno);
+        ::close(listener);
+        throw std::runtime_error("BethYw::serve: Failed to listen on socket "
+                                 + socketPath + ": " + reason);
+    }
+
+    //a client closing its connection early must not stop the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<long long> times = sourceTimes(dir, loadedDatasets);
+    std::unique_ptr<StoreVersion> first(new StoreVersion{
+            loadStore(dir, loadedDatasets, cacheDir), 1});
+    auto store = std::make_shared<PublishedStore>(std::move(first));
+
+    std::thread(reloadStore, store, dir, loadedDatasets, cacheDir, times).detach();
+
+    auto pool = std::make_shared<ThreadPool>();
+
+    std::shared_ptr<ResultCache> cache;
+    if(resultCacheBytes > 0) {
+        cache = std::make_shared<ResultCache>(resultCacheBytes);
+    }
+
+    std::cerr << "Serving " << loadedDatasets.size() << " dataset(s) on "
+              << socketPath << std::endl;
+
+    while(true) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::string reason = std::strerror(errno);
+            ::close(listener);
+            throw std::runtime_error("BethYw::serve: Failed to accept connection: " + reason);
+        }
+
+        std::thread(serveConnection, fd, store, pool, cache, loadedDatasets).detach();
+    }
+#endif
+}
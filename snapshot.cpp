@@ -0,0 +1,1256 @@
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the Snapshot and SnapshotWriter
+  classes. See snapshot.h for the layout of a snapshot file.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "input.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "trace.h"
+
+/*
+  Round a position in the file up so the array starting there is aligned.
+*/
+static std::uint64_t align8(std::uint64_t pos) {
+    return (pos + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+/*
+  Snapshot::open(path)
+
+  Open a snapshot file. On POSIX systems the file is memory mapped, so only
+  the pages that are actually used are read from disk.
+
+  @param path
+    The path of the snapshot file
+
+  @return
+    The opened snapshot
+
+  @throws
+    std::runtime_error if the file cannot be opened, or is not a valid
+    snapshot (wrong version, truncated, checksum mismatch, ...)
+
+  @example
+    auto snapshot = Snapshot::open("datasets/bethyw.snapshot");
+*/
+std::shared_ptr<Snapshot> Snapshot::open(const std::string &path) {
+    std::shared_ptr<Snapshot> snapshot(new Snapshot());
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0) {
+        if(fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error("Snapshot::open: Failed to open file " + path);
+    }
+
+    snapshot->mappingSize = static_cast<std::size_t>(info.st_size);
+    if(snapshot->mappingSize > 0) {
+        void *mapping = mmap(nullptr, snapshot->mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping != MAP_FAILED) {
+            snapshot->mapping = mapping;
+        }
+    }
+    ::close(fd);
+
+    if(snapshot->mapping == nullptr) {
+        throw std::runtime_error("Snapshot::open: Failed to map file " + path);
+    }
+
+    snapshot->data = static_cast<const char *>(snapshot->mapping);
+    snapshot->size = snapshot->mappingSize;
+#else
+    snapshot->owned = InputFile(path).read();
+    snapshot->data = snapshot->owned.data();
+    snapshot->size = snapshot->owned.size();
+#endif
+
+    snapshot->validate();
+    return snapshot;
+}
+
+/*
+  Snapshot::fromBytes(bytes)
+
+  Use a snapshot that is held in memory, e.g. one just produced by
+  SnapshotWriter::finish().
+
+  @param bytes
+    The contents of a snapshot
+
+  @return
+    The snapshot, which takes ownership of the bytes
+
+  @throws
+    std::runtime_error if the bytes are not a valid snapshot
+*/
+std::shared_ptr<Snapshot> Snapshot::fromBytes(std::string bytes) {
+    std::shared_ptr<Snapshot> snapshot(new Snapshot());
+    snapshot->owned = std::move(bytes);
+    snapshot->data = snapshot->owned.data();
+    snapshot->size = snapshot->owned.size();
+
+    snapshot->validate();
+    return snapshot;
+}
+
+Snapshot::~Snapshot() {
+#ifndef _WIN32
+    if(mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+#endif
+}
+
+/*
+  The checksum of a snapshot: the FNV-1a hash of its header, with the
+  checksum itself as 0, followed by everything up to the values.
+*/
+static std::uint64_t checksum(SnapshotHeader header, const char *data) {
+    header.checksum = 0;
+    std::uint64_t hash = fnv1aHash(reinterpret_cast<const char *>(&header), sizeof(header));
+    return fnv1aHash(data + sizeof(SnapshotHeader), header.valuesPos - sizeof(SnapshotHeader), hash);
+}
+
+/*
+  The checksum of the values of a section: the FNV-1a hash of its values,
+  followed by their year ids.
+*/
+static std::uint64_t checksum(const SnapshotSection &section,
+                              const double *values,
+                              const std::uint16_t *yearIds) {
+    std::uint64_t hash = fnv1aHash(reinterpret_cast<const char *>(values + section.firstValue),
+                                   section.valueCount * sizeof(double));
+    return fnv1aHash(reinterpret_cast<const char *>(yearIds + section.firstValue),
+                     section.valueCount * sizeof(std::uint16_t), hash);
+}
+
+/*
+  Check the header and checksum, set up the pointers to each array, and
+  check that every offset, id and count in the arrays before the values is
+  within the file, and that the values of each series are within those of
+  its section. The values themselves are checked by verify().
+*/
+void Snapshot::validate() {
+    if(size < sizeof(SnapshotHeader)
+       || reinterpret_cast<std::uintptr_t>(data) % alignof(SnapshotHeader) != 0) {
+        throw std::runtime_error("Snapshot::open: Not a snapshot file");
+    }
+
+    header = reinterpret_cast<const SnapshotHeader *>(data);
+    if(std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw std::runtime_error("Snapshot::open: Not a snapshot file");
+    }
+
+    if(header->version != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Snapshot::open: Unsupported snapshot version "
+                                 + std::to_string(header->version));
+    }
+
+    if(header->byteOrder != SNAPSHOT_BYTE_ORDER) {
+        throw std::runtime_error("Snapshot::open: Snapshot was written with a different byte order");
+    }
+
+    if(header->size != size) {
+        throw std::runtime_error("Snapshot::open: Snapshot is truncated");
+    }
+
+    if(header->valuesPos < sizeof(SnapshotHeader) || header->valuesPos > size
+       || checksum(*header, data) != header->checksum) {
+        throw std::runtime_error("Snapshot::open: Snapshot checksum mismatch");
+    }
+
+    auto corrupt = []() {
+        return std::runtime_error("Snapshot::open: Snapshot is corrupt");
+    };
+
+    auto checkArray = [this, &corrupt](std::uint64_t pos, std::uint64_t count, std::size_t itemSize) {
+        if(pos % 8 != 0 || pos > size || count > (size - pos) / itemSize) {
+            throw corrupt();
+        }
+        return data + pos;
+    };
+
+    //the arrays before the values must end before them, as the checksum
+    //only covers that far
+    auto checkTable = [this, &checkArray, &corrupt](std::uint64_t pos, std::uint64_t count,
+                                                    std::size_t itemSize) {
+        const char *table = checkArray(pos, count, itemSize);
+        if(count * itemSize > header->valuesPos - std::min(pos, header->valuesPos)) {
+            throw corrupt();
+        }
+        return table;
+    };
+
+    //a run [first, first + count) of an array of `total` items
+    auto checkRun = [&corrupt](std::uint64_t first, std::uint64_t count, std::uint64_t total) {
+        if(first > total || count > total - first) {
+            throw corrupt();
+        }
+    };
+
+    auto checkString = [this, &corrupt](std::uint32_t id) {
+        if(id >= header->stringCount) {
+            throw corrupt();
+        }
+    };
+
+    stringOffsets = reinterpret_cast<const std::uint32_t *>(
+            checkTable(header->stringOffsetsPos, header->stringCount + 1ull, sizeof(std::uint32_t)));
+    stringData = checkTable(header->stringDataPos, stringOffsets[header->stringCount], 1);
+    years = reinterpret_cast<const std::int32_t *>(
+            checkTable(header->yearsPos, header->yearCount, sizeof(std::int32_t)));
+    sections = reinterpret_cast<const SnapshotSection *>(
+            checkTable(header->sectionsPos, header->sectionCount, sizeof(SnapshotSection)));
+    areas = reinterpret_cast<const SnapshotArea *>(
+            checkTable(header->areasPos, header->areaCount, sizeof(SnapshotArea)));
+    names = reinterpret_cast<const SnapshotName *>(
+            checkTable(header->namesPos, header->nameCount, sizeof(SnapshotName)));
+    series = reinterpret_cast<const SnapshotSeries *>(
+            checkTable(header->seriesPos, header->seriesCount, sizeof(SnapshotSeries)));
+    values = reinterpret_cast<const double *>(
+            checkArray(header->valuesPos, header->valueCount, sizeof(double)));
+    yearIds = reinterpret_cast<const std::uint16_t *>(
+            checkArray(header->yearIdsPos, header->valueCount, sizeof(std::uint16_t)));
+
+    if(header->yearCount > 0x10000) {
+        throw corrupt();
+    }
+
+    for(std::uint32_t i = 0; i < header->stringCount; i++) {
+        if(stringOffsets[i] > stringOffsets[i + 1]) {
+            throw corrupt();
+        }
+    }
+
+    for(std::uint32_t i = 0; i < header->sectionCount; i++) {
+        const SnapshotSection &section = sections[i];
+        checkString(section.code);
+        checkRun(section.firstArea, section.areaCount, header->areaCount);
+        checkRun(section.firstValue, section.valueCount, header->valueCount);
+    }
+
+    for(std::uint32_t i = 0; i < header->areaCount; i++) {
+        checkString(areas[i].code);
+        checkString(areas[i].codeLower);
+        checkRun(areas[i].firstName, areas[i].nameCount, header->nameCount);
+        checkRun(areas[i].firstSeries, areas[i].seriesCount, header->seriesCount);
+    }
+
+    for(std::uint32_t i = 0; i < header->nameCount; i++) {
+        checkString(names[i].lang);
+        checkString(names[i].value);
+        checkString(names[i].valueLower);
+    }
+
+    for(std::uint32_t i = 0; i < header->seriesCount; i++) {
+        checkString(series[i].code);
+        checkString(series[i].label);
+        checkString(series[i].labelLower);
+        checkRun(series[i].firstValue, series[i].valueCount, header->valueCount);
+    }
+
+    //forEachArea() merges the sections by area code, and the series of an
+    //area by measure code, so both must be in order (as the writer leaves
+    //them, from the std::maps of Areas and Area)
+    for(std::uint32_t i = 0; i < header->sectionCount; i++) {
+        const SnapshotSection &section = sections[i];
+        for(std::uint32_t a = section.firstArea + 1; a < section.firstArea + section.areaCount; a++) {
+            if(!less(areas[a - 1].code, areas[a].code)) {
+                throw corrupt();
+            }
+        }
+    }
+
+    for(std::uint32_t i = 0; i < header->areaCount; i++) {
+        for(std::uint32_t s = areas[i].firstSeries + 1; s < areas[i].firstSeries + areas[i].seriesCount; s++) {
+            if(!less(series[s - 1].code, series[s].code)) {
+                throw corrupt();
+            }
+        }
+    }
+
+    //the values of a section's series must be within the section, as its
+    //checksum only covers those
+    for(std::uint32_t i = 0; i < header->sectionCount; i++) {
+        const SnapshotSection &section = sections[i];
+        for(std::uint32_t a = section.firstArea; a < section.firstArea + section.areaCount; a++) {
+            for(std::uint32_t s = areas[a].firstSeries; s < areas[a].firstSeries + areas[a].seriesCount; s++) {
+                if(series[s].firstValue < section.firstValue) {
+                    throw corrupt();
+                }
+                checkRun(series[s].firstValue - section.firstValue, series[s].valueCount,
+                         section.valueCount);
+            }
+        }
+    }
+
+    verified.reset(new std::atomic<std::uint8_t>[header->sectionCount]);
+    for(std::uint32_t i = 0; i < header->sectionCount; i++) {
+        verified[i] = 0;
+    }
+}
+
+/*
+  Check the values of a section against its checksum, the first time they
+  are used. Threads that get here at the same time may each check them,
+  which is harmless as they reach the same answer.
+
+  @throws
+    std::runtime_error if the values do not match the checksum
+*/
+void Snapshot::verify(const SnapshotSection &section) const {
+    std::atomic<std::uint8_t> &state = verified[&section - sections];
+    if(state.load(std::memory_order_acquire) == 0) {
+        state.store(checksum(section, values, yearIds) == section.checksum ? 1 : 2,
+                    std::memory_order_release);
+    }
+
+    if(state.load(std::memory_order_acquire) != 1) {
+        throw std::runtime_error("Snapshot::load: Values of dataset " + text(section.code)
+                                 + " do not match their checksum");
+    }
+}
+
+/*
+  Snapshot::buildIndexes()
+
+  Build a MeasureIndex over the values of every series, so that the
+  statistics of a series in the window of years of any query are found
+  without reading its values again (see forEachArea()). This reads all of
+  the values, checking them against their checksums first; the series of a
+  dataset whose values do not match are not indexed, and queries of it fail
+  as before.
+
+  The Snapshot must not be in use by any other thread while its indexes are
+  built.
+
+  @example
+    auto snapshot = Snapshot::open("datasets/bethyw.snapshot");
+    snapshot->buildIndexes();
+*/
+void Snapshot::buildIndexes() {
+    indexes.assign(header->seriesCount, nullptr);
+
+    for(std::uint32_t i = 0; i < header->sectionCount; i++) {
+        const SnapshotSection &section = sections[i];
+        try {
+            verify(section);
+        } catch(std::runtime_error &) {
+            continue;
+        }
+
+        for(std::uint32_t a = section.firstArea; a < section.firstArea + section.areaCount; a++) {
+            for(std::uint32_t s = areas[a].firstSeries; s < areas[a].firstSeries + areas[a].seriesCount; s++) {
+                indexes[s] = indexSeries(series[s]);
+            }
+        }
+    }
+}
+
+/*
+  The index of the values of a series, or nullptr if its years are not in
+  order, or span more years than a year id can tell apart, which only a
+  corrupt snapshot has.
+*/
+std::shared_ptr<const MeasureIndex> Snapshot::indexSeries(const SnapshotSeries &s) const {
+    std::vector<int> seriesYears;
+    std::vector<MeasureDataType> seriesValues;
+    seriesYears.reserve(s.valueCount);
+    seriesValues.reserve(s.valueCount);
+
+    for(std::uint64_t v = s.firstValue; v < s.firstValue + s.valueCount; v++) {
+        if(yearIds[v] >= header->yearCount) {
+            return nullptr;
+        }
+
+        int year = years[yearIds[v]];
+        if(!seriesYears.empty() && year <= seriesYears.back()) {
+            return nullptr;
+        }
+        seriesYears.push_back(year);
+        seriesValues.push_back(values[v]);
+    }
+
+    if(!seriesYears.empty()
+       && static_cast<std::int64_t>(seriesYears.back()) - seriesYears.front() >= 0x10000) {
+        return nullptr;
+    }
+
+    return std::make_shared<const MeasureIndex>(std::move(seriesYears), std::move(seriesValues));
+}
+
+std::string Snapshot::text(std::uint32_t id) const {
+    return std::string(stringData + stringOffsets[id], stringOffsets[id + 1] - stringOffsets[id]);
+}
+
+/*
+  Get a string from the dictionary, without copying it.
+*/
+SnapshotText Snapshot::str(std::uint32_t id) const {
+    return SnapshotText{stringData + stringOffsets[id], stringOffsets[id + 1] - stringOffsets[id]};
+}
+
+/*
+  Check if a dictionary string comes before another, in the order of
+  std::string (and so of the std::maps of Areas and Area).
+*/
+bool Snapshot::less(std::uint32_t lhs, std::uint32_t rhs) const {
+    SnapshotText a = str(lhs);
+    SnapshotText b = str(rhs);
+    int compared = std::memcmp(a.data, b.data, std::min(a.size, b.size));
+    return compared < 0 || (compared == 0 && a.size < b.size);
+}
+
+/*
+  Check if the dictionary string `lowerId` contains `needle`, without making
+  a copy of the string.
+*/
+bool Snapshot::contains(std::uint32_t lowerId, const std::string &needle) const {
+    const char *begin = stringData + stringOffsets[lowerId];
+    const char *end = stringData + stringOffsets[lowerId + 1];
+    return std::search(begin, end, needle.begin(), needle.end()) != end;
+}
+
+/*
+  The snapshot equivalent of filterCheck() in areas.cpp for an area: the
+  filter values are already lowercase, so an area matches if its lowercase
+  code or one of its lowercase names contains any of them.
+*/
+bool Snapshot::matchesArea(StringFilterSet const &filter, const SnapshotArea &area) const {
+    if(filter.empty()) {
+        return true;
+    }
+
+    for(const std::string &value : filter) {
+        if(contains(area.codeLower, value)) {
+            return true;
+        }
+
+        for(std::uint32_t n = area.firstName; n < area.firstName + area.nameCount; n++) {
+            if(contains(names[n].valueLower, value)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+  The snapshot equivalent of filterCheck() in areas.cpp for a measure code
+  and label.
+*/
+bool Snapshot::matchesSeries(StringFilterSet const &filter, const SnapshotSeries &s) const {
+    if(filter.empty()) {
+        return true;
+    }
+
+    for(const std::string &value : filter) {
+        if(contains(s.code, value) || contains(s.labelLower, value)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const SnapshotSection *Snapshot::findSection(const std::string &code) const {
+    for(std::uint32_t i = 0; i < header->sectionCount; i++) {
+        const SnapshotSection &section = sections[i];
+        std::uint32_t length = stringOffsets[section.code + 1] - stringOffsets[section.code];
+        if(length == code.size()
+           && std::memcmp(stringData + stringOffsets[section.code], code.data(), length) == 0) {
+            return &section;
+        }
+    }
+
+    return nullptr;
+}
+
+/*
+  Snapshot::hasDataset(code)
+
+  @param code
+    The CODE of an InputFileSource, e.g. "popden" or "areas"
+
+  @return
+    true if the dataset was imported into the snapshot
+*/
+bool Snapshot::hasDataset(const std::string &code) const {
+    return findSection(code) != nullptr;
+}
+
+/*
+  Snapshot::verifyDataset(code)
+
+  Check the values of a dataset against their checksum now, rather than
+  when they are first used.
+
+  @param code
+    The CODE of an InputFileSource, e.g. "popden" or "areas"
+
+  @throws
+    std::runtime_error if the dataset is not in the snapshot, or its values
+    do not match their checksum
+*/
+void Snapshot::verifyDataset(const std::string &code) const {
+    const SnapshotSection *section = findSection(code);
+    if(section == nullptr) {
+        throw std::runtime_error("Snapshot::load: Dataset missing from snapshot: " + code);
+    }
+    verify(*section);
+}
+
+/*
+  The sections of areas.csv and then of each of `datasets`, in the order
+  they are merged.
+
+  @throws
+    std::runtime_error if one of them is not in the snapshot
+*/
+std::vector<const SnapshotSection *> Snapshot::sectionsOf(
+        std::vector<BethYw::InputFileSource> const &datasets) const {
+    std::vector<const SnapshotSection *> found;
+    found.push_back(findSection(BethYw::InputFiles::AREAS.CODE));
+    for(auto const &src : datasets) {
+        found.push_back(findSection(src.CODE));
+    }
+
+    for(std::size_t i = 0; i < found.size(); i++) {
+        if(found[i] == nullptr) {
+            throw std::runtime_error("Snapshot::load: Dataset missing from snapshot: "
+                                     + (i == 0 ? BethYw::InputFiles::AREAS.CODE : datasets[i - 1].CODE));
+        }
+    }
+
+    return found;
+}
+
+/*
+  Snapshot::load(areas, datasets, areasFilter, measuresFilter, yearsFilter)
+
+  Fill `areas` as BethYw::loadAreas() followed by BethYw::loadDatasets()
+  would, but from the snapshot rather than the source files.
+
+  @param areas
+    The Areas instance to add the data to
+
+  @param datasets
+    The datasets to load, in the order they should be merged
+
+  @param areasFilter
+    An unordered set of areas to filter, or empty to import all areas
+
+  @param measuresFilter
+    An unordered set of measures to filter, or empty to import all measures
+
+  @param yearsFilter
+    A tuple of the range of years to import, or <0,0> for all years
+
+  @throws
+    std::runtime_error if areas.csv or one of the datasets is not in the
+    snapshot
+
+  @example
+    auto snapshot = Snapshot::open("datasets/bethyw.snapshot");
+    Areas data = Areas();
+    snapshot->load(data, datasetsToImport, areasFilter, measuresFilter, yearsFilter);
+*/
+void Snapshot::load(Areas &areas,
+                    std::vector<BethYw::InputFileSource> const &datasets,
+                    StringFilterSet const &areasFilter,
+                    StringFilterSet const &measuresFilter,
+                    YearFilterTuple const &yearsFilter) const {
+
+    std::vector<const SnapshotSection *> toLoad = sectionsOf(datasets);
+    SnapshotQuery query = prepare(areasFilter, measuresFilter, yearsFilter);
+    for(const SnapshotSection *section : toLoad) {
+        loadSection(areas, *section, query);
+    }
+}
+
+/*
+  Snapshot::loadDataset(areas, code, areasFilter, measuresFilter, yearsFilter)
+
+  Fill `areas` as populate() would when parsing a single dataset.
+
+  @param areas
+    The Areas instance to add the data to
+
+  @param code
+    The CODE of the InputFileSource to load
+
+  @param areasFilter
+    An unordered set of areas to filter, or empty to import all areas
+
+  @param measuresFilter
+    An unordered set of measures to filter, or empty to import all measures
+
+  @param yearsFilter
+    A tuple of the range of years to import, or <0,0> for all years
+
+  @throws
+    std::runtime_error if the dataset is not in the snapshot
+*/
+void Snapshot::loadDataset(Areas &areas,
+                           const std::string &code,
+                           StringFilterSet const &areasFilter,
+                           StringFilterSet const &measuresFilter,
+                           YearFilterTuple const &yearsFilter) const {
+    const SnapshotSection *section = findSection(code);
+    if(section == nullptr) {
+        throw std::runtime_error("Snapshot::load: Dataset missing from snapshot: " + code);
+    }
+
+    loadSection(areas, *section, prepare(areasFilter, measuresFilter, yearsFilter));
+}
+
+/*
+  Snapshot::prepare(areasFilter, measuresFilter, yearsFilter)
+
+  Prepare the filters of a query for matches() and forEachArea().
+  The year filter is checked once for each distinct year here, rather than
+  for every value later, and turned into the window of years that the
+  indexes are asked for.
+
+  @param areasFilter
+    An unordered set of areas to filter, or empty for all areas; it must
+    outlive the query
+
+  @param measuresFilter
+    An unordered set of measures to filter, or empty for all measures; it
+    must outlive the query
+
+  @param yearsFilter
+    A tuple of the range of years to include, or <0,0> for all years
+
+  @return
+    The prepared query
+*/
+SnapshotQuery Snapshot::prepare(StringFilterSet const &areasFilter,
+                                StringFilterSet const &measuresFilter,
+                                YearFilterTuple const &yearsFilter) const {
+    //sized for every possible year id, so that an id past the years (in a
+    //corrupt snapshot) is never included
+    SnapshotQuery query{&areasFilter, &measuresFilter, std::vector<bool>(0x10000),
+                        std::numeric_limits<int>::min(), std::numeric_limits<int>::max()};
+    for(std::uint32_t i = 0; i < header->yearCount; i++) {
+        query.yearsIncluded[i] = yearFilterCheck(&yearsFilter, years[i]);
+    }
+
+    //as yearFilterCheck() reads the filter
+    int earliestYear = std::get<0>(yearsFilter);
+    int latestYear = std::get<1>(yearsFilter);
+    if(earliestYear != 0) {
+        query.firstYear = earliestYear;
+        query.lastYear = latestYear != 0 ? latestYear : earliestYear;
+    }
+    return query;
+}
+
+/*
+  Check if an area passes the area filter of a query.
+*/
+bool Snapshot::matches(const SnapshotArea &area, const SnapshotQuery &query) const {
+    return matchesArea(*query.areasFilter, area);
+}
+
+/*
+  Check if a series passes the measure filter of a query.
+*/
+bool Snapshot::matches(const SnapshotSeries &s, const SnapshotQuery &query) const {
+    return matchesSeries(*query.measuresFilter, s);
+}
+
+/*
+  Count the rows of an area rejected by the area filter, if rows are being
+  counted (see Profiler::countRows()): its one row in the areas file, or all
+  of its values in a dataset.
+*/
+void Snapshot::countRejected(const SnapshotArea &record, std::uint32_t parser) const {
+    if(Profiler::rowCounts == nullptr) {
+        return;
+    }
+
+    if(parser == BethYw::AuthorityCodeCSV) {
+        Profiler::countRows(false);
+        return;
+    }
+
+    for(std::uint32_t s = record.firstSeries; s < record.firstSeries + record.seriesCount; s++) {
+        Profiler::countRows(false, series[s].valueCount);
+    }
+}
+
+/*
+  Replay one dataset into `areas`, mirroring the filtering done by the
+  populate…() function for its parser:
+    - AuthorityCodeCSV only creates Areas (with their names)
+    - WelshStatsJSON only adds a Measure if at least one year passes the
+      year filter, and only adds an Area if it has such a Measure
+    - AuthorityByYearCSV adds a Measure (maybe without values) whenever the
+      area and measure pass their filters
+*/
+void Snapshot::loadSection(Areas &areasOut,
+                           const SnapshotSection &section,
+                           const SnapshotQuery &query) const {
+    Tracer::Span span("import", "filter", Tracer::active() != nullptr ? text(section.code) : "");
+    verify(section);
+
+    for(std::uint32_t a = section.firstArea; a < section.firstArea + section.areaCount; a++) {
+        const SnapshotArea &record = areas[a];
+        if(!matches(record, query)) {
+            countRejected(record, section.parser);
+            continue;
+        }
+
+        std::string authorityCode = text(record.code);
+        Area area(authorityCode);
+        for(std::uint32_t n = record.firstName; n < record.firstName + record.nameCount; n++) {
+            area.setName(text(names[n].lang), text(names[n].value));
+        }
+
+        if(section.parser == BethYw::AuthorityCodeCSV) {
+            Profiler::countRows(true);
+            areasOut.setArea(authorityCode, area);
+            continue;
+        }
+
+        bool hasMeasures = false;
+        for(std::uint32_t s = record.firstSeries; s < record.firstSeries + record.seriesCount; s++) {
+            const SnapshotSeries &measureRecord = series[s];
+            if(!matches(measureRecord, query)) {
+                Profiler::countRows(false, measureRecord.valueCount);
+                continue;
+            }
+
+            Measure measure(text(measureRecord.code), text(measureRecord.label));
+            std::uint64_t kept = 0;
+            std::uint64_t end = measureRecord.firstValue + measureRecord.valueCount;
+            for(std::uint64_t v = measureRecord.firstValue; v < end; v++) {
+                if(query.yearsIncluded[yearIds[v]]) {
+                    measure.setValue(years[yearIds[v]], values[v]);
+                    kept++;
+                }
+            }
+            bool hasValues = kept > 0;
+
+            Profiler::countRows(true, kept);
+            Profiler::countRows(false, measureRecord.valueCount - kept);
+
+            if(section.parser == BethYw::WelshStatsJSON && !hasValues) {
+                continue;
+            }
+
+            area.setMeasure(measure.getCodename(), measure);
+            hasMeasures = true;
+        }
+
+        if(hasMeasures) {
+            areasOut.setArea(authorityCode, area);
+        }
+    }
+}
+
+/*
+  Add the values of a series in the query's years to those being merged,
+  setting where they are.
+*/
+void Snapshot::extractValues(AreaMerge &merge, MergedSeries &merged, const SnapshotQuery &query) const {
+    merged.first = merge.values.size();
+    std::uint64_t end = merged.series->firstValue + merged.series->valueCount;
+    for(std::uint64_t v = merged.series->firstValue; v < end; v++) {
+        if(query.yearsIncluded[yearIds[v]]) {
+            merge.values.emplace_back(years[yearIds[v]], values[v]);
+        }
+    }
+    merged.last = merge.values.size();
+    merged.fromIndex = false;
+}
+
+/*
+  Add the series of an area of one dataset that pass the query to those
+  being merged, with the same rules as loadSection(). When the values are
+  not wanted, a series with an index only has its statistics found for now.
+
+  @return
+    true if any series was added, i.e. loadSection() would add the area
+*/
+bool Snapshot::mergeSeries(AreaMerge &merge,
+                           const SnapshotArea &record,
+                           std::uint32_t parser,
+                           const SnapshotQuery &query) const {
+    bool added = false;
+    for(std::uint32_t s = record.firstSeries; s < record.firstSeries + record.seriesCount; s++) {
+        const SnapshotSeries &measureRecord = series[s];
+        if(!matches(measureRecord, query)) {
+            continue;
+        }
+
+        MergedSeries merged{&measureRecord, 0, 0, false, RangeStats()};
+        bool hasValues;
+        if(!merge.withValues && !indexes.empty() && indexes[s] != nullptr) {
+            merged.fromIndex = true;
+            hasValues = indexes[s]->stats(query.firstYear, query.lastYear, merged.stats);
+        } else {
+            extractValues(merge, merged, query);
+            hasValues = merged.last > merged.first;
+        }
+
+        if(parser == BethYw::WelshStatsJSON && !hasValues) {
+            continue;
+        }
+
+        merge.series.push_back(merged);
+        added = true;
+    }
+
+    return added;
+}
+
+/*
+  Set the names of an area of one dataset, replacing any in the same
+  language, as Areas::setArea() does.
+*/
+void Snapshot::mergeNames(SnapshotAreaView &view, const SnapshotArea &record) const {
+    for(std::uint32_t n = record.firstName; n < record.firstName + record.nameCount; n++) {
+        SnapshotText lang = str(names[n].lang);
+        SnapshotText value = str(names[n].value);
+
+        auto existing = std::find_if(view.names.begin(), view.names.end(),
+                                     [&lang](std::pair<std::string, std::string> const &name) {
+                                         return name.first.compare(0, std::string::npos,
+                                                                   lang.data, lang.size) == 0;
+                                     });
+        if(existing == view.names.end()) {
+            view.names.emplace_back(lang.str(), value.str());
+        } else {
+            existing->second.assign(value.data, value.size);
+        }
+    }
+}
+
+/*
+  Merge the next area of forEachArea() into `view`: the area with the lowest
+  code of those not yet merged from any of the sections, merged from every
+  section that has it in the order of the sections, as load() would. Areas
+  that load() would not add (because none of their sections pass the query)
+  are skipped.
+
+  @return
+    false once there are no areas left
+*/
+bool Snapshot::nextArea(AreaMerge &merge, const SnapshotQuery &query, SnapshotAreaView &view) const {
+    while(true) {
+        const SnapshotArea *lowest = nullptr;
+        for(std::size_t i = 0; i < merge.sections.size(); i++) {
+            const SnapshotSection &section = *merge.sections[i];
+            if(merge.next[i] < section.firstArea + section.areaCount
+               && (lowest == nullptr || less(areas[merge.next[i]].code, lowest->code))) {
+                lowest = &areas[merge.next[i]];
+            }
+        }
+
+        if(lowest == nullptr) {
+            return false;
+        }
+
+        //strings are stored once, so the same code has the same id in every
+        //section
+        std::uint32_t code = lowest->code;
+        bool added = false;
+        view.names.clear();
+        merge.series.clear();
+        merge.values.clear();
+
+        for(std::size_t i = 0; i < merge.sections.size(); i++) {
+            const SnapshotSection &section = *merge.sections[i];
+            if(merge.next[i] == section.firstArea + section.areaCount
+               || areas[merge.next[i]].code != code) {
+                continue;
+            }
+
+            const SnapshotArea &record = areas[merge.next[i]++];
+            if(!matches(record, query)) {
+                continue;
+            }
+
+            if(section.parser == BethYw::AuthorityCodeCSV || mergeSeries(merge, record, section.parser, query)) {
+                mergeNames(view, record);
+                added = true;
+            }
+        }
+
+        if(!added) {
+            continue;
+        }
+
+        view.code.assign(str(code).data, str(code).size);
+        std::sort(view.names.begin(), view.names.end());
+
+        //the series of each section are in order of code, so sorting them
+        //stably brings those of the same Measure together in section order
+        std::stable_sort(merge.series.begin(), merge.series.end(),
+                         [this](MergedSeries const &a, MergedSeries const &b) {
+                             return less(a.series->code, b.series->code);
+                         });
+
+        std::size_t measureCount = 0;
+        for(std::size_t s = 0; s < merge.series.size(); s++) {
+            measureCount += s == 0 || merge.series[s].series->code != merge.series[s - 1].series->code;
+        }
+        view.measures.resize(measureCount);
+
+        std::size_t m = 0;
+        for(std::size_t s = 0; s < merge.series.size(); m++) {
+            SnapshotMeasureView &measure = view.measures[m];
+            const MergedSeries &first = merge.series[s];
+            SnapshotText measureCode = str(first.series->code);
+            SnapshotText label = str(first.series->label);
+            measure.code.assign(measureCode.data, measureCode.size);
+            measure.label.assign(label.data, label.size);
+
+            std::size_t end = s + 1;
+            while(end < merge.series.size() && merge.series[end].series->code == first.series->code) {
+                end++;
+            }
+
+            //the statistics of a Measure from one dataset are those of its
+            //series, but merging several needs their values
+            if(end == s + 1 && first.fromIndex) {
+                measure.data.clear();
+                measure.stats = first.stats;
+                s = end;
+                continue;
+            }
+            for(std::size_t i = s; i < end; i++) {
+                if(merge.series[i].fromIndex) {
+                    extractValues(merge, merge.series[i], query);
+                }
+            }
+
+            measure.data.assign(merge.values.begin() + first.first, merge.values.begin() + first.last);
+
+            //the values of each later dataset replace those of the same year
+            for(s++; s < end; s++) {
+                auto later = merge.values.begin() + merge.series[s].first;
+                auto laterEnd = merge.values.begin() + merge.series[s].last;
+                auto earlier = measure.data.begin();
+
+                merge.merged.clear();
+                while(earlier != measure.data.end() || later != laterEnd) {
+                    if(later == laterEnd || (earlier != measure.data.end() && earlier->first < later->first)) {
+                        merge.merged.push_back(*earlier++);
+                    } else {
+                        if(earlier != measure.data.end() && earlier->first == later->first) {
+                            earlier++;
+                        }
+                        merge.merged.push_back(*later++);
+                    }
+                }
+                measure.data.swap(merge.merged);
+            }
+
+            measure.stats = RangeStats();
+            scanRangeStats(measure.data.begin(), measure.data.end(), measure.stats);
+        }
+
+        return true;
+    }
+}
+
+/*
+  Area keeps its names in an unordered_map, and the names are printed in the
+  order the map iterates them, which depends on the order they were
+  inserted. Find an order in which to store the names so that setting them
+  in that order when loading gives back the same iteration order.
+*/
+static std::vector<std::pair<std::string, std::string>> insertionOrder(
+        std::unordered_map<std::string, std::string> const &names) {
+    std::vector<std::pair<std::string, std::string>> iteration(names.begin(), names.end());
+    std::vector<std::pair<std::string, std::string>> reversed(iteration.rbegin(), iteration.rend());
+
+    for(auto const *attempt : {&reversed, &iteration}) {
+        std::unordered_map<std::string, std::string> rebuilt;
+        for(auto const &name : *attempt) {
+            rebuilt[name.first] = name.second;
+        }
+
+        bool same = std::equal(rebuilt.begin(), rebuilt.end(), iteration.begin(),
+                               [](std::pair<const std::string, std::string> const &lhs,
+                                  std::pair<std::string, std::string> const &rhs) {
+                                   return lhs.first == rhs.first && lhs.second == rhs.second;
+                               });
+        if(same) {
+            return *attempt;
+        }
+    }
+
+    return iteration;
+}
+
+std::uint32_t SnapshotWriter::intern(const std::string &s) {
+    auto found = stringIds.find(s);
+    if(found != stringIds.end()) {
+        return found->second;
+    }
+
+    auto id = static_cast<std::uint32_t>(strings.size());
+    strings.push_back(s);
+    stringIds.emplace(s, id);
+    return id;
+}
+
+/*
+  SnapshotWriter::addDataset(source, areas)
+
+  Add the result of importing one dataset (or areas.csv) to the snapshot.
+  The Areas must have been imported without any filters.
+
+  @param source
+    The dataset that was imported
+
+  @param areas
+    The unfiltered Areas parsed from the dataset
+
+  @example
+    SnapshotWriter writer;
+    Areas dataset = Areas();
+    ...
+    writer.addDataset(BethYw::InputFiles::POPDEN, dataset);
+*/
+void SnapshotWriter::addDataset(const BethYw::InputFileSource &source, Areas const &datasetAreas) {
+    AreasContainer const &container = datasetAreas.getAreas();
+
+    SnapshotSection section;
+    section.code = intern(source.CODE);
+    section.parser = static_cast<std::uint32_t>(source.PARSER);
+    section.firstArea = static_cast<std::uint32_t>(areas.size());
+    section.areaCount = static_cast<std::uint32_t>(container.size());
+    section.firstValue = valueCount;
+
+    for(auto const &element : container) {
+        Area const &area = element.second;
+
+        SnapshotArea record;
+        record.code = intern(element.first);
+        record.codeLower = intern(lowerString(element.first));
+        record.firstName = static_cast<std::uint32_t>(names.size());
+        record.nameCount = 0;
+        record.firstSeries = static_cast<std::uint32_t>(series.size());
+        record.seriesCount = 0;
+
+        for(auto const &name : insertionOrder(area.getNamesList())) {
+            names.push_back(SnapshotName{intern(name.first),
+                                         intern(name.second),
+                                         intern(lowerString(name.second))});
+            record.nameCount++;
+        }
+
+        for(auto const &measure : area.getMeasuresList()) {
+            PendingSeries pending;
+            for(auto const &value : measure.second.getData()) {
+                pending.values.emplace_back(value.first, value.second);
+            }
+
+            pending.record.code = intern(measure.second.getCodename());
+            pending.record.label = intern(measure.second.getLabel());
+            pending.record.labelLower = intern(lowerString(measure.second.getLabel()));
+            pending.record.valueCount = static_cast<std::uint32_t>(pending.values.size());
+            pending.record.firstValue = valueCount;
+            valueCount += pending.values.size();
+
+            series.push_back(std::move(pending));
+            record.seriesCount++;
+        }
+
+        areas.push_back(record);
+    }
+
+    section.valueCount = valueCount - section.firstValue;
+    section.checksum = 0;
+    sections.push_back(section);
+}
+
+/*
+  SnapshotWriter::finish()
+
+  Lay out everything added so far in the snapshot format.
+
+  @return
+    The bytes of the snapshot
+*/
+std::string SnapshotWriter::finish() const {
+    //the years dictionary
+    std::map<std::int32_t, std::uint16_t> yearIds;
+    for(auto const &pending : series) {
+        for(auto const &value : pending.values) {
+            yearIds.emplace(value.first, 0);
+        }
+    }
+
+    if(yearIds.size() > 0xffff) {
+        throw std::runtime_error("SnapshotWriter::finish: Too many distinct years");
+    }
+
+    std::uint16_t nextId = 0;
+    for(auto &year : yearIds) {
+        year.second = nextId++;
+    }
+
+    std::uint64_t stringBytes = 0;
+    for(auto const &s : strings) {
+        stringBytes += s.size();
+    }
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.stringCount = static_cast<std::uint32_t>(strings.size());
+    header.yearCount = static_cast<std::uint32_t>(yearIds.size());
+    header.sectionCount = static_cast<std::uint32_t>(sections.size());
+    header.areaCount = static_cast<std::uint32_t>(areas.size());
+    header.nameCount = static_cast<std::uint32_t>(names.size());
+    header.seriesCount = static_cast<std::uint32_t>(series.size());
+    header.valueCount = valueCount;
+
+    header.stringOffsetsPos = align8(sizeof(SnapshotHeader));
+    header.stringDataPos = align8(header.stringOffsetsPos + (strings.size() + 1) * sizeof(std::uint32_t));
+    header.yearsPos = align8(header.stringDataPos + stringBytes);
+    header.sectionsPos = align8(header.yearsPos + yearIds.size() * sizeof(std::int32_t));
+    header.areasPos = align8(header.sectionsPos + sections.size() * sizeof(SnapshotSection));
+    header.namesPos = align8(header.areasPos + areas.size() * sizeof(SnapshotArea));
+    header.seriesPos = align8(header.namesPos + names.size() * sizeof(SnapshotName));
+    header.valuesPos = align8(header.seriesPos + series.size() * sizeof(SnapshotSeries));
+    header.yearIdsPos = align8(header.valuesPos + valueCount * sizeof(double));
+    header.size = align8(header.yearIdsPos + valueCount * sizeof(std::uint16_t));
+
+    std::string out(static_cast<std::size_t>(header.size), '\0');
+    char *base = &out[0];
+
+    std::uint32_t offset = 0;
+    auto *offsets = reinterpret_cast<std::uint32_t *>(base + header.stringOffsetsPos);
+    for(std::size_t i = 0; i < strings.size(); i++) {
+        offsets[i] = offset;
+        std::memcpy(base + header.stringDataPos + offset, strings[i].data(), strings[i].size());
+        offset += static_cast<std::uint32_t>(strings[i].size());
+    }
+    offsets[strings.size()] = offset;
+
+    auto *yearsOut = reinterpret_cast<std::int32_t *>(base + header.yearsPos);
+    for(auto const &year : yearIds) {
+        yearsOut[year.second] = year.first;
+    }
+
+    if(!areas.empty()) {
+        std::memcpy(base + header.areasPos, areas.data(), areas.size() * sizeof(SnapshotArea));
+    }
+    if(!names.empty()) {
+        std::memcpy(base + header.namesPos, names.data(), names.size() * sizeof(SnapshotName));
+    }
+
+    auto *seriesOut = reinterpret_cast<SnapshotSeries *>(base + header.seriesPos);
+    auto *valuesOut = reinterpret_cast<double *>(base + header.valuesPos);
+    auto *yearIdsOut = reinterpret_cast<std::uint16_t *>(base + header.yearIdsPos);
+    for(std::size_t s = 0; s < series.size(); s++) {
+        seriesOut[s] = series[s].record;
+
+        std::uint64_t v = series[s].record.firstValue;
+        for(auto const &value : series[s].values) {
+            valuesOut[v] = value.second;
+            yearIdsOut[v] = yearIds.at(value.first);
+            v++;
+        }
+    }
+
+    auto *sectionsOut = reinterpret_cast<SnapshotSection *>(base + header.sectionsPos);
+    for(std::size_t i = 0; i < sections.size(); i++) {
+        sectionsOut[i] = sections[i];
+        sectionsOut[i].checksum = checksum(sections[i], valuesOut, yearIdsOut);
+    }
+
+    header.checksum = checksum(header, base);
+    std::memcpy(base, &header, sizeof(header));
+
+    return out;
+}
+
+/*
+  SnapshotWriter::write(path)
+
+  Write the snapshot to a file.
+
+  @param path
+    The path of the snapshot file
+
+  @throws
+    std::runtime_error if the file cannot be written
+*/
+void SnapshotWriter::write(const std::string &path) const {
+    save(path, finish());
+}
+
+/*
+  SnapshotWriter::save(path, bytes)
+
+  Write the bytes of a snapshot to a file. They are written to a temporary
+  file first and then renamed, so readers never see a half-written snapshot.
+
+  @param path
+    The path of the snapshot file
+
+  @param bytes
+    The snapshot, as returned by finish()
+
+  @throws
+    std::runtime_error if the file cannot be written
+*/
+void SnapshotWriter::save(const std::string &path, const std::string &bytes) {
+    std::string temporary = path + ".tmp";
+
+    {
+        std::ofstream file(temporary, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if(!file) {
+            throw std::runtime_error("SnapshotWriter::write: Failed to write file " + temporary);
+        }
+    }
+
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        throw std::runtime_error("SnapshotWriter::write: Failed to write file " + path);
+    }
+}
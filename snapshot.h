@@ -0,0 +1,452 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the declarations for the binary snapshot format. A
+  snapshot holds the unfiltered result of importing areas.csv and a number
+  of datasets, so that later runs can skip parsing the JSON/CSV files.
+
+  The file is laid out as a fixed header followed by flat arrays of the
+  records below, so it can be used straight from a memory mapping:
+
+    SnapshotHeader
+    string offsets  uint32[stringCount + 1]
+    string data     char[]
+    years           int32[yearCount]           (sorted)
+    sections        SnapshotSection[sectionCount]
+    areas           SnapshotArea[areaCount]
+    names           SnapshotName[nameCount]
+    series          SnapshotSeries[seriesCount]
+    values          double[valueCount]
+    year ids        uint16[valueCount]         (index into years)
+
+  Every string (codes, names, labels, and their lowercase forms used for
+  filtering) is stored once in the string dictionary and referred to by id.
+  Each dataset is a section with its own areas, because each dataset file
+  can name the same area differently, and each area points at the series
+  (one per Measure) that dataset has for it. The values of each series are
+  a contiguous run of the two value columns.
+
+  Numbers are stored in the byte order of the machine that wrote the file;
+  a snapshot from a machine with a different byte order is rejected.
+
+  The header checksum covers the header and the arrays before the values,
+  so that opening a snapshot does not read the values and year ids, which
+  are most of the file. Every offset, id and count in that part is checked
+  against the size of the file when it is opened, and a year id is only
+  used to look up a year once the query has included it, so a corrupt (or
+  hand-made) snapshot cannot make a read outside the file.
+
+  The values and year ids of each section (which are contiguous) have a
+  checksum of their own, kept in the section. It is checked the first time
+  the section's values are used, so opening the file stays as cheap as
+  mapping it, and a dataset that is never queried is never read. A section
+  whose values do not match its checksum cannot be loaded or queried.
+
+  In server and batch mode the snapshot also builds a MeasureIndex over the
+  values of each series (see Snapshot::buildIndexes()), so the statistics
+  of a series in any window of years are found without reading its values.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "areas.h"
+#include "datasets.h"
+#include "measureindex.h"
+
+constexpr char SNAPSHOT_MAGIC[8] = {'B', 'E', 'T', 'H', 'Y', 'W', 'S', 'N'};
+constexpr std::uint32_t SNAPSHOT_VERSION = 3;
+constexpr std::uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t size;      // of the whole file, including this header
+    std::uint64_t checksum;  // FNV-1a of this header (with this as 0) up to valuesPos
+
+    std::uint32_t stringCount;
+    std::uint32_t yearCount;
+    std::uint32_t sectionCount;
+    std::uint32_t areaCount;
+    std::uint32_t nameCount;
+    std::uint32_t seriesCount;
+    std::uint64_t valueCount;
+
+    std::uint64_t stringOffsetsPos;
+    std::uint64_t stringDataPos;
+    std::uint64_t yearsPos;
+    std::uint64_t sectionsPos;
+    std::uint64_t areasPos;
+    std::uint64_t namesPos;
+    std::uint64_t seriesPos;
+    std::uint64_t valuesPos;
+    std::uint64_t yearIdsPos;
+};
+
+// One imported dataset (or areas.csv), whose series have their values in
+// [firstValue, firstValue + valueCount)
+struct SnapshotSection {
+    std::uint32_t code;       // the InputFileSource CODE
+    std::uint32_t parser;     // the BethYw::SourceDataType it was parsed with
+    std::uint32_t firstArea;
+    std::uint32_t areaCount;
+    std::uint64_t firstValue;
+    std::uint64_t valueCount;
+    std::uint64_t checksum;   // FNV-1a of the values, then the year ids
+};
+
+// An Area as imported from one dataset
+struct SnapshotArea {
+    std::uint32_t code;
+    std::uint32_t codeLower;
+    std::uint32_t firstName;
+    std::uint32_t nameCount;
+    std::uint32_t firstSeries;
+    std::uint32_t seriesCount;
+};
+
+// A name of an Area in one language
+struct SnapshotName {
+    std::uint32_t lang;
+    std::uint32_t value;
+    std::uint32_t valueLower;
+};
+
+// A Measure of an Area, with its values in [firstValue, firstValue + valueCount)
+struct SnapshotSeries {
+    std::uint32_t code;       // already lowercase, as Measure stores it
+    std::uint32_t label;
+    std::uint32_t labelLower;
+    std::uint32_t valueCount;
+    std::uint64_t firstValue;
+};
+
+// A string in the snapshot's dictionary, which is not null-terminated
+struct SnapshotText {
+    const char *data;
+    std::size_t size;
+
+    std::string str() const { return std::string(data, size); }
+};
+
+/*
+  The filters of one query, prepared for a particular Snapshot with
+  Snapshot::prepare().
+*/
+struct SnapshotQuery {
+    StringFilterSet const *areasFilter;
+    StringFilterSet const *measuresFilter;
+    std::vector<bool> yearsIncluded;  // indexed by year id, false past the years
+    int firstYear;                    // the window of the years included
+    int lastYear;
+};
+
+/*
+  A Measure of an area as loading the datasets of a query would leave it:
+  the values of every dataset with the Measure, later datasets replacing
+  those of earlier ones in the same year, and the label of the first. The
+  statistics of the values are always set, but the values themselves may be
+  left out when they were not asked for (see Snapshot::forEachArea()).
+*/
+struct SnapshotMeasureView {
+    std::string code;
+    std::string label;
+    std::vector<std::pair<int, MeasureDataType>> data;  // by year
+    RangeStats stats;                                   // count 0 if no values
+};
+
+/*
+  An Area as loading the datasets of a query would leave it (see
+  Snapshot::forEachArea()), with the names of later datasets replacing those
+  of earlier ones in the same language.
+*/
+struct SnapshotAreaView {
+    std::string code;
+    std::vector<std::pair<std::string, std::string>> names;  // by language
+    std::vector<SnapshotMeasureView> measures;                // by code
+};
+
+/*
+  The code, Measures, label, values and statistics of an area or Measure,
+  whether of an Areas object or of a snapshot view, so that code that goes
+  through the areas of either (see Aggregation and Ranking) is written once.
+  statsOf() and spanOf() return false for a Measure with no values.
+*/
+inline std::string const &codeOf(std::pair<const std::string, Area> const &area) {
+    return area.first;
+}
+
+inline std::map<std::string, Measure> const &measuresOf(std::pair<const std::string, Area> const &area) {
+    return area.second.getMeasuresList();
+}
+
+inline std::string const &codeOf(std::pair<const std::string, Measure> const &measure) {
+    return measure.first;
+}
+
+inline std::string const &labelOf(std::pair<const std::string, Measure> const &measure) {
+    return measure.second.getLabel();
+}
+
+inline std::map<int, MeasureDataType> const &dataOf(std::pair<const std::string, Measure> const &measure) {
+    return measure.second.getData();
+}
+
+inline bool statsOf(std::pair<const std::string, Measure> const &measure, RangeStats &stats) {
+    return measure.second.getRangeStats(std::numeric_limits<int>::min(),
+                                        std::numeric_limits<int>::max(),
+                                        stats);
+}
+
+inline bool spanOf(std::pair<const std::string, Measure> const &measure, int &firstYear, int &lastYear) {
+    auto const &data = measure.second.getData();
+    if(data.empty()) {
+        return false;
+    }
+    firstYear = data.begin()->first;
+    lastYear = data.rbegin()->first;
+    return true;
+}
+
+inline std::string const &codeOf(SnapshotAreaView const &area) {
+    return area.code;
+}
+
+inline std::vector<SnapshotMeasureView> const &measuresOf(SnapshotAreaView const &area) {
+    return area.measures;
+}
+
+inline std::string const &codeOf(SnapshotMeasureView const &measure) {
+    return measure.code;
+}
+
+inline std::string const &labelOf(SnapshotMeasureView const &measure) {
+    return measure.label;
+}
+
+inline std::vector<std::pair<int, MeasureDataType>> const &dataOf(SnapshotMeasureView const &measure) {
+    return measure.data;
+}
+
+inline bool statsOf(SnapshotMeasureView const &measure, RangeStats &stats) {
+    if(measure.stats.count == 0) {
+        return false;
+    }
+    stats = measure.stats;
+    return true;
+}
+
+inline bool spanOf(SnapshotMeasureView const &measure, int &firstYear, int &lastYear) {
+    if(measure.stats.count == 0) {
+        return false;
+    }
+    firstYear = measure.stats.firstYear;
+    lastYear = measure.stats.lastYear;
+    return true;
+}
+
+/*
+  A read-only snapshot, either memory mapped from a file or held in memory.
+  Loading from a snapshot applies the same area, measure and year filters as
+  the parsers in areas.cpp, so the Areas it produces are the same as those
+  from parsing the source files.
+
+  A Snapshot never changes once it is opened and its indexes (if any) are
+  built, so any number of threads can then use it at the same time without
+  synchronisation. Besides loading into an Areas object, it can be queried
+  in place: prepare() a query once, then forEachArea() visits the areas that
+  loading it would give, merged across the datasets, without building an
+  Areas object or any of its maps.
+*/
+class Snapshot {
+public:
+    static std::shared_ptr<Snapshot> open(const std::string &path);
+    static std::shared_ptr<Snapshot> fromBytes(std::string bytes);
+
+    Snapshot(Snapshot const &) = delete;
+    Snapshot &operator=(Snapshot const &) = delete;
+    ~Snapshot();
+
+    bool hasDataset(const std::string &code) const;
+    void verifyDataset(const std::string &code) const;
+
+    void buildIndexes();
+
+    void load(Areas &areas,
+              std::vector<BethYw::InputFileSource> const &datasets,
+              StringFilterSet const &areasFilter,
+              StringFilterSet const &measuresFilter,
+              YearFilterTuple const &yearsFilter) const;
+
+    void loadDataset(Areas &areas,
+                     const std::string &code,
+                     StringFilterSet const &areasFilter,
+                     StringFilterSet const &measuresFilter,
+                     YearFilterTuple const &yearsFilter) const;
+
+    SnapshotQuery prepare(StringFilterSet const &areasFilter,
+                          StringFilterSet const &measuresFilter,
+                          YearFilterTuple const &yearsFilter) const;
+
+    bool matches(const SnapshotArea &area, const SnapshotQuery &query) const;
+    bool matches(const SnapshotSeries &series, const SnapshotQuery &query) const;
+
+    /*
+      Call `visit(area)` with every area that load() would give for the
+      same datasets and query, in order of code, each with the names and
+      Measures that load() would merge into it from areas.csv and the
+      datasets. The area is only valid during the call, as its buffers are
+      reused for the next.
+
+      Without `withValues`, a Measure that is in only one of the datasets
+      has its statistics found from the index of its series, if the indexes
+      have been built, and is visited without its values.
+
+      @throws
+        std::runtime_error if a dataset is not in the snapshot, or its
+        values do not match their checksum
+    */
+    template <typename Visitor>
+    void forEachArea(std::vector<BethYw::InputFileSource> const &datasets,
+                     const SnapshotQuery &query,
+                     bool withValues,
+                     Visitor &&visit) const {
+        AreaMerge merge;
+        merge.withValues = withValues;
+        merge.sections = sectionsOf(datasets);
+        merge.next.resize(merge.sections.size());
+        for(std::size_t i = 0; i < merge.sections.size(); i++) {
+            verify(*merge.sections[i]);
+            merge.next[i] = merge.sections[i]->firstArea;
+        }
+
+        SnapshotAreaView area;
+        while(nextArea(merge, query, area)) {
+            visit(static_cast<const SnapshotAreaView &>(area));
+        }
+    }
+
+private:
+    // a series of an area that forEachArea() merges, with its values in
+    // the query's years at [first, last) of AreaMerge::values, or only
+    // their statistics (from its index) if `fromIndex`
+    struct MergedSeries {
+        const SnapshotSeries *series;
+        std::size_t first;
+        std::size_t last;
+        bool fromIndex;
+        RangeStats stats;
+    };
+
+    // how far forEachArea() has got through each section it merges, and the
+    // buffers it reuses from one area to the next
+    struct AreaMerge {
+        bool withValues;
+        std::vector<const SnapshotSection *> sections;
+        std::vector<std::uint32_t> next;
+        std::vector<MergedSeries> series;
+        std::vector<std::pair<int, MeasureDataType>> values;
+        std::vector<std::pair<int, MeasureDataType>> merged;
+    };
+
+    Snapshot() = default;
+    void validate();
+
+    std::string owned;
+    void *mapping = nullptr;
+    std::size_t mappingSize = 0;
+
+    const char *data = nullptr;
+    std::size_t size = 0;
+    const SnapshotHeader *header = nullptr;
+
+    const std::uint32_t *stringOffsets = nullptr;
+    const char *stringData = nullptr;
+    const std::int32_t *years = nullptr;
+    const SnapshotSection *sections = nullptr;
+    const SnapshotArea *areas = nullptr;
+    const SnapshotName *names = nullptr;
+    const SnapshotSeries *series = nullptr;
+    const double *values = nullptr;
+    const std::uint16_t *yearIds = nullptr;
+
+    // whether the values of each section have been checked against its
+    // checksum: 0 if not yet, 1 if they match, 2 if not
+    std::unique_ptr<std::atomic<std::uint8_t>[]> verified;
+
+    // the index of each series, by position in `series`, once built; a
+    // series whose years are not in order has none
+    std::vector<std::shared_ptr<const MeasureIndex>> indexes;
+
+    std::string text(std::uint32_t id) const;
+    SnapshotText str(std::uint32_t id) const;
+    bool less(std::uint32_t lhs, std::uint32_t rhs) const;
+    bool contains(std::uint32_t lowerId, const std::string &needle) const;
+    bool matchesArea(StringFilterSet const &filter, const SnapshotArea &area) const;
+    bool matchesSeries(StringFilterSet const &filter, const SnapshotSeries &series) const;
+    const SnapshotSection *findSection(const std::string &code) const;
+    std::vector<const SnapshotSection *> sectionsOf(
+            std::vector<BethYw::InputFileSource> const &datasets) const;
+    void verify(const SnapshotSection &section) const;
+    std::shared_ptr<const MeasureIndex> indexSeries(const SnapshotSeries &s) const;
+    void countRejected(const SnapshotArea &record, std::uint32_t parser) const;
+    void loadSection(Areas &areas,
+                     const SnapshotSection &section,
+                     const SnapshotQuery &query) const;
+    void extractValues(AreaMerge &merge, MergedSeries &merged, const SnapshotQuery &query) const;
+    bool mergeSeries(AreaMerge &merge,
+                     const SnapshotArea &record,
+                     std::uint32_t parser,
+                     const SnapshotQuery &query) const;
+    void mergeNames(SnapshotAreaView &view, const SnapshotArea &record) const;
+    bool nextArea(AreaMerge &merge, const SnapshotQuery &query, SnapshotAreaView &view) const;
+};
+
+/*
+  Builds a snapshot from the unfiltered Areas imported from each dataset.
+*/
+class SnapshotWriter {
+public:
+    SnapshotWriter() = default;
+
+    void addDataset(const BethYw::InputFileSource &source, Areas const &areas);
+    std::string finish() const;
+    void write(const std::string &path) const;
+
+    static void save(const std::string &path, const std::string &bytes);
+
+private:
+    struct PendingSeries {
+        SnapshotSeries record;
+        std::vector<std::pair<std::int32_t, double>> values;
+    };
+
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, std::uint32_t> stringIds;
+
+    std::vector<SnapshotSection> sections;
+    std::vector<SnapshotArea> areas;
+    std::vector<SnapshotName> names;
+    std::vector<PendingSeries> series;
+    std::uint64_t valueCount = 0;
+
+    std::uint32_t intern(const std::string &s);
+};
+
+#endif // SNAPSHOT_H_
@@ -0,0 +1,355 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the TableWriter class.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iterator>
+
+#include "areas.h"
+#include "tablewriter.h"
+#include "threadpool.h"
+#include "trace.h"
+
+/*
+  TableWriter::TableWriter(os)
+
+  Create a writer. Output is buffered, and written to `os` in large blocks
+  when the buffer is full, on flush() and when the writer is destroyed.
+
+  @param os
+    The stream to write the tables to
+*/
+TableWriter::TableWriter(std::ostream &os) : os(&os), buffer(BUFFER_SIZE) {}
+
+/*
+  TableWriter::TableWriter(out)
+
+  Create a writer that appends the tables to a string instead of writing
+  them to a stream.
+
+  @param out
+    The string to append the tables to
+*/
+TableWriter::TableWriter(std::string &out) : out(&out), buffer(BUFFER_SIZE) {}
+
+TableWriter::~TableWriter() {
+    flush();
+}
+
+/*
+  Write the buffered output to the stream.
+*/
+void TableWriter::flush() {
+    if(used > 0) {
+        if(os != nullptr) {
+            os->write(buffer.data(), static_cast<std::streamsize>(used));
+        } else {
+            out->append(buffer.data(), used);
+        }
+        used = 0;
+    }
+}
+
+/*
+  Write a block of already rendered output, without copying it into the
+  buffer.
+*/
+void TableWriter::block(std::string const &text) {
+    flush();
+    if(os != nullptr) {
+        os->write(text.data(), static_cast<std::streamsize>(text.size()));
+    } else {
+        out->append(text);
+    }
+}
+
+void TableWriter::append(const char *text, std::size_t length) {
+    std::memcpy(reserve(length), text, length);
+    used += length;
+}
+
+/*
+  Write `text` right-aligned in a column of WIDTH characters. Text wider
+  than the column is written in full.
+*/
+void TableWriter::cell(const char *text, std::size_t length) {
+    std::size_t padding = length < WIDTH ? WIDTH - length : 0;
+    char *out = reserve(padding + length);
+
+    std::memset(out, ' ', padding);
+    std::memcpy(out + padding, text, length);
+    used += padding + length;
+}
+
+void TableWriter::integerCell(int number) {
+    char digits[16];
+    int length = std::snprintf(digits, sizeof(digits), "%d", number);
+    cell(digits, static_cast<std::size_t>(length));
+}
+
+/*
+  Write a value as a stream would with std::fixed and a precision of
+  PRECISION, i.e. as "%.6f" does: rounded to the nearest multiple of 10^-6,
+  with exact ties rounded to even.
+
+  For values below 10^9 the rounded value is worked out as an integer
+  number of millionths: the product `number * 10^6` is within half a unit in
+  the last place of the exact product, so rounding it gives the same integer
+  unless the exact product could be on the other side of a tie. Only values
+  that close to a tie, and larger values, are formatted by snprintf().
+*/
+void TableWriter::numberCell(double number) {
+    static_assert(PRECISION == 6, "the fast path counts in millionths");
+
+    if(std::fabs(number) < 1e9) {
+        double scaled = std::fabs(number) * 1e6;
+        double rounded = std::nearbyint(scaled);
+        double ulp = std::nextafter(scaled, HUGE_VAL) - scaled;
+
+        if(std::fabs(std::fabs(scaled - rounded) - 0.5) > ulp) {
+            char digits[32];
+            char *end = digits + sizeof(digits);
+            char *start = end;
+
+            auto millionths = static_cast<unsigned long long>(rounded);
+            for(int i = 0; i < PRECISION; i++) {
+                *--start = static_cast<char>('0' + millionths % 10);
+                millionths /= 10;
+            }
+            *--start = '.';
+            do {
+                *--start = static_cast<char>('0' + millionths % 10);
+                millionths /= 10;
+            } while(millionths > 0);
+
+            if(std::signbit(number)) {
+                *--start = '-';
+            }
+
+            cell(start, static_cast<std::size_t>(end - start));
+            return;
+        }
+    }
+
+    char digits[352];
+    int length = std::snprintf(digits, sizeof(digits), "%.*f", PRECISION, number);
+    cell(digits, static_cast<std::size_t>(length));
+}
+
+/*
+  TableWriter::write(measure)
+
+  Render a Measure: a line with its label and code, then a row with each
+  year and the "Average", "Diff." and "% Diff." headings, and a row with the
+  value for each year and those three statistics. A Measure with no values
+  gets "<no data>" instead of the two rows.
+
+  @param measure
+    The Measure to render
+*/
+void TableWriter::write(Measure const &measure) {
+    std::string const &label = measure.getLabel();
+    std::string const &code = measure.getCodename();
+
+    put('\n');
+    append(label.data(), label.size());
+    append(" (", 2);
+    append(code.data(), code.size());
+    append(")\n", 2);
+
+    if(measure.size() > 0) {
+        auto const &data = measure.getData();
+
+        for(auto const &element : data) {
+            integerCell(element.first);
+        }
+        cell("Average", 7);
+        cell("Diff.", 5);
+        cell("% Diff.\n", 8);
+
+        for(auto const &element : data) {
+            numberCell(element.second);
+        }
+        numberCell(measure.getAverage());
+        numberCell(measure.getDifference());
+        numberCell(measure.getDifferenceAsPercentage());
+    } else {
+        append("<no data>", 9);
+    }
+
+    put('\n');
+}
+
+/*
+  TableWriter::write(area)
+
+  Render an Area: its names separated by " / " and followed by its code (or
+  "Unnamed"), then each of its Measures followed by a blank line, or
+  "<no measures>" if it has none.
+
+  @param area
+    The Area to render
+*/
+void TableWriter::write(Area const &area) {
+    auto const &names = area.getNamesList();
+
+    if(names.empty()) {
+        append("Unnamed\n", 8);
+    } else {
+        std::size_t i = 0;
+        for(auto const &element : names) {
+            append(element.second.data(), element.second.size());
+
+            //more names to come, or the last one followed by the code
+            if(++i < names.size()) {
+                append(" / ", 3);
+            } else {
+                std::string const &code = area.getLocalAuthorityCode();
+                append(" (", 2);
+                append(code.data(), code.size());
+                put(')');
+            }
+        }
+    }
+
+    if(area.size() == 0) {
+        append("\n<no measures>\n", 15);
+    } else {
+        for(auto const &element : area.getMeasuresList()) {
+            write(element.second);
+            put('\n');
+        }
+    }
+}
+
+/*
+  TableWriter::write(areas)
+
+  Render every Area in order of their authority codes, or "<No areas>" if
+  there are none.
+
+  @param areas
+    The Areas to render
+*/
+void TableWriter::write(Areas const &areas) {
+    if(areas.size() == 0) {
+        append("<No areas>\n", 11);
+        return;
+    }
+
+    for(auto const &element : areas.getAreas()) {
+        write(element.second);
+    }
+}
+
+/*
+  TableWriter::write(areas, pool)
+
+  Render every Area as write(areas) does, but on the workers of `pool`. The
+  areas are split into contiguous chunks, a few for each worker so that
+  uneven chunks even out, and each chunk is rendered into its own string.
+  The strings are written in order of the areas' authority codes, so the
+  output is the same as that of write(areas). At most two chunks for each
+  worker are rendered ahead of the one being written, which bounds the
+  memory held in rendered chunks.
+
+  Too few areas to give every worker at least MIN_CHUNK_AREAS, or a pool
+  with one worker, are rendered on this thread.
+
+  This must not be called from one of the workers of `pool`, which would
+  wait on itself.
+
+  @param areas
+    The Areas to render
+
+  @param pool
+    The workers to render the chunks on
+
+  @throws
+    Any exception thrown whilst rendering a chunk
+*/
+void TableWriter::write(Areas const &areas, ThreadPool &pool) {
+    auto const &all = areas.getAreas();
+    std::size_t workers = pool.size();
+
+    if(workers < 2 || all.size() < 2 * MIN_CHUNK_AREAS) {
+        write(areas);
+        return;
+    }
+
+    std::size_t chunks = std::min(workers * 4, all.size() / MIN_CHUNK_AREAS);
+    std::size_t window = workers * 2;
+
+    using Position = decltype(all.begin());
+    std::vector<Position> bounds;
+    bounds.reserve(chunks + 1);
+
+    Position position = all.begin();
+    for(std::size_t i = 0; i < chunks; i++) {
+        bounds.push_back(position);
+        std::advance(position, all.size() * (i + 1) / chunks - all.size() * i / chunks);
+    }
+    bounds.push_back(all.end());
+
+    std::deque<std::future<std::string>> rendering;
+    std::size_t next = 0;
+
+    auto submitNext = [&]() {
+        Position first = bounds[next];
+        Position last = bounds[next + 1];
+        next++;
+
+        rendering.push_back(pool.submit([first, last]() {
+            Tracer::Span span("output", "render chunk");
+            std::string rendered;
+            {
+                TableWriter chunk(rendered);
+                for(Position it = first; it != last; ++it) {
+                    chunk.write(it->second);
+                }
+            }
+            return rendered;
+        }));
+    };
+
+    while(next < chunks && rendering.size() < window) {
+        submitNext();
+    }
+
+    try {
+        while(!rendering.empty()) {
+            std::string rendered;
+            {
+                Tracer::Span waiting("output", "wait for chunk");
+                rendered = rendering.front().get();
+            }
+            rendering.pop_front();
+
+            if(next < chunks) {
+                submitNext();
+            }
+
+            block(rendered);
+        }
+    } catch(...) {
+        //the chunks still rendering refer to `areas`, so let them finish
+        for(auto &chunk : rendering) {
+            chunk.wait();
+        }
+        throw;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef TABLEWRITER_H_
+#define TABLEWRITER_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the TableWriter class, which renders Areas, Area and
+  Measure objects as the text tables printed by Beth Yw? (see the stream
+  output operators in areas.cpp, area.cpp and measure.cpp, which use it).
+
+  Rather than setting the width and precision of an output stream for every
+  cell, the tables are formatted into a buffer: columns are padded with a
+  memset, numbers are formatted straight into the buffer, and the buffer is
+  written to the stream in large blocks.
+
+  A large Areas object can also be rendered on a ThreadPool: each chunk of
+  areas is rendered into its own buffer by a worker, and the buffers are
+  written to the stream in order of the areas' authority codes.
+ */
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Area;
+class Areas;
+class Measure;
+class ThreadPool;
+
+class TableWriter {
+public:
+    static constexpr std::size_t BUFFER_SIZE = 1 << 16;
+
+    // the width of every column, and the number of decimal places of values
+    static constexpr std::size_t WIDTH = 15;
+    static constexpr int PRECISION = 6;
+
+    // the fewest areas rendered by each task when rendering on a ThreadPool
+    static constexpr std::size_t MIN_CHUNK_AREAS = 8;
+
+    explicit TableWriter(std::ostream &os);
+    explicit TableWriter(std::string &out);
+    ~TableWriter();
+
+    TableWriter(TableWriter const &) = delete;
+    TableWriter &operator=(TableWriter const &) = delete;
+
+    void write(Areas const &areas);
+    void write(Areas const &areas, ThreadPool &pool);
+    void write(Area const &area);
+    void write(Measure const &measure);
+
+    void flush();
+
+private:
+    // where the output goes: a stream, or the end of a string
+    std::ostream *os = nullptr;
+    std::string *out = nullptr;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+
+    // make sure there is room for `length` more bytes in the buffer
+    char *reserve(std::size_t length) {
+        if(length > buffer.size() - used) {
+            flush();
+            if(length > buffer.size()) {
+                buffer.resize(length);
+            }
+        }
+        return buffer.data() + used;
+    }
+
+    void put(char c) {
+        *reserve(1) = c;
+        used++;
+    }
+
+    void append(const char *text, std::size_t length);
+    void block(std::string const &text);
+    void cell(const char *text, std::size_t length);
+    void integerCell(int number);
+    void numberCell(double number);
+};
+
+#endif // TABLEWRITER_H_
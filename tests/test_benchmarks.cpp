@@ -0,0 +1,366 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  Catch2 benchmarks of the parsers, merges, filters, Measure statistics,
+  aggregations, rankings, value conditions and output renderers, on the
+  bundled dataset files. What they time is tested in test_correctness.cpp.
+  Build and run them with:
+
+    ./build.sh test_benchmarks
+    ./bin/bethyw-test
+
+  from the root of the project (or from bin/). Catch2 reports the mean and
+  standard deviation of each benchmark, over 100 samples by default; pass
+  e.g. --benchmark-samples 20 to take fewer, or a tag (e.g. "[parse]") to
+  run only some of the benchmarks. The AQI dataset is left out, as it
+  cannot be parsed yet.
+ */
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../lib_catch.hpp"
+
+#include "../aggregate.h"
+#include "../areas.h"
+#include "../datasets.h"
+#include "../measure.h"
+#include "../measureindex.h"
+#include "../predicate.h"
+#include "../ranking.h"
+
+namespace {
+
+/*
+  Read a file of the datasets directory, whether the benchmarks are run from
+  the root of the project or from bin/.
+*/
+std::string readDataset(std::string const &file) {
+    for(const char *dir : {"datasets/", "../datasets/"}) {
+        std::ifstream in(dir + file, std::ios_base::in | std::ios_base::binary);
+        if(in) {
+            std::ostringstream contents;
+            contents << in.rdbuf();
+            return contents.str();
+        }
+    }
+
+    FAIL("Could not find dataset file " << file);
+    return "";
+}
+
+/*
+  Parse a dataset with the populateFrom*() function for its parser, with
+  the given filters.
+*/
+void parse(Areas &areas,
+           BethYw::InputFileSource const &src,
+           std::string const &contents,
+           StringFilterSet const &areasFilter,
+           StringFilterSet const &measuresFilter,
+           YearFilterTuple const &yearsFilter) {
+    std::istringstream stream(contents);
+
+    switch(src.PARSER) {
+        case BethYw::AuthorityCodeCSV:
+            areas.populateFromAuthorityCodeCSV(stream, src.COLS, &areasFilter);
+            break;
+        case BethYw::WelshStatsJSON:
+            areas.populateFromWelshStatsJSON(stream, src.COLS,
+                                             &areasFilter, &measuresFilter, &yearsFilter);
+            break;
+        case BethYw::AuthorityByYearCSV:
+            areas.populateFromAuthorityByYearCSV(stream, src.COLS,
+                                                 &areasFilter, &measuresFilter, &yearsFilter);
+            break;
+        default:
+            FAIL("No parser for dataset " << src.CODE);
+    }
+}
+
+/*
+  The bundled datasets, optionally preceded by the areas file.
+*/
+std::vector<BethYw::InputFileSource> benchmarkedDatasets(bool withAreas = false) {
+    std::vector<BethYw::InputFileSource> datasets;
+    if(withAreas) {
+        datasets.push_back(BethYw::InputFiles::AREAS);
+    }
+    for(auto const &src : BethYw::InputFiles::DATASETS) {
+        if(src.CODE != BethYw::InputFiles::AQI.CODE) {
+            datasets.push_back(src);
+        }
+    }
+    return datasets;
+}
+
+/*
+  Every bundled dataset (and the areas file) parsed without filters into a
+  single Areas object, parsed once and shared by the benchmarks.
+*/
+Areas const &loadAll() {
+    static Areas all = []() {
+        StringFilterSet none;
+        YearFilterTuple allYears(0, 0);
+
+        Areas merged;
+        for(auto const &src : benchmarkedDatasets(true)) {
+            Areas parsed;
+            parse(parsed, src, readDataset(src.FILE), none, none, allYears);
+            merged.merge(parsed);
+        }
+        return merged;
+    }();
+
+    return all;
+}
+
+} // namespace
+
+TEST_CASE( "Parsers", "[benchmark][parse]" ) {
+    StringFilterSet none;
+    YearFilterTuple allYears(0, 0);
+
+    for(auto const &src : benchmarkedDatasets(true)) {
+        std::string contents = readDataset(src.FILE);
+
+        BENCHMARK("parse " + src.CODE + " (" + std::to_string(contents.size()) + " bytes)") {
+            Areas areas;
+            parse(areas, src, contents, none, none, allYears);
+            return areas.size();
+        };
+    }
+
+    //a filter that rejects most rows, so the cost of filtering shows
+    StringFilterSet swansea = {"W06000011"};
+    YearFilterTuple fewYears(2010, 2012);
+    std::string popden = readDataset(BethYw::InputFiles::POPDEN.FILE);
+
+    BENCHMARK("parse popden, one area and three years") {
+        Areas areas;
+        parse(areas, BethYw::InputFiles::POPDEN, popden, swansea, none, fewYears);
+        return areas.size();
+    };
+}
+
+TEST_CASE( "Merges", "[benchmark][merge]" ) {
+    StringFilterSet none;
+    YearFilterTuple allYears(0, 0);
+
+    Areas popden;
+    parse(popden, BethYw::InputFiles::POPDEN, readDataset(BethYw::InputFiles::POPDEN.FILE),
+          none, none, allYears);
+
+    Areas biz;
+    parse(biz, BethYw::InputFiles::BIZ, readDataset(BethYw::InputFiles::BIZ.FILE),
+          none, none, allYears);
+
+    //each run merges into its own copy, made before the timing starts
+    BENCHMARK_ADVANCED("setArea, every area of biz into popden")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Areas> targets(meter.runs(), popden);
+
+        meter.measure([&](int i) {
+            for(auto const &area : biz.getAreas()) {
+                targets[i].setArea(area.first, area.second);
+            }
+            return targets[i].size();
+        });
+    };
+
+    BENCHMARK_ADVANCED("merge, biz into popden")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Areas> targets(meter.runs(), popden);
+
+        meter.measure([&](int i) {
+            targets[i].merge(biz);
+            return targets[i].size();
+        });
+    };
+
+    BENCHMARK_ADVANCED("setArea, every area of popden into an empty Areas")(Catch::Benchmark::Chronometer meter) {
+        std::vector<Areas> targets(meter.runs());
+
+        meter.measure([&](int i) {
+            for(auto const &area : popden.getAreas()) {
+                targets[i].setArea(area.first, area.second);
+            }
+            return targets[i].size();
+        });
+    };
+}
+
+TEST_CASE( "Filters", "[benchmark][filter]" ) {
+    std::unordered_map<std::string, std::string> names = {
+        {"eng", "Swansea"},
+        {"cym", "Abertawe"}
+    };
+
+    for(int size : {0, 1, 10, 100, 1000}) {
+        StringFilterSet filter;
+        for(int i = 0; i < size; i++) {
+            filter.insert("w" + std::to_string(6000000 + i * 7));
+        }
+
+        BENCHMARK("filterCheck, " + std::to_string(size) + " entries, code and names") {
+            return filterCheck(&filter, "W06000011", names);
+        };
+
+        BENCHMARK("filterCheck, " + std::to_string(size) + " entries, code and one name") {
+            return filterCheck(&filter, "W06000011", "Swansea");
+        };
+    }
+
+    YearFilterTuple range(2010, 2015);
+    BENCHMARK("yearFilterCheck, range of years") {
+        return yearFilterCheck(&range, 2012);
+    };
+}
+
+TEST_CASE( "Measure statistics", "[benchmark][measure]" ) {
+    for(int years : {10, 100, 1000}) {
+        Measure measure("pop", "Population");
+        for(int year = 0; year < years; year++) {
+            measure.setValue(1000 + year, 1000.0 + year * 1.5);
+        }
+
+        std::string suffix = ", " + std::to_string(years) + " years";
+
+        BENCHMARK("getAverage" + suffix) {
+            return measure.getAverage();
+        };
+
+        BENCHMARK("getDifference" + suffix) {
+            return measure.getDifference();
+        };
+
+        BENCHMARK("getDifferenceAsPercentage" + suffix) {
+            return measure.getDifferenceAsPercentage();
+        };
+
+        //the middle half of the years
+        int firstYear = 1000 + years / 4;
+        int lastYear = 1000 + 3 * years / 4;
+
+        BENCHMARK("getRangeStats, scanned" + suffix) {
+            RangeStats stats;
+            measure.getRangeStats(firstYear, lastYear, stats);
+            return stats.sum;
+        };
+
+        Measure indexed = measure;
+        indexed.buildIndex();
+
+        BENCHMARK("getRangeStats, indexed" + suffix) {
+            RangeStats stats;
+            indexed.getRangeStats(firstYear, lastYear, stats);
+            return stats.sum;
+        };
+
+        BENCHMARK("buildIndex" + suffix) {
+            Measure built = measure;
+            built.buildIndex();
+            return built.hasIndex();
+        };
+
+        BENCHMARK("setValue" + suffix) {
+            Measure filled("pop", "Population");
+            for(int year = 0; year < years; year++) {
+                filled.setValue(1000 + year, year * 1.5);
+            }
+            return filled.size();
+        };
+    }
+}
+
+TEST_CASE( "Aggregations", "[benchmark][aggregate]" ) {
+    Areas const &all = loadAll();
+
+    std::vector<Aggregation::Statistic> statistics = {Aggregation::SUM,
+                                                      Aggregation::MEAN,
+                                                      Aggregation::MIN,
+                                                      Aggregation::MAX,
+                                                      Aggregation::COUNT};
+
+    std::vector<std::pair<std::string, std::vector<Aggregation::Key>>> groupings = {
+        {"nothing", {}},
+        {"measure", {Aggregation::MEASURE}},
+        {"measure,year", {Aggregation::MEASURE, Aggregation::YEAR}},
+        {"area,measure,year", {Aggregation::AREA, Aggregation::MEASURE, Aggregation::YEAR}}
+    };
+
+    for(auto const &grouping : groupings) {
+        Aggregation aggregation(grouping.second, statistics);
+
+        BENCHMARK("aggregate, all datasets, grouped by " + grouping.first) {
+            aggregation.aggregate(all);
+            return &aggregation;
+        };
+    }
+}
+
+TEST_CASE( "Rankings", "[benchmark][rank]" ) {
+    Areas const &all = loadAll();
+
+    for(std::size_t count : {1, 5, 100}) {
+        Ranking ranking(count, Ranking::PERCENTAGE_DIFFERENCE);
+
+        BENCHMARK("rank, all datasets, top " + std::to_string(count) + " by pct-diff") {
+            ranking.rank(all);
+            return &ranking;
+        };
+    }
+}
+
+TEST_CASE( "Conditions", "[benchmark][where]" ) {
+    Areas const &all = loadAll();
+
+    BENCHMARK("Predicate, compile") {
+        return Predicate("pop > 100000 and (dens < 50 or not area >= 1000)").getMeasures().size();
+    };
+
+    for(const char *condition : {"pop > 100000",
+                                 "pop > 100000 and dens < 50",
+                                 "pop < 0 and dens < 50",
+                                 "not (pop < 150000 or dens > area)"}) {
+        Predicate predicate(condition);
+        StringFilterSet allMeasures;
+
+        BENCHMARK("filter, all datasets, where " + std::string(condition)) {
+            return predicate.filter(all, allMeasures).size();
+        };
+    }
+}
+
+TEST_CASE( "Renderers", "[benchmark][output]" ) {
+    Areas const &all = loadAll();
+
+    BENCHMARK("operator<<, all datasets") {
+        std::ostringstream os;
+        os << all;
+        return os.str().size();
+    };
+
+    BENCHMARK("toJSON, all datasets") {
+        return all.toJSON().size();
+    };
+
+    Area const &swansea = all.getAreas().at("W06000011");
+
+    BENCHMARK("operator<<, one area") {
+        std::ostringstream os;
+        os << swansea;
+        return os.str().size();
+    };
+}
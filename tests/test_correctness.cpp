@@ -0,0 +1,648 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  Catch2 tests of the behaviour of the loading, storage and query engine
+  that the benchmarks in test_benchmarks.cpp only time. Build and run them
+  with:
+
+    ./build.sh test_correctness
+    ./bin/bethyw-test
+
+  from the root of the project (or from bin/). Pass a tag (e.g. "[input]")
+  to run only some of the tests.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../lib_catch.hpp"
+#include "../lib_json.hpp"
+
+#include "../aggregate.h"
+#include "../areas.h"
+#include "../datasets.h"
+#include "../input.h"
+#include "../predicate.h"
+#include "../measureindex.h"
+#include "../ranking.h"
+#include "../resultcache.h"
+#include "../snapshot.h"
+
+namespace {
+
+/*
+  Read a file of the datasets directory, whether the tests are run from the
+  root of the project or from bin/.
+*/
+std::string readDataset(std::string const &file) {
+    for(const char *dir : {"datasets/", "../datasets/"}) {
+        std::ifstream in(dir + file, std::ios_base::in | std::ios_base::binary);
+        if(in) {
+            std::ostringstream contents;
+            contents << in.rdbuf();
+            return contents.str();
+        }
+    }
+
+    FAIL("Could not find dataset file " << file);
+    return "";
+}
+
+std::uint32_t crc32(std::string const &data) {
+    std::uint32_t crc = 0xffffffff;
+    for(char c : data) {
+        crc ^= static_cast<unsigned char>(c);
+        for(int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+void appendLittleEndian(std::string &out, std::uint32_t value, int bytes) {
+    for(int i = 0; i < bytes; i++) {
+        out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+/*
+  `data` as a gzip file of uncompressed (stored) DEFLATE blocks.
+*/
+std::string gzipStored(std::string const &data) {
+    std::string out("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+
+    std::size_t offset = 0;
+    do {
+        std::size_t length = std::min<std::size_t>(data.size() - offset, 65535);
+        bool last = offset + length == data.size();
+        out += static_cast<char>(last ? 1 : 0);
+        appendLittleEndian(out, static_cast<std::uint32_t>(length), 2);
+        appendLittleEndian(out, static_cast<std::uint32_t>(~length & 0xffff), 2);
+        out.append(data, offset, length);
+        offset += length;
+    } while(offset < data.size());
+
+    appendLittleEndian(out, crc32(data), 4);
+    appendLittleEndian(out, static_cast<std::uint32_t>(data.size()), 4);
+    return out;
+}
+
+/*
+  Parse a dataset from memory, as the loading pipeline does.
+*/
+void parse(Areas &areas, BethYw::InputFileSource const &src, std::string contents) {
+    StringFilterSet none;
+    YearFilterTuple allYears(0, 0);
+
+    InputBuffer buffer(src.FILE, std::move(contents));
+    auto stream = buffer.open();
+    areas.populate(*stream, src.PARSER, src.COLS, &none, &none, &allYears);
+}
+
+/*
+  Add an area with the given values of each measure, e.g.
+  addArea(areas, "W06000011", {{"pop", {{2010, 1.0}}}}).
+*/
+void addArea(Areas &areas,
+             std::string const &code,
+             std::map<std::string, std::map<int, double>> const &measures) {
+    Area area(code);
+    area.setName("eng", "Area " + code);
+    for(auto const &measure : measures) {
+        Measure values(measure.first, "Label of " + measure.first);
+        for(auto const &value : measure.second) {
+            values.setValue(value.first, value.second);
+        }
+        area.setMeasure(measure.first, values);
+    }
+    areas.setArea(code, area);
+}
+
+/*
+  The years of a measure of an area, or none if it does not have the
+  measure (or the area).
+*/
+std::vector<int> yearsOf(Areas const &areas, std::string const &code, std::string const &measure) {
+    std::vector<int> years;
+    auto area = areas.getAreas().find(code);
+    if(area == areas.getAreas().end()) {
+        return years;
+    }
+
+    auto measures = area->second.getMeasuresList();
+    auto found = measures.find(measure);
+    if(found != measures.end()) {
+        for(auto const &value : found->second.getData()) {
+            years.push_back(value.first);
+        }
+    }
+    return years;
+}
+
+template<typename Output>
+nlohmann::json toJSON(Output const &output) {
+    std::ostringstream os;
+    output.writeJSON(os);
+    return nlohmann::json::parse(os.str());
+}
+
+/*
+  Whether two JSON documents are the same but for rounding in the last bits
+  of their numbers, as a sum from an index can be.
+*/
+bool nearlyEqual(nlohmann::json const &lhs, nlohmann::json const &rhs) {
+    if(lhs.is_number() && rhs.is_number()) {
+        return lhs.get<double>() == Approx(rhs.get<double>()).epsilon(1e-12);
+    }
+    if(lhs.type() != rhs.type() || lhs.size() != rhs.size()) {
+        return false;
+    }
+    if(lhs.is_object()) {
+        for(auto it = lhs.begin(); it != lhs.end(); ++it) {
+            if(!rhs.contains(it.key()) || !nearlyEqual(it.value(), rhs.at(it.key()))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if(lhs.is_array()) {
+        for(std::size_t i = 0; i < lhs.size(); i++) {
+            if(!nearlyEqual(lhs[i], rhs[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return lhs == rhs;
+}
+
+} // namespace
+
+TEST_CASE( "Compressed datasets are checked to the end", "[input]" ) {
+    for(auto const &src : {BethYw::InputFiles::POPDEN, BethYw::InputFiles::COMPLETE_POP}) {
+        std::string original = readDataset(src.FILE);
+        std::string compressed = gzipStored(original);
+
+        SECTION( src.CODE + " (" + src.FILE + ")" ) {
+            Areas plain, inflated;
+            parse(plain, src, original);
+            parse(inflated, src, compressed);
+            REQUIRE( inflated.size() == plain.size() );
+            REQUIRE( inflated.toJSON() == plain.toJSON() );
+
+            //the CRC-32, then the length, of the data are the last 8 bytes
+            for(std::size_t fromEnd : {6, 2}) {
+                std::string corrupt = compressed;
+                corrupt[corrupt.size() - fromEnd] ^= 0x5a;
+
+                Areas areas;
+                REQUIRE_THROWS_AS( parse(areas, src, corrupt), std::runtime_error );
+            }
+        }
+    }
+}
+
+TEST_CASE( "Snapshot values are checked against their checksum when used", "[snapshot]" ) {
+    auto const &src = BethYw::InputFiles::POPDEN;
+    Areas parsed;
+    parse(parsed, src, readDataset(src.FILE));
+
+    SnapshotWriter writer;
+    writer.addDataset(src, parsed);
+    std::string bytes = writer.finish();
+
+    StringFilterSet none;
+    YearFilterTuple allYears(0, 0);
+
+    Areas loaded;
+    Snapshot::fromBytes(bytes)->loadDataset(loaded, src.CODE, none, none, allYears);
+    REQUIRE( loaded.toJSON() == parsed.toJSON() );
+
+    SnapshotHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    for(std::uint64_t pos : {header.valuesPos, header.yearIdsPos}) {
+        std::string corrupt = bytes;
+        corrupt[pos] ^= 0x5a;
+
+        //only the header and index are checked on opening
+        auto snapshot = Snapshot::fromBytes(corrupt);
+        REQUIRE( snapshot->hasDataset(src.CODE) );
+
+        Areas areas;
+        REQUIRE_THROWS_AS( snapshot->loadDataset(areas, src.CODE, none, none, allYears),
+                           std::runtime_error );
+    }
+}
+
+TEST_CASE( "The result cache keeps the output of the newest data", "[cache]" ) {
+    ResultCache cache(1 << 20);
+    auto older = std::make_shared<const std::string>("older");
+    auto newer = std::make_shared<const std::string>("newer");
+
+    SECTION( "an output of older data does not replace one of newer data" ) {
+        cache.insert("query", 2, newer);
+        cache.insert("query", 1, older);
+        REQUIRE( cache.find("query", 2) == newer );
+    }
+
+    SECTION( "a lookup of older data does not drop an output of newer data" ) {
+        cache.insert("query", 2, newer);
+        REQUIRE( cache.find("query", 1) == nullptr );
+        REQUIRE( cache.find("query", 2) == newer );
+    }
+
+    SECTION( "an output of older data is replaced and dropped" ) {
+        cache.insert("query", 1, older);
+        REQUIRE( cache.find("query", 1) == older );
+        REQUIRE( cache.find("query", 2) == nullptr );
+        REQUIRE( cache.find("query", 1) == nullptr );
+
+        cache.insert("query", 1, older);
+        cache.insert("query", 2, newer);
+        REQUIRE( cache.find("query", 2) == newer );
+    }
+}
+
+TEST_CASE( "The result cache shares its budget between its shards", "[cache]" ) {
+    const std::size_t budget = 1 << 20;
+    ResultCache cache(budget);
+
+    SECTION( "an output larger than one shard's share is kept and served" ) {
+        auto large = std::make_shared<const std::string>(budget / 4, 'x');
+        cache.insert("large", 1, large);
+        REQUIRE( cache.find("large", 1) == large );
+    }
+
+    SECTION( "an output larger than its share of the budget is not kept" ) {
+        auto huge = std::make_shared<const std::string>(budget / 2 + 1, 'x');
+        cache.insert("huge", 1, huge);
+        REQUIRE( cache.find("huge", 1) == nullptr );
+    }
+
+    SECTION( "room for a large output is made in the other shards" ) {
+        std::vector<std::shared_ptr<const std::string>> outputs;
+        for(int i = 0; i < 100; i++) {
+            outputs.push_back(std::make_shared<const std::string>(budget / 128, 'x'));
+            cache.insert("small" + std::to_string(i), 1, outputs.back());
+        }
+
+        auto large = std::make_shared<const std::string>(budget / 3, 'x');
+        cache.insert("large", 1, large);
+        REQUIRE( cache.find("large", 1) == large );
+
+        //the most recent outputs survive; at least a third had to go
+        int kept = 0;
+        for(int i = 0; i < 100; i++) {
+            if(cache.find("small" + std::to_string(i), 1) != nullptr) {
+                kept++;
+            }
+        }
+        REQUIRE( kept > 0 );
+        REQUIRE( kept < 100 );
+        REQUIRE( cache.find("large", 1) == large );
+    }
+}
+
+TEST_CASE( "Conditions are parsed into a canonical form", "[where]" ) {
+    Predicate predicate("POP>100000 AND (dens<50||!area >= 1e3)");
+    REQUIRE( predicate.describe() == "pop > 100000 and ( dens < 50 || ! area >= 1e3 )" );
+    REQUIRE( predicate.getMeasures() == std::vector<std::string>({"pop", "dens", "area"}) );
+
+    REQUIRE( Predicate("50 > dens").describe() == "50 > dens" );
+    REQUIRE( Predicate("pop<>dens").getMeasures().size() == 2 );
+
+    for(const char *invalid : {"", "   ", "pop", "pop >", "pop > 1 and", "(pop > 1",
+                               "pop > 1)", "1 < 2", "pop ? 1", "pop > 1 dens < 2",
+                               "pop = = 1"}) {
+        INFO( "condition: " << invalid );
+        REQUIRE_THROWS_AS( Predicate(invalid), std::invalid_argument );
+    }
+}
+
+TEST_CASE( "Conditions keep the years whose values meet them", "[where]" ) {
+    Areas areas;
+    addArea(areas, "W1", {{"pop", {{2010, 10}, {2011, 20}, {2012, 30}}},
+                          {"dens", {{2010, 5}, {2012, 500}}}});
+    addArea(areas, "W2", {{"pop", {{2010, 1}}}});
+    StringFilterSet allMeasures;
+
+    SECTION( "a comparison with a missing value is false, and its negation true" ) {
+        Areas kept = Predicate("dens < 100").filter(areas, allMeasures);
+        REQUIRE( yearsOf(kept, "W1", "pop") == std::vector<int>({2010}) );
+        REQUIRE( kept.size() == 1 );
+
+        kept = Predicate("not dens < 100").filter(areas, allMeasures);
+        REQUIRE( yearsOf(kept, "W1", "pop") == std::vector<int>({2011, 2012}) );
+        REQUIRE( yearsOf(kept, "W2", "pop") == std::vector<int>({2010}) );
+    }
+
+    SECTION( "and/or skip their right-hand side only when the left decides" ) {
+        //or: a true left-hand side is the result, a false one is dropped
+        Areas kept = Predicate("pop >= 20 or dens = 5").filter(areas, allMeasures);
+        REQUIRE( yearsOf(kept, "W1", "pop") == std::vector<int>({2010, 2011, 2012}) );
+        REQUIRE( kept.size() == 1 );
+
+        //and: a false left-hand side is the result, a true one is dropped
+        kept = Predicate("pop >= 20 and dens > pop").filter(areas, allMeasures);
+        REQUIRE( yearsOf(kept, "W1", "pop") == std::vector<int>({2012}) );
+
+        //the result of a skipped group is still combined with what follows
+        kept = Predicate("(pop > 100 and dens > 0) or pop = 1").filter(areas, allMeasures);
+        REQUIRE( yearsOf(kept, "W1", "pop").empty() );
+        REQUIRE( yearsOf(kept, "W2", "pop") == std::vector<int>({2010}) );
+
+        kept = Predicate("not (pop < 15 or dens > 100) and pop > 0").filter(areas, allMeasures);
+        REQUIRE( yearsOf(kept, "W1", "pop") == std::vector<int>({2011}) );
+        REQUIRE( yearsOf(kept, "W1", "dens").empty() );
+    }
+
+    SECTION( "measures only imported for the condition are dropped" ) {
+        Predicate predicate("pop >= 20");
+
+        StringFilterSet onlyDens = {"dens"};
+        StringFilterSet imported = predicate.importFilter(onlyDens);
+        REQUIRE( imported == StringFilterSet({"dens", "pop"}) );
+        REQUIRE( predicate.importFilter(allMeasures).empty() );
+
+        Areas kept = predicate.filter(areas, onlyDens);
+        REQUIRE( yearsOf(kept, "W1", "dens") == std::vector<int>({2012}) );
+        REQUIRE( yearsOf(kept, "W1", "pop").empty() );
+        REQUIRE( kept.size() == 1 );
+
+        //an area left with none of the selected measures is dropped
+        REQUIRE( Predicate("pop = 1").filter(areas, onlyDens).size() == 0 );
+    }
+}
+
+TEST_CASE( "Aggregations are the same whether their groups are dense or sparse", "[aggregate]" ) {
+    std::vector<Aggregation::Statistic> statistics = {Aggregation::SUM, Aggregation::MEAN,
+                                                      Aggregation::MIN, Aggregation::MAX,
+                                                      Aggregation::COUNT};
+
+    SECTION( "a few values" ) {
+        Areas areas;
+        addArea(areas, "W1", {{"pop", {{2010, 10}, {2011, 20}}}, {"dens", {{2010, 1}}}});
+        addArea(areas, "W2", {{"pop", {{2010, 30}}}});
+
+        Aggregation aggregation({Aggregation::MEASURE}, statistics);
+        aggregation.aggregate(areas);
+        nlohmann::json groups = toJSON(aggregation);
+
+        REQUIRE( groups.size() == 2 );
+        REQUIRE( groups[0]["measure"] == "dens" );
+        REQUIRE( groups[0]["count"] == 1 );
+        REQUIRE( groups[1]["measure"] == "pop" );
+        REQUIRE( groups[1]["label"] == "Label of pop" );
+        REQUIRE( groups[1]["sum"] == 60.0 );
+        REQUIRE( groups[1]["mean"] == 20.0 );
+        REQUIRE( groups[1]["min"] == 10.0 );
+        REQUIRE( groups[1]["max"] == 30.0 );
+        REQUIRE( groups[1]["count"] == 3 );
+    }
+
+    SECTION( "a dataset" ) {
+        Areas dense;
+        parse(dense, BethYw::InputFiles::POPDEN, readDataset(BethYw::InputFiles::POPDEN.FILE));
+
+        //a value far in the future spreads the years too far for a dense
+        //array of every possible group
+        Areas sparse = dense;
+        addArea(sparse, "W99999999", {{"zzz", {{3000000, 42}}}});
+
+        std::vector<std::vector<Aggregation::Key>> groupings = {
+            {Aggregation::YEAR},
+            {Aggregation::AREA, Aggregation::MEASURE, Aggregation::YEAR},
+            {Aggregation::MEASURE, Aggregation::YEAR}};
+
+        for(auto const &groupBy : groupings) {
+            Aggregation aggregation(groupBy, statistics);
+
+            aggregation.aggregate(dense);
+            nlohmann::json denseGroups = toJSON(aggregation);
+            aggregation.aggregate(sparse);
+            nlohmann::json sparseGroups = toJSON(aggregation);
+
+            //the extra group is the last, in both area and year order
+            REQUIRE( denseGroups.size() > 1 );
+            REQUIRE( sparseGroups.size() == denseGroups.size() + 1 );
+            REQUIRE( sparseGroups.back()["sum"] == 42.0 );
+            sparseGroups.erase(sparseGroups.size() - 1);
+            REQUIRE( sparseGroups == denseGroups );
+        }
+    }
+}
+
+TEST_CASE( "Rankings keep the best areas, ties going to the lowest code", "[rank]" ) {
+    Areas areas;
+    addArea(areas, "W4", {{"pop", {{2010, 9}, {2011, 9}}}});
+    addArea(areas, "W3", {{"pop", {{2010, 5}, {2011, 5}}}});
+    addArea(areas, "W1", {{"pop", {{2010, 5}, {2011, 5}}}});
+    addArea(areas, "W2", {{"pop", {{2010, 5}, {2011, 5}}}});
+    addArea(areas, "W5", {{"pop", {{2010, 0}, {2011, 7}}}});
+
+    auto ranked = [&areas](Ranking ranking) {
+        ranking.rank(areas);
+        std::vector<std::string> codes;
+        for(auto const &row : toJSON(ranking)) {
+            REQUIRE( row["rank"] == codes.size() + 1 );
+            codes.push_back(row["area"]);
+        }
+        return codes;
+    };
+
+    REQUIRE( ranked(Ranking(2, Ranking::AVERAGE)) == std::vector<std::string>({"W4", "W1"}) );
+    REQUIRE( ranked(Ranking(4, Ranking::AVERAGE))
+             == std::vector<std::string>({"W4", "W1", "W2", "W3"}) );
+    REQUIRE( ranked(Ranking(10, Ranking::AVERAGE)).size() == 5 );
+    REQUIRE( ranked(Ranking(1, Ranking::DIFFERENCE)) == std::vector<std::string>({"W5"}) );
+
+    //a percentage difference from 0 is not a number, so W5 is not ranked
+    REQUIRE( ranked(Ranking(10, Ranking::PERCENTAGE_DIFFERENCE)).size() == 4 );
+
+    //nor is any area without a value in the year
+    REQUIRE( ranked(Ranking(10, Ranking::VALUE, 2012)).empty() );
+    REQUIRE( ranked(Ranking(2, Ranking::VALUE, 2011)) == std::vector<std::string>({"W4", "W5"}) );
+
+    REQUIRE_THROWS_AS( Ranking(0, Ranking::AVERAGE), std::invalid_argument );
+}
+
+TEST_CASE( "Aggregates and rankings from a snapshot are those of the Areas it loads", "[snapshot]" ) {
+    //complete-pop has the pop Measure of popden too, for other years, so
+    //the two are merged
+    std::vector<BethYw::InputFileSource> datasets = {BethYw::InputFiles::POPDEN,
+                                                     BethYw::InputFiles::COMPLETE_POP,
+                                                     BethYw::InputFiles::BIZ};
+
+    SnapshotWriter writer;
+    for(auto const &src : {BethYw::InputFiles::AREAS, datasets[0], datasets[1], datasets[2]}) {
+        Areas parsed;
+        parse(parsed, src, readDataset(src.FILE));
+        writer.addDataset(src, parsed);
+    }
+    auto snapshot = Snapshot::fromBytes(writer.finish());
+
+    //with its indexes, the statistics of each window of years come from
+    //them, and sums are the same but for the last bits
+    bool indexed = GENERATE(false, true);
+    if(indexed) {
+        snapshot->buildIndexes();
+    }
+
+    StringFilterSet none;
+    StringFilterSet someAreas = {"swan", "w06000015", "newport"};
+    StringFilterSet someMeasures = {"pop", "var1"};
+
+    struct Filters {
+        StringFilterSet const *areas;
+        StringFilterSet const *measures;
+        YearFilterTuple years;
+    };
+
+    for(Filters const &filters : {Filters{&none, &none, YearFilterTuple(0, 0)},
+                                  Filters{&someAreas, &none, YearFilterTuple(2005, 2012)},
+                                  Filters{&none, &someMeasures, YearFilterTuple(2011, 0)},
+                                  Filters{&someAreas, &someMeasures, YearFilterTuple(1990, 2000)}}) {
+        Areas loaded;
+        snapshot->load(loaded, datasets, *filters.areas, *filters.measures, filters.years);
+        SnapshotQuery query = snapshot->prepare(*filters.areas, *filters.measures, filters.years);
+
+        for(auto const &groupBy : std::vector<std::vector<Aggregation::Key>>{
+                    {}, {Aggregation::AREA, Aggregation::MEASURE}, {Aggregation::MEASURE, Aggregation::YEAR}}) {
+            Aggregation aggregation(groupBy, {Aggregation::SUM, Aggregation::MEAN, Aggregation::MIN,
+                                              Aggregation::MAX, Aggregation::COUNT});
+            aggregation.aggregate(loaded);
+            nlohmann::json fromAreas = toJSON(aggregation);
+            aggregation.aggregate(*snapshot, datasets, query);
+            REQUIRE( nearlyEqual(toJSON(aggregation), fromAreas) );
+            if(!indexed) {
+                REQUIRE( toJSON(aggregation) == fromAreas );
+            }
+        }
+
+        for(Ranking ranking : {Ranking(3, Ranking::AVERAGE), Ranking(5, Ranking::PERCENTAGE_DIFFERENCE),
+                               Ranking(4, Ranking::VALUE, 2011)}) {
+            ranking.rank(loaded);
+            nlohmann::json fromAreas = toJSON(ranking);
+            ranking.rank(*snapshot, datasets, query);
+            REQUIRE( nearlyEqual(toJSON(ranking), fromAreas) );
+            if(!indexed) {
+                REQUIRE( toJSON(ranking) == fromAreas );
+            }
+        }
+    }
+}
+
+TEST_CASE( "Conditions evaluated on a snapshot keep what they keep of the Areas it loads", "[where]" ) {
+    std::vector<BethYw::InputFileSource> datasets = {BethYw::InputFiles::POPDEN,
+                                                     BethYw::InputFiles::COMPLETE_POP,
+                                                     BethYw::InputFiles::BIZ};
+
+    SnapshotWriter writer;
+    for(auto const &src : {BethYw::InputFiles::AREAS, datasets[0], datasets[1], datasets[2]}) {
+        Areas parsed;
+        parse(parsed, src, readDataset(src.FILE));
+        writer.addDataset(src, parsed);
+    }
+    auto snapshot = Snapshot::fromBytes(writer.finish());
+
+    StringFilterSet none;
+    StringFilterSet someAreas = {"swan", "w06000015", "newport"};
+    StringFilterSet someMeasures = {"area", "var1"};
+    YearFilterTuple allYears(0, 0);
+    YearFilterTuple someYears(2005, 2015);
+
+    for(const char *condition : {"pop > 100000 and dens < 500", "pop > dens or var1 >= 10", "not area < 1000"}) {
+        Predicate where(condition);
+
+        for(auto const &filters : std::vector<std::pair<StringFilterSet const *, YearFilterTuple const *>>{
+                    {&none, &allYears}, {&someAreas, &someYears}}) {
+            for(StringFilterSet const *measuresFilter : {&none, &someMeasures}) {
+                StringFilterSet importFilter = where.importFilter(*measuresFilter);
+                Areas loaded;
+                snapshot->load(loaded, datasets, *filters.first, importFilter, *filters.second);
+                Areas expected = where.filter(loaded, *measuresFilter);
+                SnapshotQuery query = snapshot->prepare(*filters.first, importFilter, *filters.second);
+
+                REQUIRE( where.filter(*snapshot, datasets, query, *measuresFilter).toJSON()
+                         == expected.toJSON() );
+
+                Aggregation aggregation({Aggregation::AREA, Aggregation::MEASURE},
+                                        {Aggregation::SUM, Aggregation::COUNT});
+                aggregation.aggregate(expected);
+                nlohmann::json fromAreas = toJSON(aggregation);
+                aggregation.aggregate(*snapshot, datasets, query, where, *measuresFilter);
+                REQUIRE( toJSON(aggregation) == fromAreas );
+
+                Ranking ranking(3, Ranking::AVERAGE);
+                ranking.rank(expected);
+                fromAreas = toJSON(ranking);
+                ranking.rank(*snapshot, datasets, query, where, *measuresFilter);
+                REQUIRE( toJSON(ranking) == fromAreas );
+            }
+        }
+    }
+}
+
+TEST_CASE( "Range statistics from an index are those of scanning the values", "[index]" ) {
+    Measure scanned("pop", "Population");
+    for(int year = 1990; year <= 2020; year++) {
+        //a gap every few years, and values that do not add up exactly
+        if(year % 7 != 3) {
+            scanned.setValue(year, 1000.0 / (year - 1985) - (year % 5) * 37.1);
+        }
+    }
+    Measure indexed = scanned;
+    indexed.buildIndex();
+    REQUIRE( indexed.hasIndex() );
+
+    for(int firstYear = 1988; firstYear <= 2022; firstYear++) {
+        for(int lastYear = 1988; lastYear <= 2022; lastYear++) {
+            RangeStats expected, actual;
+            bool any = scanned.getRangeStats(firstYear, lastYear, expected);
+            REQUIRE( indexed.getRangeStats(firstYear, lastYear, actual) == any );
+            if(!any) {
+                continue;
+            }
+
+            REQUIRE( actual.count == expected.count );
+            REQUIRE( actual.firstYear == expected.firstYear );
+            REQUIRE( actual.lastYear == expected.lastYear );
+            REQUIRE( actual.min == expected.min );
+            REQUIRE( actual.max == expected.max );
+            REQUIRE( actual.difference == expected.difference );
+            REQUIRE( actual.differencePercentage == expected.differencePercentage );
+            REQUIRE( actual.sum == Approx(expected.sum).epsilon(1e-12) );
+            REQUIRE( actual.average == Approx(expected.average).epsilon(1e-12) );
+
+            //a range from the first value sums the values in the same order
+            if(firstYear <= 1990) {
+                REQUIRE( actual.sum == expected.sum );
+            }
+        }
+    }
+
+    //setting a value discards the index
+    indexed.setValue(2021, 1.0);
+    REQUIRE_FALSE( indexed.hasIndex() );
+
+    double total = 0;
+    for(auto const &value : indexed.getData()) {
+        total += value.second;
+    }
+    REQUIRE( indexed.getAverage() == total / indexed.size() );
+}
@@ -0,0 +1,84 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the ThreadPool class.
+ */
+
+#include "threadpool.h"
+#include "trace.h"
+
+/*
+  ThreadPool::ThreadPool(threads)
+
+  Start the worker threads.
+
+  @param threads
+    The number of workers (at least 1)
+*/
+ThreadPool::ThreadPool(std::size_t threads) {
+    if(threads == 0) {
+        threads = 1;
+    }
+
+    for(std::size_t i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+/*
+  ThreadPool::~ThreadPool()
+
+  Run the tasks still queued, then stop the worker threads.
+*/
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    hasTasks.notify_all();
+
+    for(std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+/*
+  The number of workers to use by default: one for each core.
+*/
+std::size_t ThreadPool::defaultThreads() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+/*
+  The loop of each worker thread: run tasks until the pool is stopped and
+  no tasks are left.
+*/
+void ThreadPool::work() {
+    Tracer::nameThread("worker");
+
+    while(true) {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            hasTasks.wait(guard, [this] { return stopping || !tasks.empty(); });
+
+            if(tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
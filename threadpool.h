@@ -0,0 +1,83 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the ThreadPool class, a fixed set of worker threads
+  that run queries (in server and batch mode) so that many queries can be
+  answered at once without starting more threads than there are cores.
+  Each task's allocations are counted against the MemStats subsystem of
+  the thread that submitted it.
+ */
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "memstats.h"
+
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+
+    std::mutex lock;
+    std::condition_variable hasTasks;
+
+    void work();
+
+public:
+    explicit ThreadPool(std::size_t threads = defaultThreads());
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    static std::size_t defaultThreads();
+
+    std::size_t size() const { return workers.size(); }
+
+    /*
+      Run `task` on one of the workers.
+
+      @param task
+        A callable with no arguments
+
+      @return
+        A future for the result of `task`, or the exception it threw
+    */
+    template <typename Task>
+    auto submit(Task task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packaged->get_future();
+        MemStats::Subsystem submitter = MemStats::current();
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            tasks.emplace_back([packaged, submitter]() {
+                MemStats::Scope scope(submitter);
+                (*packaged)();
+            });
+        }
+        hasTasks.notify_one();
+
+        return result;
+    }
+};
+
+#endif // THREADPOOL_H_
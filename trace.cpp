@@ -0,0 +1,155 @@
+
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the implementation of the Tracer class.
+ */
+
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+
+#include "lib_json.hpp"
+
+#include "trace.h"
+
+Tracer *Tracer::current = nullptr;
+
+namespace {
+
+std::atomic<std::uint32_t> nextThread(1);
+
+// this thread's id in traces, given the first time it records an event
+thread_local std::uint32_t threadId = 0;
+
+// this thread's name in traces
+thread_local std::string threadName;
+
+// the Tracer this thread's name was last given to
+thread_local const Tracer *namedTo = nullptr;
+
+} // namespace
+
+/*
+  Tracer::Tracer()
+
+  Start a timeline, at time 0.
+*/
+Tracer::Tracer() : started(Clock::now()) {}
+
+/*
+  Tracer::nameThread(name)
+
+  Name the calling thread in the timelines it records events in (threads
+  are otherwise named "thread <id>").
+
+  @param name
+    The thread's name, e.g. "parser"
+*/
+void Tracer::nameThread(std::string const &name) {
+    threadName = name;
+}
+
+Tracer::Span::Span(const char *category, const char *name, std::string const &dataset)
+    : tracer(current), category(category), name(name) {
+    if(tracer != nullptr) {
+        this->dataset = dataset;
+        tracer->add('B', category, name, dataset);
+    }
+}
+
+Tracer::Span::~Span() {
+    if(tracer != nullptr) {
+        tracer->add('E', category, name, dataset);
+    }
+}
+
+/*
+  Tracer::add(phase, category, name, dataset)
+
+  Record an event on the calling thread, now.
+
+  @param phase
+    'B' for the beginning of a span, 'E' for its end
+
+  @param category
+    The category of the span, e.g. "import"
+
+  @param name
+    The name of the span, e.g. "parse"
+
+  @param dataset
+    The dataset the span works on, or empty
+*/
+void Tracer::add(char phase, const char *category, const char *name, std::string const &dataset) {
+    double microseconds = std::chrono::duration<double, std::micro>(Clock::now() - started).count();
+
+    if(threadId == 0) {
+        threadId = nextThread++;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if(namedTo != this) {
+        namedTo = this;
+        threads.emplace_back(threadId,
+                             threadName.empty() ? "thread " + std::to_string(threadId) : threadName);
+    }
+    events.push_back(Event{phase, category, name, dataset, threadId, microseconds});
+}
+
+/*
+  Tracer::write(path)
+
+  Write the timeline recorded so far to a file, as a JSON object of the
+  form {"traceEvents":[...],"displayTimeUnit":"ms"}.
+
+  @param path
+    The file to write
+
+  @throws
+    std::runtime_error if the file cannot be written
+*/
+void Tracer::write(std::string const &path) const {
+    nlohmann::json trace;
+    nlohmann::json &traceEvents = trace["traceEvents"] = nlohmann::json::array();
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        for(auto const &thread : threads) {
+            traceEvents.push_back({{"name", "thread_name"},
+                                   {"ph", "M"},
+                                   {"pid", 1},
+                                   {"tid", thread.first},
+                                   {"args", {{"name", thread.second}}}});
+        }
+
+        for(auto const &event : events) {
+            nlohmann::json traced = {{"name", event.name},
+                                     {"cat", event.category},
+                                     {"ph", std::string(1, event.phase)},
+                                     {"ts", event.microseconds},
+                                     {"pid", 1},
+                                     {"tid", event.thread}};
+            if(!event.dataset.empty()) {
+                traced["args"] = {{"dataset", event.dataset}};
+            }
+            traceEvents.push_back(std::move(traced));
+        }
+    }
+
+    trace["displayTimeUnit"] = "ms";
+
+    std::ofstream file(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    file << trace.dump();
+    if(!file) {
+        throw std::runtime_error("Tracer::write: Failed to write file " + path);
+    }
+}
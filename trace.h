@@ -0,0 +1,86 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <979961>
+
+  This file contains the Tracer class, which records a timeline of a run of
+  Beth Yw? (--trace FILE): a begin and an end event, with the thread they
+  happened on, for each dataset file opened, each dataset parsed, merged or
+  filtered from a snapshot, and each part of the output rendered. The
+  timeline is written in the Chrome Trace Event format, which chrome://tracing
+  and Perfetto (ui.perfetto.dev) display, so that stragglers, idle workers
+  and points where the stages wait on each other can be seen.
+
+  Tracing is off unless a Tracer is made active, and a Tracer::Span costs
+  nothing but a null pointer check when it is off.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Tracer();
+
+    Tracer(Tracer const &) = delete;
+    Tracer &operator=(Tracer const &) = delete;
+
+    static Tracer *active() { return current; }
+    static void setActive(Tracer *tracer) { current = tracer; }
+
+    static void nameThread(std::string const &name);
+
+    /*
+      Records a begin event when it is made, and the matching end event when
+      it is destroyed, on the active Tracer (if any).
+    */
+    class Span {
+    public:
+        Span(const char *category, const char *name, std::string const &dataset = "");
+        ~Span();
+
+        Span(Span const &) = delete;
+        Span &operator=(Span const &) = delete;
+
+    private:
+        Tracer *tracer;
+        const char *category;
+        const char *name;
+        std::string dataset;
+    };
+
+    void write(std::string const &path) const;
+
+private:
+    struct Event {
+        char phase;
+        const char *category;
+        const char *name;
+        std::string dataset;
+        std::uint32_t thread;
+        double microseconds;
+    };
+
+    static Tracer *current;
+
+    Clock::time_point started;
+
+    mutable std::mutex lock;
+    std::vector<Event> events;
+    std::vector<std::pair<std::uint32_t, std::string>> threads;
+
+    void add(char phase, const char *category, const char *name, std::string const &dataset);
+};
+
+#endif // TRACE_H_